@@ -5,14 +5,43 @@
 #include <linux/sysfs.h>
 #include <linux/workqueue.h>
 #include <linux/jiffies.h>
-#include <linux/pid.h>        // find_vpid, pid_task
+#include <linux/pid.h>        // find_get_pid, pid_task
 #include <linux/sched.h>      // task_struct, set_user_nice
 #include <linux/kernel_stat.h>
 #include <linux/sched/loadavg.h>
 #include <linux/sched/cputime.h>
 #include <linux/tick.h>
 #include <linux/cpumask.h>    // for_each_online_cpu
+#include <linux/cpuhotplug.h>
+#include <linux/percpu.h>
+#include <linux/topology.h>   // cpumask_of_node
 #include <linux/smp.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/seqlock.h>
+#include <linux/hashtable.h>
+#include <linux/cgroup.h>
+#include <linux/sched/signal.h>  // for_each_thread, for_each_process_thread
+#include <uapi/linux/sched/types.h>  // struct sched_attr
+#include <linux/moduleparam.h>
+#include <linux/mm.h>             // si_meminfo, get_task_mm, get_mm_rss
+#include <linux/version.h>
+#include <linux/sort.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/uaccess.h>
+#include <linux/ioprio.h>     // set_task_ioprio
+
+#include "adaptive_sched_uapi.h"
+
+#define CREATE_TRACE_POINTS
+#include "adaptive_sched_trace.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Roman Bartusevych");
@@ -28,263 +57,4553 @@ MODULE_VERSION("0.5");
 // Boost level (0..3), controlled via sysfs "boost_level"
 static int boost_level = 0;
 
-// Average CPU load across all online CPUs (0..100), read-only via sysfs
-static int current_load = 0;
+/*
+ * Runqueue latency of one sample, see sample_runqueues(). wait_pct is the
+ * runqueue wait of all tasks per online CPU as a percentage of the sample
+ * (100 = on average one task waiting on every CPU, may exceed 100);
+ * target_wait_pct the same for all threads of the primary target, not
+ * divided by the CPUs. Both are lower bounds (what exited threads waited
+ * in their last interval is lost) and 0 without CONFIG_SCHED_INFO.
+ */
+struct rq_stats {
+    unsigned int nr_running;    // runnable tasks, running or queued
+    unsigned int nr_blocked;    // tasks sleeping in iowait
+    unsigned int waiting;       // runnable tasks queued behind another one
+    unsigned int max_depth;     // deepest per-CPU runqueue
+    unsigned int wait_pct;
+    pid_t target_pid;           // primary target the target_* fields describe
+    unsigned int target_wait_pct;
+    u64 target_run_delay_ns;    // total, like /proc/<pid>/schedstat
+};
+
+/*
+ * Published load metrics. The sampler (load_work, the only writer) updates
+ * them together with the cpu_history slot under metrics_lock; readers use
+ * read_metrics() and retry instead of blocking the sampler, so they always
+ * see one consistent sample.
+ */
+struct load_metrics {
+    int avg_load;       // average load across all online CPUs (current_load)
+    int max_load;       // maximum per-CPU load among online CPUs (max_load)
+    u64 seq;            // number of load samples taken so far
+    struct rq_stats rq;
+};
+
+static struct load_metrics metrics;
+static DEFINE_SEQLOCK(metrics_lock);
+
+/*
+ * ----------------------
+ * Overhead statistics
+ * ----------------------
+ * Time spent in the module's own hot paths, exported by the overhead
+ * attribute (bench/overhead_bench.py) so what the machinery costs can be
+ * compared across CPU counts and between builds.
+ */
+
+enum overhead_stat {
+    OVERHEAD_LOAD_WORK = 0,     // one whole load_work_func() run
+    OVERHEAD_SAMPLE,            // CPU and runqueue sampling within it
+    OVERHEAD_POLICY,            // run_kernel_policy() with a policy active
+    OVERHEAD_TOP_SCAN,          // scan_top_tasks()
+    OVERHEAD_BOOST,             // one apply_boost_to_target()
+    NR_OVERHEAD_STATS,
+};
+
+static const char * const overhead_names[] = {
+    [OVERHEAD_LOAD_WORK] = "load_work",
+    [OVERHEAD_SAMPLE]    = "sample",
+    [OVERHEAD_POLICY]    = "policy",
+    [OVERHEAD_TOP_SCAN]  = "top_scan",
+    [OVERHEAD_BOOST]     = "boost",
+};
+
+struct overhead_counter {
+    u64 count;
+    u64 total_ns;
+    u64 max_ns;
+    u64 last_ns;
+};
+
+static struct overhead_counter overhead[NR_OVERHEAD_STATS];
+static DEFINE_SPINLOCK(overhead_lock);
+
+static void overhead_account(int stat, u64 start_ns)
+{
+    struct overhead_counter *c = &overhead[stat];
+    u64 ns = ktime_get_ns() - start_ns;
+
+    spin_lock(&overhead_lock);
+    c->count++;
+    c->total_ns += ns;
+    c->last_ns = ns;
+    if (ns > c->max_ns)
+        c->max_ns = ns;
+    spin_unlock(&overhead_lock);
+}
+
+// Target process ID that will be controlled by this module
+// (legacy single-target interface, mirrors the primary entry below)
+static pid_t target_pid = 0;
+
+// Work item that periodically updates load metrics
+static struct delayed_work load_work;
+
+// Load notification thresholds (0..100), controlled via "notify_thresholds".
+// current_load / max_load are sysfs_notify()'ed when they move into another
+// band (below low, between, at or above high) or change by at least delta
+// since the last notification (delta = 0 disables the delta trigger).
+static int notify_low = 30;
+static int notify_high = 70;
+static int notify_delta = 20;
+
+/*
+ * Sampling period of load_work. With sample_adaptive enabled the period
+ * drops to sample_min_ms while load is changing or above notify_high and
+ * doubles towards sample_max_ms while the machine stays quiet.
+ */
+#define SAMPLE_PERIOD_MIN_MS   10
+#define SAMPLE_PERIOD_MAX_MS   10000
+#define SAMPLE_CHANGE_PCT      5      // avg_load change that counts as "moving"
+
+static unsigned int sample_period_ms = 500;
+module_param(sample_period_ms, uint, 0444);
+MODULE_PARM_DESC(sample_period_ms, "Load sampling period in ms (default 500)");
+
+static bool sample_adaptive = false;
+module_param(sample_adaptive, bool, 0444);
+MODULE_PARM_DESC(sample_adaptive, "Adapt the sampling period to load changes (default off)");
+
+static unsigned int sample_min_ms = 50;
+module_param(sample_min_ms, uint, 0444);
+MODULE_PARM_DESC(sample_min_ms, "Fastest adaptive sampling period in ms (default 50)");
+
+static unsigned int sample_max_ms = 2000;
+module_param(sample_max_ms, uint, 0444);
+MODULE_PARM_DESC(sample_max_ms, "Slowest adaptive sampling period in ms (default 2000)");
+
+// Period used for the next sample, read-only via "sample_interval_ms"
+static unsigned int sample_cur_ms = 500;
+
+/*
+ * How CPUs are sampled, controlled via "sample_mode":
+ *  serial  one kworker walks every online CPU
+ *  node    one work item per NUMA node runs on a CPU of that node and
+ *          samples only the node's CPUs; load_work reduces the partials
+ *  auto    node when more than one NUMA node is online, serial otherwise
+ */
+enum sample_mode {
+    SAMPLE_MODE_AUTO = 0,
+    SAMPLE_MODE_SERIAL,
+    SAMPLE_MODE_NODE,
+};
+
+static const char * const sample_mode_names[] = {
+    [SAMPLE_MODE_AUTO]   = "auto",
+    [SAMPLE_MODE_SERIAL] = "serial",
+    [SAMPLE_MODE_NODE]   = "node",
+};
+
+static int sample_mode = SAMPLE_MODE_AUTO;
+
+/*
+ * Previous cpustat values used for per-CPU load delta calculations,
+ * private to load_work (work items never run concurrently with themselves).
+ * Kept per CPU and cache-line aligned so entries of different CPUs never
+ * share a line. needs_reset is set by the CPU hotplug callbacks: the next
+ * sample of that CPU only re-initializes the baseline instead of producing
+ * a delta that spans the offline period.
+ */
+struct cpu_load_state {
+    u64 total;
+    u64 idle_all;       // idle + iowait
+    u64 iowait;
+    u64 irq;
+    u64 softirq;
+    u64 steal;
+    bool needs_reset;
+};
+
+static DEFINE_PER_CPU_SHARED_ALIGNED(struct cpu_load_state, cpu_state);
+
+// Dynamic hotplug state returned by cpuhp_setup_state_nocalls()
+static int adaptive_cpuhp_state = -1;
+
+/*
+ * Per-CPU history of the last history_depth samples, CPU-major:
+ * cpu_history[cpu * history_depth + slot]. history_head is the slot the
+ * next sample goes to (i.e. the oldest one once the ring has wrapped).
+ * Both are written under metrics_lock. A new sample is first built in
+ * cpu_staging (one entry per CPU) and copied in with the lock held.
+ */
+#define HISTORY_DEPTH_MAX 1024
+
+static unsigned int history_depth = 64;
+module_param(history_depth, uint, 0444);
+MODULE_PARM_DESC(history_depth, "Samples kept per CPU in cpu_history (default 64)");
+
+static struct adaptive_cpu_sample *cpu_history;
+static struct adaptive_cpu_sample *cpu_staging;
+static unsigned int history_head = 0;
+
+/*
+ * Load aggregated per NUMA node (node_groups[node]) and per LLC domain
+ * (llc_groups[first CPU of the domain], cnt == 0 for non-first CPUs).
+ * Built from the staged per-CPU samples and published with them under
+ * metrics_lock, the *_staging copies are private to load_work.
+ *
+ * LLC domains use topology_die_cpumask(), which matches the shared last
+ * level cache on most systems and is available to modules on every
+ * architecture (the x86 cpu_llc_shared_map is not exported).
+ */
+struct load_group {
+    int avg;
+    int max;
+    int cnt;            // online CPUs in the group
+};
+
+static struct load_group *node_groups, *node_groups_staging;
+static struct load_group *llc_groups, *llc_groups_staging;
+
+static void read_metrics(struct load_metrics *m)
+{
+    unsigned int seq;
+
+    do {
+        seq = read_seqbegin(&metrics_lock);
+        *m = metrics;
+    } while (read_seqretry(&metrics_lock, seq));
+}
+
+/*
+ * Recent CPU usage per process, for target selection without ps. After a
+ * sample, load_work sums sum_exec_runtime over the threads of every user
+ * process and compares it with the previous scan (per-tgid entries in
+ * tgid_runtimes, private to load_work). A bounded min-heap keeps the
+ * TOP_TASKS_MAX processes with the largest delta while walking, so no
+ * full sort is needed. They are published in top_tasks (text) and
+ * top_table (binary, struct adaptive_top_task), CPU usage as a
+ * percentage of one CPU over the scan interval (like top, may exceed
+ * 100). Every scan walks all user processes and their threads under RCU,
+ * which costs O(threads) on a busy host, so scans are at least
+ * TOP_SCAN_MIN_MS apart, however fast load_work samples.
+ */
+#define TOP_TASKS_MAX       ADAPTIVE_TOP_TASKS_MAX
+#define TOP_HASH_BITS       10
+#define TOP_SCAN_MIN_MS     1000
+
+struct tgid_runtime {
+    struct hlist_node node;
+    pid_t tgid;
+    u64 start_time;     // of the leader, tells a reused tgid apart
+    u64 runtime;
+    u64 run_delay;
+    u64 gen;            // last scan that saw the process
+};
+
+static DEFINE_HASHTABLE(tgid_runtimes, TOP_HASH_BITS);
+static u64 top_gen, top_stamp_ns;
+static struct adaptive_top_task top_heap[TOP_TASKS_MAX];   // min-heap on cpu_x10
+static int nr_top_heap;
+
+// Published result, heaviest first, protected by top_lock
+static struct adaptive_top_task top_tasks[TOP_TASKS_MAX];
+static int nr_top_tasks;
+static u64 top_seq, top_interval_ns;
+static DEFINE_MUTEX(top_lock);
+
+/*
+ * ----------------------
+ * Target table
+ * ----------------------
+ * Every controlled process has its own entry with an individual boost
+ * level, so several processes can be boosted at the same time.
+ *
+ * The legacy "target_pid" / "boost_level" files manage one entry marked
+ * as primary. Writing a new target_pid drops the previous primary entry;
+ * entries added through "targets" are left alone.
+ *
+ * A target covers either a single task, a whole thread group, or every
+ * task of a cgroup v2 subtree. Group and cgroup targets are re-applied on
+ * every load_work tick, so threads spawned after the boost pick it up too.
+ */
+
+#define ADAPTIVE_MAX_TARGETS 32
+
+enum target_scope {
+    SCOPE_TASK = 0,     // only the task with this pid
+    SCOPE_GROUP,        // every thread of the pid's thread group
+    SCOPE_CGROUP,       // every task inside a cgroup v2 subtree
+};
+
+static const char * const scope_names[] = {
+    [SCOPE_TASK]   = "task",
+    [SCOPE_GROUP]  = "group",
+    [SCOPE_CGROUP] = "cgroup",
+};
+
+// Scheduling attributes of a task as they were before a target changed them
+struct task_sched_state {
+    unsigned int policy;
+    int nice;
+    unsigned int rt_priority;
+    u64 dl_runtime;
+    u64 dl_deadline;
+    u64 dl_period;
+    unsigned int util_min;
+    unsigned int util_max;
+    bool reset_on_fork;
+    int ioprio;
+};
+
+struct adaptive_target {
+    struct list_head list;
+    pid_t pid;              // 0 for cgroup targets
+    struct pid *pid_ref;    // resolved once, NULL for cgroup targets
+    int boost;              // 0..3
+    int applied;            // level of the last apply_boost_to_target()
+    int scope;              // enum target_scope
+    bool primary;           // owned by target_pid / boost_level
+    int policy;             // enum boost_policy
+    bool throttle;          // member of the throttle set, boost is its level
+    struct cgroup *cgrp;    // SCOPE_CGROUP only, holds a reference
+    char *cgrp_path;        // SCOPE_CGROUP only, as written by the user
+
+    // Real-time tier bookkeeping, see rt_budget
+    bool rt_throttled;      // fell back to nice (budget spent / no admission)
+    u64 rt_runtime_ns;      // target CPU time at rt_stamp_ns
+    u64 rt_stamp_ns;
+    u64 refresh_ns;         // last re-walk by refresh_targets()
+
+    // CPU placement for the current boost level, see level_affinity
+    bool affinity_active;   // aff_mask is applied
+    cpumask_var_t aff_mask;
+
+    // Original attributes of the changed tasks, see the task ledger
+    struct list_head ledger;
+    u64 boost_start_ns;     // when the target left level 0, 0 at level 0
+    bool base_valid;
+    struct task_sched_state base;   // for threads started after boost_start_ns
+    cpumask_var_t base_mask;
+};
+
+static LIST_HEAD(target_list);
+static int nr_targets = 0;
+
+// Entry owned by target_pid / boost_level, NULL if none
+static struct adaptive_target *primary_target;
+
+// Scope used for the primary target (legacy interface), "target_scope"
+static int primary_scope = SCOPE_TASK;
+
+/*
+ * CPU placement per boost level, controlled via "boost_affinity":
+ *  none       leave the affinity alone (level 0 always: restores it)
+ *  idle <n>   pin to the n least-loaded online CPUs, taken from the least
+ *             loaded NUMA node that has n online CPUs if there is one
+ *  set <cpus> pin to a reserved CPU list (e.g. isolated cores)
+ * The mask is chosen when a target enters the level and kept until the
+ * level changes, so the target does not hop between CPUs every sample.
+ */
+enum affinity_mode {
+    AFFINITY_NONE = 0,
+    AFFINITY_IDLE,
+    AFFINITY_SET,
+};
+
+struct boost_affinity {
+    int mode;               // enum affinity_mode
+    int nr_cpus;            // AFFINITY_IDLE
+    cpumask_var_t cpus;     // AFFINITY_SET
+};
+
+static struct boost_affinity level_affinity[4];
+
+/*
+ * IO priority per boost level, controlled via "boost_ioprio": class
+ * (rt, be, idle) and level (0 highest .. 7) of the target's tasks, so
+ * IO-bound targets are served ahead of competing readers and writers.
+ * "none" (0) keeps the ioprio the task had before the boost. Applies to
+ * boost targets of every policy, not to the throttle set.
+ */
+// IOPRIO_PRIO_VALUE() is an inline function since 6.5, not a constant
+#define LEVEL_IOPRIO(class, data)   (((class) << IOPRIO_CLASS_SHIFT) | (data))
+
+static int level_ioprio[4] = {
+    [1] = LEVEL_IOPRIO(IOPRIO_CLASS_BE, 2),
+    [2] = LEVEL_IOPRIO(IOPRIO_CLASS_BE, 1),
+    [3] = LEVEL_IOPRIO(IOPRIO_CLASS_BE, 0),
+};
+
+static const char * const ioprio_class_names[] = {
+    [IOPRIO_CLASS_NONE] = "none",
+    [IOPRIO_CLASS_RT]   = "rt",
+    [IOPRIO_CLASS_BE]   = "be",
+    [IOPRIO_CLASS_IDLE] = "idle",
+};
+
+/*
+ * How a target is boosted, selectable per target ("targets") and for
+ * target_pid ("boost_policy"):
+ *  nice      nice 0/-2/-5/-10 per level (default)
+ *  batch     SCHED_BATCH with nice 0/2/5/10, demotes noisy neighbors
+ *  uclamp    util_clamp_min 0/256/512/1024 per level, the nice value is
+ *            left alone; raises the frequency/placement floor only
+ *  fifo      as nice for levels 1-2, SCHED_FIFO priority 1 at level 3
+ *  deadline  as nice for levels 1-2, SCHED_DEADLINE at level 3
+ * and for the throttle set ("throttle"), which deprioritizes the tasks
+ * competing with the targets instead of boosting the targets further:
+ *  demote    nice 0/5/10/19 per level (default)
+ *  idle      SCHED_IDLE at every level above 0
+ *  batch     as above
+ * The real-time tiers are bounded by "rt_budget" (runtime_ms per
+ * period_ms): every SCHED_DEADLINE thread gets that reservation, while a
+ * SCHED_FIFO target falls back to nice for one sample whenever the whole
+ * target used more than runtime_ms/period_ms of one CPU during the last
+ * sample. The kernel's own RT throttling stays the last line of defence.
+ */
+enum boost_policy {
+    POLICY_NICE = 0,
+    POLICY_BATCH,
+    POLICY_UCLAMP,
+    POLICY_FIFO,
+    POLICY_DEADLINE,
+    POLICY_DEMOTE,
+    POLICY_IDLE,
+};
+
+static const char * const policy_names[] = {
+    [POLICY_NICE]     = "nice",
+    [POLICY_BATCH]    = "batch",
+    [POLICY_UCLAMP]   = "uclamp",
+    [POLICY_FIFO]     = "fifo",
+    [POLICY_DEADLINE] = "deadline",
+    [POLICY_DEMOTE]   = "demote",
+    [POLICY_IDLE]     = "idle",
+};
+
+// Boost policy used for target_pid, controlled via "boost_policy"
+static int primary_policy = POLICY_NICE;
+
+#define RT_TIER_LEVEL       3       // first boost level using the RT class
+#define RT_FIFO_PRIO        1
+
+static unsigned int rt_runtime_ms = 20;
+static unsigned int rt_period_ms = 100;
+
+/*
+ * In-kernel boost policy: the rule table of decide_boost_level() in the
+ * userspace controller. With policy_mode "kernel", load_work evaluates it
+ * after every sample and sets boost_level of the primary target itself,
+ * so boosting reacts within one sample period and keeps working while
+ * the daemon is dead or stalled. "user" (default) leaves boost_level to
+ * userspace. A level fires when any of
+ *   avg_load >= avg, max_load >= max, target CPU % >= proc,
+ *   target runqueue wait % >= wait (see struct rq_stats),
+ *   memory used % >= mem and running tasks >= run
+ * holds, 101 disables a percentage. The highest firing level wins.
+ * Going up is immediate; going down needs the lower level to hold with
+ * the percentages lowered by policy_margin for policy_dwell_ms (checked
+ * once per sample, so rounded up to the sample period), like the
+ * controllers' ADAPTIVE_BOOST_DWELL.
+ *
+ * policy_mode "model" replaces the rule table with a tree ensemble
+ * uploaded through policy_model (export_model.py, format in the uapi
+ * header), evaluated with integer compares only; going down still needs
+ * policy_dwell_ms. Until a model is loaded the rules are used.
+ */
+struct policy_rule {
+    int avg;
+    int max;
+    int proc;
+    int mem;
+    int run;
+    int wait;
+};
+
+#define POLICY_RULE_OFF     101
+
+static struct policy_rule policy_rules[4] = {
+    [1] = {  40, 101, 30, 70, 4,  20 },
+    [2] = {  70, 101, 60, 80, 6,  40 },
+    [3] = { 101,  90, 80, 90, 8, 101 },
+};
+
+enum policy_mode {
+    POLICY_MODE_USER = 0,
+    POLICY_MODE_KERNEL,
+    POLICY_MODE_MODEL,
+};
+
+static const char * const policy_mode_names[] = {
+    [POLICY_MODE_USER]   = "user",
+    [POLICY_MODE_KERNEL] = "kernel",
+    [POLICY_MODE_MODEL]  = "model",
+};
+
+static int policy_mode = POLICY_MODE_USER;
+static int policy_margin = 5;
+static int policy_dwell_ms = 1000;
+
+// State of the in-kernel policy for the primary target
+static struct {
+    struct adaptive_target *target;
+    u64 runtime_ns;     // process CPU time at stamp_ns
+    u64 stamp_ns;
+    u64 down_since_ns;  // since a lower level holds, 0 if it does not
+} kpolicy;
+
+// Model used by policy_mode "model", a whole validated model file
+static struct adaptive_model_header *policy_model;
+
+// Protects target_list, nr_targets, target_pid, boost_level, primary_scope,
+// primary_policy, rt_runtime_ms/rt_period_ms, level_affinity, level_ioprio
+// and the policy_* settings including policy_model
+static DEFINE_MUTEX(targets_lock);
+
+/*
+ * ----------------------
+ * Helper: map boost_level -> nice value
+ * ----------------------
+ *  boost_level = 0 -> nice = 0   (default priority)
+ *  boost_level = 1 -> nice = -2  (slightly increased priority)
+ *  boost_level = 2 -> nice = -5  (higher priority)
+ *  boost_level = 3 -> nice = -10 (aggressive boost)
+ */
+
+static int boost_to_nice(int boost)
+{
+    switch (boost) {
+    case 0: return 0;
+    case 1: return -2;
+    case 2: return -5;
+    case 3:
+    default:
+        return -10;
+    }
+}
+
+// throttle level -> nice for POLICY_DEMOTE
+static int throttle_to_nice(int level)
+{
+    switch (level) {
+    case 0: return 0;
+    case 1: return 5;
+    case 2: return 10;
+    case 3:
+    default:
+        return 19;
+    }
+}
+
+// boost_level -> sched_util_min for POLICY_UCLAMP
+static const unsigned int boost_util_min[4] = {
+    0, 256, 512, SCHED_CAPACITY_SCALE,
+};
+
+/*
+ * ----------------------
+ * Helper: compute real CPU load (%) using kernel cpustat
+ * ----------------------
+ * Method: compare per-CPU usage counters since last sample.
+ * CPU load = (busy_time / total_time) * 100
+ *
+ * The split-out iowait/irq/softirq/steal percentages of the same interval
+ * are stored in *sample. busy counts everything but idle and iowait, so
+ * irq, softirq and steal are part of it (as before).
+ */
+
+static u8 delta_pct(u64 part, u64 total)
+{
+    u64 pct = div64_u64(part * 100, total);
+
+    return pct > 100 ? 100 : (u8)pct;
+}
+
+static int get_cpu_load(int cpu, struct adaptive_cpu_sample *sample)
+{
+    struct kernel_cpustat *kcpustat_ptr;
+    struct cpu_load_state *prev;
+    u64 user, nice, system, idle, iowait, irq, softirq, steal;
+    u64 idle_all, total;
+    u64 diff_idle, diff_total;
+
+    kcpustat_ptr = &kcpustat_cpu(cpu);
+    prev = per_cpu_ptr(&cpu_state, cpu);
+
+    user    = kcpustat_ptr->cpustat[CPUTIME_USER];
+    nice    = kcpustat_ptr->cpustat[CPUTIME_NICE];
+    system  = kcpustat_ptr->cpustat[CPUTIME_SYSTEM];
+    idle    = kcpustat_ptr->cpustat[CPUTIME_IDLE];
+    iowait  = kcpustat_ptr->cpustat[CPUTIME_IOWAIT];
+    irq     = kcpustat_ptr->cpustat[CPUTIME_IRQ];
+    softirq = kcpustat_ptr->cpustat[CPUTIME_SOFTIRQ];
+    steal   = kcpustat_ptr->cpustat[CPUTIME_STEAL];
+
+    idle_all = idle + iowait;
+    total = user + nice + system + idle_all + irq + softirq + steal;
+
+    // First measurement for this CPU (or first after hotplug): initialize
+    if (prev->total == 0 || READ_ONCE(prev->needs_reset)) {
+        WRITE_ONCE(prev->needs_reset, false);
+        prev->total    = total;
+        prev->idle_all = idle_all;
+        prev->iowait   = iowait;
+        prev->irq      = irq;
+        prev->softirq  = softirq;
+        prev->steal    = steal;
+        return 0;
+    }
+
+    diff_total = total - prev->total;
+    diff_idle  = idle_all - prev->idle_all;
+
+    if (diff_total != 0) {
+        sample->busy    = delta_pct(diff_total - diff_idle, diff_total);
+        sample->iowait  = delta_pct(iowait - prev->iowait, diff_total);
+        sample->irq     = delta_pct(irq - prev->irq, diff_total);
+        sample->softirq = delta_pct(softirq - prev->softirq, diff_total);
+        sample->steal   = delta_pct(steal - prev->steal, diff_total);
+        sample->flags   = ADAPTIVE_CPU_SAMPLE_VALID;
+    }
+
+    prev->total    = total;
+    prev->idle_all = idle_all;
+    prev->iowait   = iowait;
+    prev->irq      = irq;
+    prev->softirq  = softirq;
+    prev->steal    = steal;
+
+    if (diff_total == 0)
+        return 0;
+
+    return sample->busy;
+}
+
+/*
+ * ----------------------
+ * CPU hotplug: restart the load baseline of CPUs going on/offline
+ * ----------------------
+ */
+
+static int adaptive_cpu_online(unsigned int cpu)
+{
+    WRITE_ONCE(per_cpu_ptr(&cpu_state, cpu)->needs_reset, true);
+    return 0;
+}
+
+static int adaptive_cpu_offline(unsigned int cpu)
+{
+    WRITE_ONCE(per_cpu_ptr(&cpu_state, cpu)->needs_reset, true);
+    return 0;
+}
+
+/*
+ * ----------------------
+ * Helper: walk every task covered by a target
+ * ----------------------
+ * Calls fn() for each task under rcu_read_lock(), so fn() must not sleep
+ * (see get_target_tasks() for that). Kernel threads are skipped. Returns
+ * the number of visited tasks, or -ESRCH if the target process does not
+ * exist (anymore).
+ */
+
+typedef void (*target_task_fn)(struct task_struct *task,
+                               struct adaptive_target *t, void *data);
+
+static int for_each_target_task(struct adaptive_target *t, target_task_fn fn,
+                                void *data)
+{
+    struct task_struct *task, *thread;
+    struct cgroup_subsys_state *css;
+    struct css_task_iter it;
+    int visited = 0;
+
+    rcu_read_lock();
+
+    if (t->scope == SCOPE_CGROUP) {
+        // Only the css_sets of the subtree, not every thread in the system
+        css_for_each_descendant_pre(css, &t->cgrp->self) {
+            css_task_iter_start(css, 0, &it);
+            while ((thread = css_task_iter_next(&it))) {
+                if (thread->flags & PF_KTHREAD)
+                    continue;
+                fn(thread, t, data);
+                visited++;
+            }
+            css_task_iter_end(&it);
+        }
+        rcu_read_unlock();
+        return visited;
+    }
+
+    task = pid_task(t->pid_ref, PIDTYPE_PID);
+    if (!task) {
+        rcu_read_unlock();
+        return -ESRCH;
+    }
+
+    if (t->scope == SCOPE_GROUP) {
+        for_each_thread(task, thread) {
+            fn(thread, t, data);
+            visited++;
+        }
+    } else {
+        fn(task, t, data);
+        visited++;
+    }
+
+    rcu_read_unlock();
+    return visited;
+}
+
+/*
+ * Collect referenced tasks of a target so the caller may sleep while
+ * using them. Only tasks for which filter() returns true are collected.
+ * Release with put_target_tasks().
+ */
+
+typedef bool (*target_filter_fn)(struct task_struct *task, const void *arg);
+
+struct task_collector {
+    struct task_struct **tasks;
+    target_filter_fn filter;
+    const void *arg;
+    int nr;
+    int max;
+};
+
+static void count_task(struct task_struct *task, struct adaptive_target *t,
+                       void *data)
+{
+}
+
+static void collect_task(struct task_struct *task, struct adaptive_target *t,
+                         void *data)
+{
+    struct task_collector *c = data;
+
+    if (c->nr >= c->max)
+        return;
+    if (!c->filter(task, c->arg))
+        return;
+
+    get_task_struct(task);
+    c->tasks[c->nr++] = task;
+}
+
+static int get_target_tasks(struct adaptive_target *t, target_filter_fn filter,
+                            const void *arg, struct task_struct ***tasks)
+{
+    struct task_collector c = { .filter = filter, .arg = arg };
+    int nr;
+
+    nr = for_each_target_task(t, count_task, NULL);
+    if (nr <= 0)
+        return nr;
+
+    // Some slack for threads created between the two walks
+    c.max = nr + 16;
+    c.tasks = kvmalloc_array(c.max, sizeof(*c.tasks), GFP_KERNEL);
+    if (!c.tasks)
+        return -ENOMEM;
+
+    for_each_target_task(t, collect_task, &c);
+
+    *tasks = c.tasks;
+    return c.nr;
+}
+
+static void put_target_tasks(struct task_struct **tasks, int nr)
+{
+    int i;
+
+    for (i = 0; i < nr; i++)
+        put_task_struct(tasks[i]);
+    kvfree(tasks);
+}
+
+/*
+ * ----------------------
+ * Helper: ledger of original scheduling attributes (targets_lock held)
+ * ----------------------
+ * The first time a target changes a task, the task's nice, policy, RT/DL
+ * parameters, util clamps and ioprio are recorded here together with a task
+ * reference, and its CPU mask once it is placed. Level 0, switching the
+ * policy, removing the target and unloading the module write them back;
+ * entries of exited tasks are dropped by refresh_targets(). Threads
+ * started after the target left level 0 inherited boosted values, so
+ * they are recorded with the target's base values instead: those of
+ * the pid's own task, defaults for cgroup targets.
+ */
+
+struct ledger_entry {
+    struct hlist_node hnode;        // task_ledger, keyed by task
+    struct list_head list;          // owner->ledger
+    struct task_struct *task;       // holds a reference
+    struct adaptive_target *owner;
+    struct task_sched_state orig;
+    bool mask_saved;
+    cpumask_var_t mask;             // original affinity if mask_saved
+};
+
+#define TASK_LEDGER_BITS 8
+
+static DEFINE_HASHTABLE(task_ledger, TASK_LEDGER_BITS);
+
+// IOPRIO_CLASS_NONE (follows nice) until the task has an io_context
+static int task_ioprio(struct task_struct *task)
+{
+    int ioprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_NONE, 0);
+
+    task_lock(task);
+    if (task->io_context)
+        ioprio = task->io_context->ioprio;
+    task_unlock(task);
+
+    return ioprio;
+}
+
+static void read_sched_state(struct task_struct *task,
+                             struct task_sched_state *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->policy = task->policy;
+    st->nice = task_nice(task);
+    st->rt_priority = task->rt_priority;
+    st->dl_runtime = task->dl.dl_runtime;
+    st->dl_deadline = task->dl.dl_deadline;
+    st->dl_period = task->dl.dl_period;
+#ifdef CONFIG_UCLAMP_TASK
+    st->util_min = task->uclamp_req[UCLAMP_MIN].value;
+    st->util_max = task->uclamp_req[UCLAMP_MAX].value;
+#else
+    st->util_max = SCHED_CAPACITY_SCALE;
+#endif
+    st->reset_on_fork = task->sched_reset_on_fork;
+    st->ioprio = task_ioprio(task);
+}
+
+static void default_sched_state(struct task_sched_state *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->policy = SCHED_NORMAL;
+    st->util_max = SCHED_CAPACITY_SCALE;
+}
+
+static bool fair_sched_policy(unsigned int policy)
+{
+    return policy == SCHED_NORMAL || policy == SCHED_BATCH ||
+           policy == SCHED_IDLE;
+}
+
+static struct ledger_entry *ledger_find(struct task_struct *task)
+{
+    struct ledger_entry *e;
+
+    hash_for_each_possible(task_ledger, e, hnode, (unsigned long)task) {
+        if (e->task == task)
+            return e;
+    }
+
+    return NULL;
+}
+
+static bool started_after_boost(struct adaptive_target *t,
+                                struct task_struct *task)
+{
+    return t->base_valid && t->boost_start_ns &&
+           task->start_time >= t->boost_start_ns;
+}
+
+// Remember the CPU mask before the first placement of a task
+static bool ledger_save_mask(struct adaptive_target *t, struct ledger_entry *e,
+                             gfp_t gfp)
+{
+    if (e->mask_saved)
+        return true;
+    if (!zalloc_cpumask_var(&e->mask, gfp))
+        return false;
+
+    if (started_after_boost(t, e->task))
+        cpumask_copy(e->mask, t->base_mask);
+    else
+        cpumask_copy(e->mask, &e->task->cpus_mask);
+    e->mask_saved = true;
+
+    return true;
+}
+
+/*
+ * Look up or create the ledger entry of a task. Runs inside the RCU walk,
+ * hence GFP_ATOMIC; targets leave tasks without an entry alone. A task
+ * already recorded by another target keeps that entry.
+ */
+static struct ledger_entry *ledger_track(struct adaptive_target *t,
+                                         struct task_struct *task)
+{
+    struct ledger_entry *e = ledger_find(task);
+
+    if (e)
+        return e;
+
+    e = kzalloc(sizeof(*e), GFP_ATOMIC);
+    if (!e)
+        return NULL;
+
+    if (started_after_boost(t, task))
+        e->orig = t->base;
+    else
+        read_sched_state(task, &e->orig);
+
+    if (!t->base_valid && task_pid_vnr(task) == t->pid) {
+        t->base = e->orig;
+        cpumask_copy(t->base_mask, &task->cpus_mask);
+        t->base_valid = true;
+    }
+
+    get_task_struct(task);
+    e->task = task;
+    e->owner = t;
+    hash_add(task_ledger, &e->hnode, (unsigned long)task);
+    list_add_tail(&e->list, &t->ledger);
+
+    // New threads of a placed target inherited the placement as well
+    if (t->affinity_active && started_after_boost(t, task))
+        ledger_save_mask(t, e, GFP_ATOMIC);
+
+    return e;
+}
+
+static void ledger_track_task(struct task_struct *task,
+                              struct adaptive_target *t, void *data)
+{
+    ledger_track(t, task);
+}
+
+static void ledger_restore_mask(struct ledger_entry *e)
+{
+    int ret;
+
+    if (!e->mask_saved)
+        return;
+
+    if (!(e->task->flags & PF_EXITING)) {
+        ret = set_cpus_allowed_ptr(e->task, e->mask);
+        if (ret)
+            pr_debug("adaptive_sched: restoring affinity of pid=%d failed (%d)\n",
+                     task_pid_nr(e->task), ret);
+    }
+
+    free_cpumask_var(e->mask);
+    e->mask_saved = false;
+}
+
+static void ledger_restore(struct ledger_entry *e)
+{
+    struct task_struct *task = e->task;
+    const struct task_sched_state *orig = &e->orig;
+    struct task_sched_state cur;
+    struct sched_attr attr;
+    int ret;
+
+    ledger_restore_mask(e);
+
+    if (task->flags & PF_EXITING)
+        return;
+
+    read_sched_state(task, &cur);
+
+    if (cur.ioprio != orig->ioprio) {
+        ret = set_task_ioprio(task, orig->ioprio);
+        if (ret)
+            pr_debug("adaptive_sched: restoring ioprio of pid=%d failed (%d)\n",
+                     task_pid_nr(task), ret);
+    }
+
+    // Only the nice value changed: no need for sched_setattr()
+    if (cur.policy == orig->policy && fair_sched_policy(orig->policy) &&
+        cur.util_min == orig->util_min && cur.util_max == orig->util_max &&
+        cur.reset_on_fork == orig->reset_on_fork) {
+        if (cur.nice != orig->nice)
+            set_user_nice(task, orig->nice);
+        return;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = orig->policy;
+    attr.sched_nice = orig->nice;
+    attr.sched_priority = orig->rt_priority;
+    attr.sched_runtime = orig->dl_runtime;
+    attr.sched_deadline = orig->dl_deadline;
+    attr.sched_period = orig->dl_period;
+    if (orig->reset_on_fork)
+        attr.sched_flags |= SCHED_FLAG_RESET_ON_FORK;
+#ifdef CONFIG_UCLAMP_TASK
+    attr.sched_flags |= SCHED_FLAG_UTIL_CLAMP;
+    attr.sched_util_min = orig->util_min;
+    attr.sched_util_max = orig->util_max;
+#endif
+
+    ret = sched_setattr_nocheck(task, &attr);
+    if (ret)
+        pr_debug("adaptive_sched: restoring pid=%d failed (%d)\n",
+                 task_pid_nr(task), ret);
+}
+
+static void ledger_free(struct ledger_entry *e)
+{
+    hash_del(&e->hnode);
+    list_del(&e->list);
+    if (e->mask_saved)
+        free_cpumask_var(e->mask);
+    put_task_struct(e->task);
+    kfree(e);
+}
+
+// Give every task changed by the target its original attributes back
+static void restore_target(struct adaptive_target *t)
+{
+    struct ledger_entry *e, *tmp;
+
+    // Threads spawned since the last walk still carry boosted values
+    if (t->boost_start_ns)
+        for_each_target_task(t, ledger_track_task, NULL);
+
+    list_for_each_entry_safe(e, tmp, &t->ledger, list) {
+        ledger_restore(e);
+        ledger_free(e);
+    }
+
+    t->affinity_active = false;
+    t->boost_start_ns = 0;
+    if (t->scope != SCOPE_CGROUP)
+        t->base_valid = false;
+}
+
+// Drop the entries of tasks that exited, nothing to restore for them
+static void ledger_prune(struct adaptive_target *t)
+{
+    struct ledger_entry *e, *tmp;
+
+    list_for_each_entry_safe(e, tmp, &t->ledger, list) {
+        if (e->task->exit_state || (e->task->flags & PF_EXITING))
+            ledger_free(e);
+    }
+}
+
+/*
+ * ----------------------
+ * Helper: apply the boost policy of a target at a level (targets_lock held)
+ * ----------------------
+ */
+
+static void target_sched_attr(const struct adaptive_target *t, int level,
+                              struct sched_attr *attr)
+{
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->sched_policy = SCHED_NORMAL;
+    attr->sched_nice = boost_to_nice(level);
+
+    switch (t->policy) {
+    case POLICY_BATCH:
+        attr->sched_nice = -boost_to_nice(level);
+        if (level > 0)
+            attr->sched_policy = SCHED_BATCH;
+        break;
+    case POLICY_UCLAMP:
+        attr->sched_flags = SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP_MIN;
+        attr->sched_util_min = boost_util_min[level];
+        break;
+    case POLICY_FIFO:
+        if (level < RT_TIER_LEVEL || t->rt_throttled)
+            break;
+        attr->sched_policy = SCHED_FIFO;
+        attr->sched_priority = RT_FIFO_PRIO;
+        attr->sched_nice = 0;
+        attr->sched_flags = SCHED_FLAG_RESET_ON_FORK;
+        break;
+    case POLICY_DEADLINE:
+        if (level < RT_TIER_LEVEL || t->rt_throttled)
+            break;
+        attr->sched_policy = SCHED_DEADLINE;
+        attr->sched_nice = 0;
+        attr->sched_flags = SCHED_FLAG_RESET_ON_FORK;
+        attr->sched_runtime = (u64)rt_runtime_ms * NSEC_PER_MSEC;
+        attr->sched_deadline = (u64)rt_period_ms * NSEC_PER_MSEC;
+        attr->sched_period = attr->sched_deadline;
+        break;
+    case POLICY_DEMOTE:
+        attr->sched_nice = throttle_to_nice(level);
+        break;
+    case POLICY_IDLE:
+        attr->sched_nice = 0;
+        if (level > 0)
+            attr->sched_policy = SCHED_IDLE;
+        break;
+    }
+}
+
+/*
+ * Only the batch, idle, fifo and deadline policies pick a class. Under the
+ * others (and below the RT tier) a task that was not SCHED_NORMAL before
+ * the boost keeps its class: RT and DL tasks are left alone, batch and
+ * idle ones only get the nice. Returns that original policy, SCHED_NORMAL
+ * if attr applies as is.
+ */
+static unsigned int kept_policy(struct task_struct *task,
+                                const struct sched_attr *attr)
+{
+    const struct ledger_entry *e;
+
+    if (attr->sched_policy != SCHED_NORMAL)
+        return SCHED_NORMAL;
+
+    e = ledger_find(task);
+    return e ? e->orig.policy : SCHED_NORMAL;
+}
+
+// Does the task need sched_setattr()? Plain nice changes do not.
+static bool task_needs_setattr(struct task_struct *task, const void *arg)
+{
+    const struct sched_attr *attr = arg;
+
+    if (kept_policy(task, attr) != SCHED_NORMAL)
+        return false;
+
+    if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MIN) {
+#ifdef CONFIG_UCLAMP_TASK
+        return task->uclamp_req[UCLAMP_MIN].value != attr->sched_util_min;
+#else
+        return false;
+#endif
+    }
+
+    if (task->policy != attr->sched_policy)
+        return true;
+
+    switch (attr->sched_policy) {
+    case SCHED_FIFO:
+        return task->rt_priority != attr->sched_priority;
+    case SCHED_DEADLINE:
+        return task->dl.dl_runtime != attr->sched_runtime ||
+               task->dl.dl_period != attr->sched_period;
+    default:
+        return false;
+    }
+}
+
+struct boost_walk {
+    const struct sched_attr *attr;
+    int pending;            // tasks left for sched_setattr()
+};
+
+// Runs under RCU: only the cheap nice update, count the rest
+static void boost_task(struct task_struct *task, struct adaptive_target *t,
+                       void *data)
+{
+    struct boost_walk *w = data;
+    const struct sched_attr *attr = w->attr;
+    unsigned int orig_policy;
+
+    // Never change a task whose original attributes are not recorded
+    if (!ledger_track(t, task))
+        return;
+
+    orig_policy = kept_policy(task, attr);
+    if (orig_policy != SCHED_NORMAL && orig_policy != SCHED_BATCH &&
+        orig_policy != SCHED_IDLE)
+        return;
+
+    if (task_needs_setattr(task, attr)) {
+        w->pending++;
+        return;
+    }
+
+    if (attr->sched_flags & SCHED_FLAG_KEEP_PARAMS)
+        return;
+    if (attr->sched_policy != SCHED_NORMAL && attr->sched_policy != SCHED_BATCH)
+        return;
+
+    if (task_nice(task) != attr->sched_nice)
+        set_user_nice(task, attr->sched_nice);
+}
+
+/*
+ * Move every task of the target to the policy's setting for level (> 0,
+ * level 0 is restore_target()). Tasks are recorded in the ledger first.
+ * sched_setattr() may sleep, so those tasks are collected first. If
+ * SCHED_DEADLINE admission fails, the target falls back to nice until
+ * its level is set again.
+ */
+static int boost_target_tasks(struct adaptive_target *t, int level)
+{
+    struct sched_attr attr;
+    struct boost_walk w = { .attr = &attr };
+    struct task_struct **tasks;
+    bool dl_failed = false;
+    int i, nr, nr_tasks, ret;
+
+    target_sched_attr(t, level, &attr);
+
+    nr = for_each_target_task(t, boost_task, &w);
+    if (nr <= 0 || !w.pending)
+        return nr;
+
+    nr_tasks = get_target_tasks(t, task_needs_setattr, &attr, &tasks);
+    if (nr_tasks <= 0)
+        return nr;
+
+    for (i = 0; i < nr_tasks; i++) {
+        if (!ledger_find(tasks[i]))
+            continue;
+
+        ret = sched_setattr_nocheck(tasks[i], &attr);
+        if (!ret)
+            continue;
+
+        if (attr.sched_policy == SCHED_DEADLINE)
+            dl_failed = true;
+        pr_debug("adaptive_sched: sched_setattr(%s) of pid=%d failed (%d)\n",
+                 policy_names[t->policy], task_pid_nr(tasks[i]), ret);
+    }
+
+    put_target_tasks(tasks, nr_tasks);
+
+    if (dl_failed) {
+        pr_info("adaptive_sched: SCHED_DEADLINE refused for target pid=%d, falling back to nice\n",
+                t->pid);
+        t->rt_throttled = true;
+        return boost_target_tasks(t, level);
+    }
+
+    return nr;
+}
+
+static void sum_task_runtime(struct task_struct *task, struct adaptive_target *t,
+                             void *data)
+{
+    *(u64 *)data += READ_ONCE(task->se.sum_exec_runtime);
+}
+
+/*
+ * SCHED_FIFO budget: compare the CPU time the target used since the last
+ * sample against rt_runtime_ms/rt_period_ms of one CPU. Overspending drops
+ * the target to nice for one sample. Returns true if the state changed.
+ */
+static bool update_rt_budget(struct adaptive_target *t)
+{
+    u64 runtime = 0, now = ktime_get_ns();
+    u64 used, allowed;
+    bool throttled = false;
+
+    if (t->policy != POLICY_FIFO || t->boost < RT_TIER_LEVEL)
+        return false;
+    if (for_each_target_task(t, sum_task_runtime, &runtime) < 0)
+        return false;
+
+    if (t->rt_stamp_ns && !t->rt_throttled) {
+        // Threads that exited take their runtime with them
+        used = runtime > t->rt_runtime_ns ? runtime - t->rt_runtime_ns : 0;
+        allowed = div_u64((now - t->rt_stamp_ns) * rt_runtime_ms, rt_period_ms);
+        throttled = used > allowed;
+    }
+
+    t->rt_runtime_ns = runtime;
+    t->rt_stamp_ns = now;
+
+    if (throttled == t->rt_throttled)
+        return false;
+
+    t->rt_throttled = throttled;
+    pr_debug("adaptive_sched: SCHED_FIFO budget of pid=%d %s\n", t->pid,
+             throttled ? "spent, falling back to nice" : "restored");
+    return true;
+}
+
+// Undo everything the old policy changed before switching
+static void set_target_policy(struct adaptive_target *t, int policy)
+{
+    if (t->policy == policy)
+        return;
+
+    restore_target(t);
+    t->policy = policy;
+}
+
+/*
+ * ----------------------
+ * Helper: CPU placement of a target (targets_lock held)
+ * ----------------------
+ */
+
+// Pick the n least-loaded online CPUs of the latest sample into dst
+static void pick_idle_cpus(struct cpumask *dst, int n)
+{
+    const struct cpumask *candidates = cpu_online_mask;
+    struct load_group g;
+    unsigned int seq, slot;
+    int cpu, node, best_node = NUMA_NO_NODE, best_avg = INT_MAX;
+    u8 *busy;
+
+    cpumask_clear(dst);
+
+    busy = kmalloc(nr_cpu_ids, GFP_KERNEL);
+    if (!busy)
+        return;
+
+    do {
+        seq = read_seqbegin(&metrics_lock);
+        slot = (history_head + history_depth - 1) % history_depth;
+        for_each_possible_cpu(cpu) {
+            const struct adaptive_cpu_sample *sample =
+                &cpu_history[cpu * history_depth + slot];
+
+            busy[cpu] = (sample->flags & ADAPTIVE_CPU_SAMPLE_VALID) ?
+                        sample->busy : U8_MAX;
+        }
+    } while (read_seqretry(&metrics_lock, seq));
+
+    // Prefer staying on one node: the least loaded one that is big enough
+    for_each_online_node(node) {
+        do {
+            seq = read_seqbegin(&metrics_lock);
+            g = node_groups[node];
+        } while (read_seqretry(&metrics_lock, seq));
+
+        if (g.cnt >= n && g.avg < best_avg) {
+            best_avg = g.avg;
+            best_node = node;
+        }
+    }
+    if (best_node != NUMA_NO_NODE)
+        candidates = cpumask_of_node(best_node);
+
+    while (n-- > 0) {
+        int best = -1;
+
+        for_each_cpu_and(cpu, candidates, cpu_online_mask) {
+            if (cpumask_test_cpu(cpu, dst) || busy[cpu] == U8_MAX)
+                continue;
+            if (best < 0 || busy[cpu] < busy[best])
+                best = cpu;
+        }
+        if (best < 0)
+            break;
+
+        cpumask_set_cpu(best, dst);
+    }
+
+    kfree(busy);
+}
+
+static bool task_mask_differs(struct task_struct *task, const void *arg)
+{
+    return !cpumask_equal(task->cpus_ptr, arg);
+}
+
+static void set_target_affinity(struct adaptive_target *t,
+                                const struct cpumask *mask)
+{
+    struct task_struct **tasks;
+    int i, nr, ret;
+
+    nr = get_target_tasks(t, task_mask_differs, mask, &tasks);
+    if (nr <= 0)
+        return;
+
+    for (i = 0; i < nr; i++) {
+        struct ledger_entry *e = ledger_find(tasks[i]);
+
+        if (!e || !ledger_save_mask(t, e, GFP_KERNEL))
+            continue;
+
+        ret = set_cpus_allowed_ptr(tasks[i], mask);
+        if (ret)
+            pr_debug("adaptive_sched: set affinity of pid=%d failed (%d)\n",
+                     task_pid_nr(tasks[i]), ret);
+    }
+
+    put_target_tasks(tasks, nr);
+}
+
+static void restore_target_affinity(struct adaptive_target *t)
+{
+    struct ledger_entry *e;
+
+    if (!t->affinity_active)
+        return;
+
+    list_for_each_entry(e, &t->ledger, list)
+        ledger_restore_mask(e);
+    t->affinity_active = false;
+}
+
+static void update_target_affinity(struct adaptive_target *t)
+{
+    const struct boost_affinity *aff = &level_affinity[t->boost];
+
+    // Placement is a boost action, throttled tasks keep their CPUs
+    if (aff->mode == AFFINITY_NONE || t->throttle) {
+        restore_target_affinity(t);
+        return;
+    }
+
+    if (aff->mode == AFFINITY_IDLE)
+        pick_idle_cpus(t->aff_mask, aff->nr_cpus);
+    else
+        cpumask_and(t->aff_mask, aff->cpus, cpu_online_mask);
+
+    if (cpumask_empty(t->aff_mask)) {
+        pr_info("adaptive_sched: no CPUs available for boost_level=%d placement\n",
+                t->boost);
+        restore_target_affinity(t);
+        return;
+    }
+
+    t->affinity_active = true;
+    set_target_affinity(t, t->aff_mask);
+}
+
+/*
+ * ----------------------
+ * Helper: IO priority of a target (targets_lock held)
+ * ----------------------
+ */
+
+// ioprio a recorded task should have at the target's level
+static int target_task_ioprio(const struct adaptive_target *t,
+                              const struct ledger_entry *e)
+{
+    int ioprio = t->throttle ? 0 : level_ioprio[t->boost];
+
+    return ioprio ? ioprio : e->orig.ioprio;
+}
+
+static bool task_ioprio_differs(struct task_struct *task, const void *arg)
+{
+    const struct ledger_entry *e = ledger_find(task);
+
+    return e && task_ioprio(task) != target_task_ioprio(arg, e);
+}
+
+// set_task_ioprio() may allocate an io_context, so not under RCU
+static void set_target_ioprio(struct adaptive_target *t)
+{
+    struct task_struct **tasks;
+    struct ledger_entry *e;
+    int i, nr, ret;
+
+    nr = get_target_tasks(t, task_ioprio_differs, t, &tasks);
+    if (nr <= 0)
+        return;
+
+    for (i = 0; i < nr; i++) {
+        e = ledger_find(tasks[i]);
+        if (!e)
+            continue;
+
+        ret = set_task_ioprio(tasks[i], target_task_ioprio(t, e));
+        if (ret)
+            pr_debug("adaptive_sched: set_task_ioprio of pid=%d failed (%d)\n",
+                     task_pid_nr(tasks[i]), ret);
+    }
+
+    put_target_tasks(tasks, nr);
+}
+
+// Returns the number of tasks changed, -1 if the target has exited
+static int boost_target(struct adaptive_target *t)
+{
+    int nr;
+
+    // A new level starts a fresh budget period and retries admission
+    t->rt_throttled = false;
+    t->rt_stamp_ns = 0;
+
+    if (t->boost == 0) {
+        restore_target(t);
+        pr_debug("adaptive_sched: restored original attributes of %s %d%s%s\n",
+                t->scope == SCOPE_CGROUP ? "cgroup" : "pid", t->pid,
+                t->cgrp_path ? " " : "", t->cgrp_path ? t->cgrp_path : "");
+        return 0;
+    }
+
+    if (!t->boost_start_ns)
+        t->boost_start_ns = ktime_get_ns();
+
+    nr = boost_target_tasks(t, t->boost);
+    if (nr > 0 && !t->throttle)
+        set_target_ioprio(t);
+    update_target_affinity(t);
+
+    if (t->scope == SCOPE_CGROUP) {
+        pr_debug("adaptive_sched: applying %s_level=%d (%s) to cgroup %s (%d tasks)\n",
+                t->throttle ? "throttle" : "boost", t->boost,
+                policy_names[t->policy], t->cgrp_path, nr);
+        return nr;
+    }
+
+    if (nr < 0) {
+        pr_debug("adaptive_sched: target pid %d has exited\n", t->pid);
+        return nr;
+    }
+
+    pr_debug("adaptive_sched: applying %s_level=%d (%s) to pid=%d (%s, %d tasks)\n",
+            t->throttle ? "throttle" : "boost", t->boost,
+            policy_names[t->policy], t->pid, scope_names[t->scope], nr);
+    return nr;
+}
+
+// Nice value of the target's own task, 0 for cgroup targets
+static int target_nice(struct adaptive_target *t)
+{
+    struct task_struct *task;
+    int nice = 0;
+
+    if (!t->pid_ref)
+        return 0;
+
+    rcu_read_lock();
+    task = pid_task(t->pid_ref, PIDTYPE_PID);
+    if (task)
+        nice = task_nice(task);
+    rcu_read_unlock();
+
+    return nice;
+}
+
+// Move the target to t->boost; reason is an enum adaptive_boost_reason
+static void apply_boost_to_target(struct adaptive_target *t, int reason)
+{
+    bool traced = trace_adaptive_sched_boost_enabled();
+    int old_nice = traced ? target_nice(t) : 0;
+    u64 start = ktime_get_ns();
+    int nr;
+
+    nr = boost_target(t);
+    overhead_account(OVERHEAD_BOOST, start);
+
+    if (traced)
+        trace_adaptive_sched_boost(READ_ONCE(metrics.seq), t->pid, t->policy,
+                                   t->applied, t->boost, old_nice,
+                                   target_nice(t), nr, reason);
+    t->applied = t->boost;
+}
+
+
+/*
+ * Re-apply group and cgroup targets so that threads created after the
+ * boost are covered as well, and enforce the SCHED_FIFO budget. Called
+ * from load_work_func(). The budget is checked every sample; the re-walk
+ * (several passes over all tasks of the target) only every REFRESH_MIN_MS
+ * per target, or right away when the budget state changed.
+ */
+#define REFRESH_MIN_MS      200
+
+static void refresh_targets(void)
+{
+    bool traced = trace_adaptive_sched_boost_enabled();
+    struct adaptive_target *t;
+    u64 now = ktime_get_ns();
+    bool budget_changed;
+    int old_nice, nr;
+
+    mutex_lock(&targets_lock);
+    list_for_each_entry(t, &target_list, list) {
+        if (t->boost == 0) {
+            ledger_prune(t);
+            continue;
+        }
+
+        budget_changed = update_rt_budget(t);
+        if (t->scope == SCOPE_TASK && !budget_changed) {
+            ledger_prune(t);
+            continue;
+        }
+        if (!budget_changed && t->refresh_ns &&
+            now - t->refresh_ns < (u64)REFRESH_MIN_MS * NSEC_PER_MSEC)
+            continue;
+        t->refresh_ns = now;
+
+        ledger_prune(t);
+
+        old_nice = traced && budget_changed ? target_nice(t) : 0;
+        nr = boost_target_tasks(t, t->boost);
+        if (level_ioprio[t->boost] && !t->throttle)
+            set_target_ioprio(t);
+        if (t->affinity_active)
+            set_target_affinity(t, t->aff_mask);
+        if (traced && budget_changed)
+            trace_adaptive_sched_boost(READ_ONCE(metrics.seq), t->pid,
+                                       t->policy, t->boost, t->boost, old_nice,
+                                       target_nice(t), nr, BOOST_REASON_BUDGET);
+    }
+    mutex_unlock(&targets_lock);
+}
+
+/*
+ * ----------------------
+ * Helpers: target table management (targets_lock held)
+ * ----------------------
+ */
+
+static struct adaptive_target *find_target(pid_t pid)
+{
+    struct adaptive_target *t;
+
+    list_for_each_entry(t, &target_list, list) {
+        if (t->scope != SCOPE_CGROUP && t->pid == pid)
+            return t;
+    }
+
+    return NULL;
+}
+
+static struct adaptive_target *find_cgroup_target(struct cgroup *cgrp)
+{
+    struct adaptive_target *t;
+
+    list_for_each_entry(t, &target_list, list) {
+        if (t->scope == SCOPE_CGROUP && t->cgrp == cgrp)
+            return t;
+    }
+
+    return NULL;
+}
+
+// Forget the in-kernel policy state, e.g. when the primary target goes away
+static void reset_kernel_policy(void)
+{
+    kpolicy.target = NULL;
+    kpolicy.down_since_ns = 0;
+}
+
+static bool target_alive(struct adaptive_target *t)
+{
+    bool alive;
+
+    if (t->scope == SCOPE_CGROUP)
+        return true;
+
+    rcu_read_lock();
+    alive = pid_task(t->pid_ref, PIDTYPE_PID) != NULL;
+    rcu_read_unlock();
+
+    return alive;
+}
+
+// pid 0 creates a cgroup target, anything else must be a live process
+static struct adaptive_target *add_target(pid_t pid, int boost, int scope,
+                                          int policy)
+{
+    struct adaptive_target *t;
+    struct pid *pid_ref = NULL;
+
+    if (nr_targets >= ADAPTIVE_MAX_TARGETS)
+        return ERR_PTR(-ENOSPC);
+
+    if (pid) {
+        pid_ref = find_get_pid(pid);
+        if (!pid_ref)
+            return ERR_PTR(-ESRCH);
+    }
+
+    t = kzalloc(sizeof(*t), GFP_KERNEL);
+    if (!t) {
+        put_pid(pid_ref);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    if (!zalloc_cpumask_var(&t->aff_mask, GFP_KERNEL) ||
+        !zalloc_cpumask_var(&t->base_mask, GFP_KERNEL)) {
+        free_cpumask_var(t->aff_mask);
+        put_pid(pid_ref);
+        kfree(t);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    INIT_LIST_HEAD(&t->ledger);
+    t->pid = pid;
+    t->pid_ref = pid_ref;
+    t->boost = boost;
+    t->scope = scope;
+    t->policy = policy;
+
+    list_add_tail(&t->list, &target_list);
+    nr_targets++;
+
+    trace_adaptive_sched_target(TARGET_ACTION_ADD, pid, scope, policy, boost,
+                                false);
+    return t;
+}
+
+/*
+ * Consumes the cgroup reference: it is either stored in the new entry,
+ * or dropped if the cgroup is already a target.
+ */
+static struct adaptive_target *add_cgroup_target(struct cgroup *cgrp,
+                                                 const char *path, int boost,
+                                                 int policy)
+{
+    struct adaptive_target *t;
+    char *path_copy;
+
+    t = find_cgroup_target(cgrp);
+    if (t) {
+        cgroup_put(cgrp);
+        return t;
+    }
+
+    path_copy = kstrdup(path, GFP_KERNEL);
+    if (!path_copy) {
+        cgroup_put(cgrp);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    t = add_target(0, boost, SCOPE_CGROUP, policy);
+    if (IS_ERR(t)) {
+        kfree(path_copy);
+        cgroup_put(cgrp);
+        return t;
+    }
+
+    t->cgrp = cgrp;
+    t->cgrp_path = path_copy;
+
+    // Tasks spawned inside the cgroup while boosted fall back to defaults
+    default_sched_state(&t->base);
+    cpumask_copy(t->base_mask, cpu_possible_mask);
+    t->base_valid = true;
+
+    return t;
+}
+
+static void del_target(struct adaptive_target *t)
+{
+    trace_adaptive_sched_target(TARGET_ACTION_DEL, t->pid, t->scope,
+                                t->policy, t->boost, t->throttle);
+
+    if (t->primary) {
+        target_pid = 0;
+        primary_target = NULL;
+        reset_kernel_policy();
+    }
+
+    restore_target(t);
+
+    list_del(&t->list);
+    nr_targets--;
+
+    if (t->cgrp)
+        cgroup_put(t->cgrp);
+    put_pid(t->pid_ref);
+    free_cpumask_var(t->base_mask);
+    free_cpumask_var(t->aff_mask);
+    kfree(t->cgrp_path);
+    kfree(t);
+}
+
+/*
+ * find_target() for add paths: an entry whose process has exited is
+ * dropped, since its pid number may now belong to another process.
+ */
+static struct adaptive_target *find_live_target(pid_t pid)
+{
+    struct adaptive_target *t = find_target(pid);
+
+    if (t && !target_alive(t)) {
+        del_target(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+static void clear_targets(void)
+{
+    struct adaptive_target *t, *tmp;
+
+    list_for_each_entry_safe(t, tmp, &target_list, list)
+        del_target(t);
+}
+
+static void clear_target_set(bool throttle)
+{
+    struct adaptive_target *t, *tmp;
+
+    list_for_each_entry_safe(t, tmp, &target_list, list) {
+        if (t->throttle == throttle)
+            del_target(t);
+    }
+}
+
+static int clamp_boost(int val)
+{
+    if (val < 0) val = 0;
+    if (val > 3) val = 3;
+    return val;
+}
+
+static int parse_scope(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(scope_names); i++) {
+        if (sysfs_streq(name, scope_names[i]))
+            return i;
+    }
+
+    return -EINVAL;
+}
+
+// The throttle set only demotes, the boost set never does (except batch)
+static bool policy_allowed(int policy, bool throttle)
+{
+    switch (policy) {
+    case POLICY_BATCH:
+        return true;
+    case POLICY_DEMOTE:
+    case POLICY_IDLE:
+        return throttle;
+    default:
+        return !throttle;
+    }
+}
+
+static int parse_policy(const char *name, bool throttle)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(policy_names); i++) {
+        if (!sysfs_streq(name, policy_names[i]))
+            continue;
+        if (!policy_allowed(i, throttle))
+            return -EINVAL;
+#ifndef CONFIG_UCLAMP_TASK
+        if (i == POLICY_UCLAMP)
+            return -EOPNOTSUPP;
+#endif
+        return i;
+    }
+
+    return -EINVAL;
+}
+
+/*
+ * ----------------------
+ * sysfs: boost_level
+ * ----------------------
+ */
+
+static ssize_t boost_show(struct kobject *kobj,
+                          struct kobj_attribute *attr,
+                          char *buf)
+{
+    int val;
+
+    mutex_lock(&targets_lock);
+    val = boost_level;
+    mutex_unlock(&targets_lock);
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+}
+
+static ssize_t boost_store(struct kobject *kobj,
+                           struct kobj_attribute *attr,
+                           const char *buf,
+                           size_t count)
+{
+    struct adaptive_target *t;
+    int val;
+
+    if (kstrtoint(buf, 10, &val) == 0) {
+        mutex_lock(&targets_lock);
+
+        if (policy_mode != POLICY_MODE_USER) {
+            mutex_unlock(&targets_lock);
+            return -EBUSY;
+        }
+
+        boost_level = clamp_boost(val);
+        pr_debug("adaptive_sched: boost_level set to %d\n", boost_level);
+
+        // Hot path (the daemon writes every period): only act on changes
+        t = primary_target;
+        if (t && t->boost != boost_level) {
+            t->boost = boost_level;
+            apply_boost_to_target(t, BOOST_REASON_USER);
+        } else if (!t) {
+            pr_debug("adaptive_sched: no target_pid set, nothing to boost\n");
+        }
+
+        mutex_unlock(&targets_lock);
+    } else {
+        pr_info("adaptive_sched: invalid value for boost_level\n");
+    }
+
+    return count;
+}
+
+static struct kobj_attribute boost_attr =
+    __ATTR(boost_level, 0664, boost_show, boost_store);
+
+/*
+ * ----------------------
+ * sysfs: current_load (average load, read-only)
+ * ----------------------
+ */
+
+static ssize_t load_show(struct kobject *kobj,
+                         struct kobj_attribute *attr,
+                         char *buf)
+{
+    struct load_metrics m;
+
+    read_metrics(&m);
+    return scnprintf(buf, PAGE_SIZE, "%d\n", m.avg_load);
+}
+
+static struct kobj_attribute load_attr =
+    __ATTR(current_load, 0444, load_show, NULL);
+
+/*
+ * ----------------------
+ * sysfs: max_load (maximum per-CPU load, read-only)
+ * ----------------------
+ */
+
+static ssize_t max_load_show(struct kobject *kobj,
+                             struct kobj_attribute *attr,
+                             char *buf)
+{
+    struct load_metrics m;
+
+    read_metrics(&m);
+    return scnprintf(buf, PAGE_SIZE, "%d\n", m.max_load);
+}
+
+static struct kobj_attribute max_load_attr =
+    __ATTR(max_load, 0444, max_load_show, NULL);
+
+/*
+ * ----------------------
+ * sysfs: node_load / llc_load (read-only)
+ * ----------------------
+ * node_load: one line per NUMA node with online CPUs,
+ *            "<node> <avg> <max> <nr_cpus>"
+ * llc_load:  one line per LLC domain,
+ *            "<first_cpu> <avg> <max> <nr_cpus> <cpulist>"
+ */
+
+static ssize_t node_load_show(struct kobject *kobj,
+                              struct kobj_attribute *attr,
+                              char *buf)
+{
+    struct load_group g;
+    ssize_t len = 0;
+    unsigned int seq;
+    int node;
+
+    for (node = 0; node < nr_node_ids; node++) {
+        do {
+            seq = read_seqbegin(&metrics_lock);
+            g = node_groups[node];
+        } while (read_seqretry(&metrics_lock, seq));
+
+        if (g.cnt == 0)
+            continue;
+
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%d %d %d %d\n",
+                         node, g.avg, g.max, g.cnt);
+    }
+
+    return len;
+}
+
+static struct kobj_attribute node_load_attr =
+    __ATTR(node_load, 0444, node_load_show, NULL);
+
+static ssize_t llc_load_show(struct kobject *kobj,
+                             struct kobj_attribute *attr,
+                             char *buf)
+{
+    struct load_group g;
+    ssize_t len = 0;
+    unsigned int seq;
+    int cpu;
+
+    for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+        do {
+            seq = read_seqbegin(&metrics_lock);
+            g = llc_groups[cpu];
+        } while (read_seqretry(&metrics_lock, seq));
+
+        if (g.cnt == 0)
+            continue;
+
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%d %d %d %d %*pbl\n",
+                         cpu, g.avg, g.max, g.cnt,
+                         cpumask_pr_args(topology_die_cpumask(cpu)));
+    }
+
+    return len;
+}
+
+static struct kobj_attribute llc_load_attr =
+    __ATTR(llc_load, 0444, llc_load_show, NULL);
+
+/*
+ * ----------------------
+ * sysfs: runqueue / run_delay (read-only)
+ * ----------------------
+ * runqueue:  "<nr_running> <waiting> <max_depth>" of the last sample
+ * run_delay: "<wait_pct> <target_pid> <target_wait_pct> <target_delay_ns>",
+ *            see struct rq_stats
+ */
+
+static ssize_t runqueue_show(struct kobject *kobj,
+                             struct kobj_attribute *attr,
+                             char *buf)
+{
+    struct load_metrics m;
+
+    read_metrics(&m);
+    return scnprintf(buf, PAGE_SIZE, "%u %u %u\n",
+                     m.rq.nr_running, m.rq.waiting, m.rq.max_depth);
+}
+
+static struct kobj_attribute runqueue_attr =
+    __ATTR(runqueue, 0444, runqueue_show, NULL);
+
+static ssize_t run_delay_show(struct kobject *kobj,
+                              struct kobj_attribute *attr,
+                              char *buf)
+{
+    struct load_metrics m;
+
+    read_metrics(&m);
+    return scnprintf(buf, PAGE_SIZE, "%u %d %u %llu\n",
+                     m.rq.wait_pct, m.rq.target_pid, m.rq.target_wait_pct,
+                     m.rq.target_run_delay_ns);
+}
+
+static struct kobj_attribute run_delay_attr =
+    __ATTR(run_delay, 0444, run_delay_show, NULL);
+
+/*
+ * ----------------------
+ * sysfs: overhead
+ * ----------------------
+ * Read:  "cpus <online>" then per hot path
+ *        "<name> <count> <avg_ns> <max_ns> <last_ns>", see enum overhead_stat
+ * Write: "reset" (or 0) clears the counters
+ */
+
+static ssize_t overhead_show(struct kobject *kobj,
+                             struct kobj_attribute *attr,
+                             char *buf)
+{
+    struct overhead_counter c[NR_OVERHEAD_STATS];
+    ssize_t len;
+    int i;
+
+    spin_lock(&overhead_lock);
+    memcpy(c, overhead, sizeof(c));
+    spin_unlock(&overhead_lock);
+
+    len = scnprintf(buf, PAGE_SIZE, "cpus %u\n", num_online_cpus());
+    for (i = 0; i < NR_OVERHEAD_STATS; i++)
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%s %llu %llu %llu %llu\n",
+                         overhead_names[i], c[i].count,
+                         c[i].count ? div64_u64(c[i].total_ns, c[i].count) : 0,
+                         c[i].max_ns, c[i].last_ns);
+
+    return len;
+}
+
+static ssize_t overhead_store(struct kobject *kobj,
+                              struct kobj_attribute *attr,
+                              const char *buf, size_t count)
+{
+    if (!sysfs_streq(buf, "reset") && !sysfs_streq(buf, "0")) {
+        pr_info("adaptive_sched: invalid value for overhead\n");
+        return -EINVAL;
+    }
+
+    spin_lock(&overhead_lock);
+    memset(overhead, 0, sizeof(overhead));
+    spin_unlock(&overhead_lock);
+
+    return count;
+}
+
+static struct kobj_attribute overhead_attr =
+    __ATTR(overhead, 0664, overhead_show, overhead_store);
+
+/*
+ * ----------------------
+ * sysfs: top_tasks (read-only)
+ * ----------------------
+ * Heaviest processes of the last scan, one per line, highest first:
+ * "<tgid> <cpu%> <comm>", cpu% with one decimal.
+ */
+
+static ssize_t top_tasks_show(struct kobject *kobj,
+                              struct kobj_attribute *attr,
+                              char *buf)
+{
+    const struct adaptive_top_task *tt;
+    ssize_t len = 0;
+    int i;
+
+    mutex_lock(&top_lock);
+    for (i = 0; i < nr_top_tasks; i++) {
+        tt = &top_tasks[i];
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%d %u.%u %s\n",
+                         tt->tgid, tt->cpu_x10 / 10, tt->cpu_x10 % 10,
+                         tt->comm);
+    }
+    mutex_unlock(&top_lock);
+
+    return len;
+}
+
+static struct kobj_attribute top_tasks_attr =
+    __ATTR(top_tasks, 0444, top_tasks_show, NULL);
+
+/*
+ * ----------------------
+ * sysfs: notify_thresholds ("<low> <high> <delta>")
+ * ----------------------
+ * Userspace can poll() current_load / max_load (POLLPRI) and is woken
+ * when a threshold is crossed instead of re-reading them periodically.
+ */
+
+static ssize_t notify_thresholds_show(struct kobject *kobj,
+                                      struct kobj_attribute *attr,
+                                      char *buf)
+{
+    return scnprintf(buf, PAGE_SIZE, "%d %d %d\n",
+                     READ_ONCE(notify_low), READ_ONCE(notify_high),
+                     READ_ONCE(notify_delta));
+}
+
+static ssize_t notify_thresholds_store(struct kobject *kobj,
+                                       struct kobj_attribute *attr,
+                                       const char *buf,
+                                       size_t count)
+{
+    int low, high, delta = 0;
+
+    if (sscanf(buf, "%d %d %d", &low, &high, &delta) < 2 ||
+        low < 0 || high > 100 || low > high || delta < 0) {
+        pr_info("adaptive_sched: invalid value for notify_thresholds\n");
+        return -EINVAL;
+    }
+
+    WRITE_ONCE(notify_low, low);
+    WRITE_ONCE(notify_high, high);
+    WRITE_ONCE(notify_delta, delta);
+
+    return count;
+}
+
+static struct kobj_attribute notify_thresholds_attr =
+    __ATTR(notify_thresholds, 0664, notify_thresholds_show,
+           notify_thresholds_store);
+
+/*
+ * ----------------------
+ * sysfs: sampling period
+ * ----------------------
+ *  sample_period_ms    fixed period used when adaptive sampling is off
+ *  sample_adaptive     "<0|1> <min_ms> <max_ms>"
+ *  sample_interval_ms  period actually used for the next sample (read-only)
+ *
+ * A write reschedules the pending sample so the change applies at once.
+ */
+
+static bool valid_period(unsigned int ms)
+{
+    return ms >= SAMPLE_PERIOD_MIN_MS && ms <= SAMPLE_PERIOD_MAX_MS;
+}
+
+static void reschedule_load_work(void)
+{
+    unsigned int ms;
+
+    ms = READ_ONCE(sample_adaptive) ? READ_ONCE(sample_min_ms)
+                                    : READ_ONCE(sample_period_ms);
+    WRITE_ONCE(sample_cur_ms, ms);
+
+    mod_delayed_work(system_wq, &load_work, msecs_to_jiffies(ms));
+}
+
+static ssize_t sample_period_show(struct kobject *kobj,
+                                  struct kobj_attribute *attr,
+                                  char *buf)
+{
+    return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(sample_period_ms));
+}
+
+static ssize_t sample_period_store(struct kobject *kobj,
+                                   struct kobj_attribute *attr,
+                                   const char *buf,
+                                   size_t count)
+{
+    unsigned int ms;
+
+    if (kstrtouint(buf, 10, &ms) || !valid_period(ms)) {
+        pr_info("adaptive_sched: invalid value for sample_period_ms\n");
+        return -EINVAL;
+    }
+
+    WRITE_ONCE(sample_period_ms, ms);
+    reschedule_load_work();
+
+    return count;
+}
+
+static struct kobj_attribute sample_period_attr =
+    __ATTR(sample_period_ms, 0664, sample_period_show, sample_period_store);
+
+static ssize_t sample_adaptive_show(struct kobject *kobj,
+                                    struct kobj_attribute *attr,
+                                    char *buf)
+{
+    return scnprintf(buf, PAGE_SIZE, "%d %u %u\n",
+                     READ_ONCE(sample_adaptive) ? 1 : 0,
+                     READ_ONCE(sample_min_ms), READ_ONCE(sample_max_ms));
+}
+
+static ssize_t sample_adaptive_store(struct kobject *kobj,
+                                     struct kobj_attribute *attr,
+                                     const char *buf,
+                                     size_t count)
+{
+    unsigned int min_ms = READ_ONCE(sample_min_ms);
+    unsigned int max_ms = READ_ONCE(sample_max_ms);
+    int enable;
+
+    if (sscanf(buf, "%d %u %u", &enable, &min_ms, &max_ms) < 1 ||
+        !valid_period(min_ms) || !valid_period(max_ms) || min_ms > max_ms) {
+        pr_info("adaptive_sched: invalid value for sample_adaptive\n");
+        return -EINVAL;
+    }
+
+    WRITE_ONCE(sample_min_ms, min_ms);
+    WRITE_ONCE(sample_max_ms, max_ms);
+    WRITE_ONCE(sample_adaptive, enable != 0);
+    reschedule_load_work();
+
+    return count;
+}
+
+static struct kobj_attribute sample_adaptive_attr =
+    __ATTR(sample_adaptive, 0664, sample_adaptive_show, sample_adaptive_store);
+
+static ssize_t sample_interval_show(struct kobject *kobj,
+                                    struct kobj_attribute *attr,
+                                    char *buf)
+{
+    return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(sample_cur_ms));
+}
+
+static struct kobj_attribute sample_interval_attr =
+    __ATTR(sample_interval_ms, 0444, sample_interval_show, NULL);
+
+/*
+ * ----------------------
+ * sysfs: sample_mode ("auto", "serial" or "node")
+ * ----------------------
+ */
+
+static ssize_t sample_mode_show(struct kobject *kobj,
+                                struct kobj_attribute *attr,
+                                char *buf)
+{
+    return scnprintf(buf, PAGE_SIZE, "%s\n",
+                     sample_mode_names[READ_ONCE(sample_mode)]);
+}
+
+static ssize_t sample_mode_store(struct kobject *kobj,
+                                 struct kobj_attribute *attr,
+                                 const char *buf,
+                                 size_t count)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(sample_mode_names); i++) {
+        if (sysfs_streq(buf, sample_mode_names[i])) {
+            WRITE_ONCE(sample_mode, i);
+            return count;
+        }
+    }
+
+    pr_info("adaptive_sched: invalid value for sample_mode\n");
+    return -EINVAL;
+}
+
+static struct kobj_attribute sample_mode_attr =
+    __ATTR(sample_mode, 0664, sample_mode_show, sample_mode_store);
+
+/*
+ * ----------------------
+ * sysfs: target_pid
+ * ----------------------
+ */
+
+static ssize_t target_pid_show(struct kobject *kobj,
+                               struct kobj_attribute *attr,
+                               char *buf)
+{
+    pid_t val;
+
+    mutex_lock(&targets_lock);
+    val = target_pid;
+    mutex_unlock(&targets_lock);
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+}
+
+static ssize_t target_pid_store(struct kobject *kobj,
+                                struct kobj_attribute *attr,
+                                const char *buf,
+                                size_t count)
+{
+    struct adaptive_target *t;
+    pid_t pid_val;
+
+    if (kstrtoint(buf, 10, &pid_val) == 0) {
+        if (pid_val < 0) pid_val = 0;
+
+        mutex_lock(&targets_lock);
+
+        t = primary_target;
+        if (t && (t->pid != pid_val || !target_alive(t)))
+            del_target(t);
+
+        target_pid = pid_val;
+        pr_info("adaptive_sched: target_pid set to %d\n", target_pid);
+
+        if (target_pid > 0) {
+            t = find_live_target(target_pid);
+            if (t && t->throttle) {
+                del_target(t);
+                t = NULL;
+            }
+            if (!t)
+                t = add_target(target_pid, boost_level, primary_scope,
+                               primary_policy);
+
+            if (IS_ERR(t)) {
+                pr_info("adaptive_sched: failed to track target_pid %d (%ld)\n",
+                        target_pid, PTR_ERR(t));
+                target_pid = 0;
+            } else {
+                t->primary = true;
+                primary_target = t;
+                t->boost = boost_level;
+                trace_adaptive_sched_target(TARGET_ACTION_PRIMARY, t->pid,
+                                            t->scope, t->policy, t->boost,
+                                            t->throttle);
+                apply_boost_to_target(t, BOOST_REASON_TARGET);
+            }
+        }
+
+        mutex_unlock(&targets_lock);
+    } else {
+        pr_info("adaptive_sched: invalid value for target_pid\n");
+    }
+
+    return count;
+}
+
+static struct kobj_attribute target_pid_attr =
+    __ATTR(target_pid, 0664, target_pid_show, target_pid_store);
+
+/*
+ * ----------------------
+ * sysfs: targets (multi-PID table) and throttle (the throttle set)
+ * ----------------------
+ * Both files share the target table and ADAPTIVE_MAX_TARGETS, a PID or
+ * cgroup is either boosted or throttled, never both (-EBUSY).
+ * Read: one line per entry, "<pid> <level> <scope> <policy>", cgroup
+ * entries print pid 0 followed by the cgroup path, the primary entry is
+ * suffixed with " primary".
+ * Write commands:
+ *   add <pid> <level> [task|group] [policy]
+ *                                    add an entry or update it
+ *   del <pid>                        stop controlling a process
+ *   addcg <path> <level> [policy]    add a cgroup v2 subtree, path is
+ *                                    relative to the cgroup2 mount
+ *   delcg <path>                     stop controlling a cgroup
+ *   clear                            drop all entries of this file
+ * The policy defaults to "nice" for targets and "demote" for throttle.
+ */
+
+static ssize_t target_set_show(char *buf, bool throttle)
+{
+    struct adaptive_target *t;
+    ssize_t len = 0;
+
+    mutex_lock(&targets_lock);
+    list_for_each_entry(t, &target_list, list) {
+        if (t->throttle != throttle)
+            continue;
+
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%d %d %s %s%s%s%s\n",
+                         t->pid, t->boost, scope_names[t->scope],
+                         policy_names[t->policy],
+                         t->cgrp_path ? " " : "",
+                         t->cgrp_path ? t->cgrp_path : "",
+                         t->primary ? " primary" : "");
+    }
+    mutex_unlock(&targets_lock);
+
+    return len;
+}
+
+static ssize_t target_set_store(const char *buf, size_t count, bool throttle)
+{
+    struct adaptive_target *t;
+    struct cgroup *cgrp;
+    char word[8] = "task";
+    char pol[10];
+    char path[128];
+    pid_t pid_val;
+    int level, scope, policy, n;
+    ssize_t ret = count;
+
+    strscpy(pol, policy_names[throttle ? POLICY_DEMOTE : POLICY_NICE],
+            sizeof(pol));
+
+    mutex_lock(&targets_lock);
+
+    n = sscanf(buf, "add %d %d %7s %9s", &pid_val, &level, word, pol);
+    if (n >= 2 && pid_val > 0) {
+        level = clamp_boost(level);
+        scope = parse_scope(word);
+        policy = parse_policy(pol, throttle);
+        if (scope < 0 || scope == SCOPE_CGROUP) {
+            ret = -EINVAL;
+            goto out;
+        }
+        if (policy < 0) {
+            ret = policy;
+            goto out;
+        }
+
+        t = find_live_target(pid_val);
+        if (t && t->throttle != throttle) {
+            ret = -EBUSY;
+            goto out;
+        }
+        if (!t) {
+            t = add_target(pid_val, level, scope, policy);
+            if (!IS_ERR(t))
+                t->throttle = throttle;
+        }
+
+        if (IS_ERR(t)) {
+            ret = PTR_ERR(t);
+        } else {
+            set_target_policy(t, policy);
+            t->boost = level;
+            t->scope = scope;
+            if (t->primary)
+                boost_level = level;
+            apply_boost_to_target(t, BOOST_REASON_TARGET);
+        }
+    } else if (sscanf(buf, "addcg %127s %d %9s", path, &level, pol) >= 2) {
+        policy = parse_policy(pol, throttle);
+        if (policy < 0) {
+            ret = policy;
+            goto out;
+        }
+
+        cgrp = cgroup_get_from_path(path);
+        if (IS_ERR(cgrp)) {
+            ret = PTR_ERR(cgrp);
+            goto out;
+        }
+
+        t = find_cgroup_target(cgrp);
+        if (t && t->throttle != throttle) {
+            cgroup_put(cgrp);
+            ret = -EBUSY;
+            goto out;
+        }
+
+        t = add_cgroup_target(cgrp, path, clamp_boost(level), policy);
+        if (IS_ERR(t)) {
+            ret = PTR_ERR(t);
+        } else {
+            t->throttle = throttle;
+            set_target_policy(t, policy);
+            t->boost = clamp_boost(level);
+            apply_boost_to_target(t, BOOST_REASON_TARGET);
+        }
+    } else if (sscanf(buf, "delcg %127s", path) == 1) {
+        cgrp = cgroup_get_from_path(path);
+        if (IS_ERR(cgrp)) {
+            ret = PTR_ERR(cgrp);
+            goto out;
+        }
+
+        t = find_cgroup_target(cgrp);
+        cgroup_put(cgrp);
+        if (t && t->throttle == throttle)
+            del_target(t);
+        else
+            ret = -ENOENT;
+    } else if (sscanf(buf, "del %d", &pid_val) == 1) {
+        t = find_target(pid_val);
+        if (t && t->throttle == throttle)
+            del_target(t);
+        else
+            ret = -ENOENT;
+    } else if (sysfs_streq(buf, "clear")) {
+        clear_target_set(throttle);
+    } else {
+        pr_info("adaptive_sched: invalid command for %s\n",
+                throttle ? "throttle" : "targets");
+        ret = -EINVAL;
+    }
+
+out:
+    mutex_unlock(&targets_lock);
+
+    return ret;
+}
+
+static ssize_t targets_show(struct kobject *kobj,
+                            struct kobj_attribute *attr,
+                            char *buf)
+{
+    return target_set_show(buf, false);
+}
+
+static ssize_t targets_store(struct kobject *kobj,
+                             struct kobj_attribute *attr,
+                             const char *buf,
+                             size_t count)
+{
+    return target_set_store(buf, count, false);
+}
+
+static struct kobj_attribute targets_attr =
+    __ATTR(targets, 0664, targets_show, targets_store);
+
+static ssize_t throttle_show(struct kobject *kobj,
+                             struct kobj_attribute *attr,
+                             char *buf)
+{
+    return target_set_show(buf, true);
+}
+
+static ssize_t throttle_store(struct kobject *kobj,
+                              struct kobj_attribute *attr,
+                              const char *buf,
+                              size_t count)
+{
+    return target_set_store(buf, count, true);
+}
+
+static struct kobj_attribute throttle_attr =
+    __ATTR(throttle, 0664, throttle_show, throttle_store);
+
+/*
+ * ----------------------
+ * sysfs: target_scope ("task" or "group", used for target_pid)
+ * ----------------------
+ */
+
+static ssize_t target_scope_show(struct kobject *kobj,
+                                 struct kobj_attribute *attr,
+                                 char *buf)
+{
+    int scope;
+
+    mutex_lock(&targets_lock);
+    scope = primary_scope;
+    mutex_unlock(&targets_lock);
+
+    return scnprintf(buf, PAGE_SIZE, "%s\n", scope_names[scope]);
+}
+
+static ssize_t target_scope_store(struct kobject *kobj,
+                                  struct kobj_attribute *attr,
+                                  const char *buf,
+                                  size_t count)
+{
+    struct adaptive_target *t;
+    int scope = parse_scope(buf);
+
+    if (scope < 0 || scope == SCOPE_CGROUP) {
+        pr_info("adaptive_sched: invalid value for target_scope\n");
+        return -EINVAL;
+    }
+
+    mutex_lock(&targets_lock);
+
+    primary_scope = scope;
+    t = primary_target;
+    if (t) {
+        t->scope = scope;
+        apply_boost_to_target(t, BOOST_REASON_CONFIG);
+    }
+
+    mutex_unlock(&targets_lock);
+
+    return count;
+}
+
+static struct kobj_attribute target_scope_attr =
+    __ATTR(target_scope, 0664, target_scope_show, target_scope_store);
+
+/*
+ * ----------------------
+ * sysfs: boost_policy (nice|batch|uclamp|fifo|deadline, used for target_pid)
+ * ----------------------
+ */
+
+static ssize_t boost_policy_show(struct kobject *kobj,
+                                 struct kobj_attribute *attr,
+                                 char *buf)
+{
+    int policy;
+
+    mutex_lock(&targets_lock);
+    policy = primary_policy;
+    mutex_unlock(&targets_lock);
+
+    return scnprintf(buf, PAGE_SIZE, "%s\n", policy_names[policy]);
+}
+
+static ssize_t boost_policy_store(struct kobject *kobj,
+                                  struct kobj_attribute *attr,
+                                  const char *buf,
+                                  size_t count)
+{
+    struct adaptive_target *t;
+    int policy = parse_policy(buf, false);
+
+    if (policy < 0) {
+        pr_info("adaptive_sched: invalid value for boost_policy\n");
+        return policy;
+    }
+
+    mutex_lock(&targets_lock);
+
+    primary_policy = policy;
+    t = primary_target;
+    if (t) {
+        set_target_policy(t, policy);
+        apply_boost_to_target(t, BOOST_REASON_CONFIG);
+    }
+
+    mutex_unlock(&targets_lock);
+
+    return count;
+}
+
+static struct kobj_attribute boost_policy_attr =
+    __ATTR(boost_policy, 0664, boost_policy_show, boost_policy_store);
+
+/*
+ * ----------------------
+ * sysfs: rt_budget ("runtime_ms period_ms" of the fifo/deadline tiers)
+ * ----------------------
+ */
+
+static ssize_t rt_budget_show(struct kobject *kobj,
+                              struct kobj_attribute *attr,
+                              char *buf)
+{
+    unsigned int runtime, period;
+
+    mutex_lock(&targets_lock);
+    runtime = rt_runtime_ms;
+    period = rt_period_ms;
+    mutex_unlock(&targets_lock);
+
+    return scnprintf(buf, PAGE_SIZE, "%u %u\n", runtime, period);
+}
+
+static ssize_t rt_budget_store(struct kobject *kobj,
+                               struct kobj_attribute *attr,
+                               const char *buf,
+                               size_t count)
+{
+    struct adaptive_target *t;
+    unsigned int runtime, period;
+
+    if (sscanf(buf, "%u %u", &runtime, &period) != 2 ||
+        runtime == 0 || runtime > period || period > 1000) {
+        pr_info("adaptive_sched: invalid value for rt_budget\n");
+        return -EINVAL;
+    }
+
+    mutex_lock(&targets_lock);
+
+    rt_runtime_ms = runtime;
+    rt_period_ms = period;
+
+    list_for_each_entry(t, &target_list, list) {
+        if (t->policy == POLICY_DEADLINE && t->boost >= RT_TIER_LEVEL)
+            apply_boost_to_target(t, BOOST_REASON_CONFIG);
+    }
+
+    mutex_unlock(&targets_lock);
+
+    return count;
+}
+
+static struct kobj_attribute rt_budget_attr =
+    __ATTR(rt_budget, 0664, rt_budget_show, rt_budget_store);
+
+/*
+ * ----------------------
+ * sysfs: policy_mode ("user", "kernel" or "model"), policy_rules,
+ *        policy_hysteresis, policy_model
+ * ----------------------
+ * policy_rules: one line per level,
+ * "<level> <avg> <max> <proc> <mem> <run> <wait>", write one such line to
+ * change a level (<wait> may be left out).
+ * policy_hysteresis: "<margin> <dwell_ms>".
+ * boost_level rejects writes with -EBUSY unless policy_mode is "user".
+ */
+
+static ssize_t policy_mode_show(struct kobject *kobj,
+                                struct kobj_attribute *attr,
+                                char *buf)
+{
+    return scnprintf(buf, PAGE_SIZE, "%s\n",
+                     policy_mode_names[READ_ONCE(policy_mode)]);
+}
+
+static ssize_t policy_mode_store(struct kobject *kobj,
+                                 struct kobj_attribute *attr,
+                                 const char *buf,
+                                 size_t count)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(policy_mode_names); i++) {
+        if (sysfs_streq(buf, policy_mode_names[i])) {
+            mutex_lock(&targets_lock);
+            policy_mode = i;
+            reset_kernel_policy();
+            mutex_unlock(&targets_lock);
+            return count;
+        }
+    }
+
+    pr_info("adaptive_sched: invalid value for policy_mode\n");
+    return -EINVAL;
+}
+
+static struct kobj_attribute policy_mode_attr =
+    __ATTR(policy_mode, 0664, policy_mode_show, policy_mode_store);
+
+static ssize_t policy_rules_show(struct kobject *kobj,
+                                 struct kobj_attribute *attr,
+                                 char *buf)
+{
+    const struct policy_rule *r;
+    ssize_t len = 0;
+    int level;
+
+    mutex_lock(&targets_lock);
+    for (level = 1; level < ARRAY_SIZE(policy_rules); level++) {
+        r = &policy_rules[level];
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%d %d %d %d %d %d %d\n",
+                         level, r->avg, r->max, r->proc, r->mem, r->run,
+                         r->wait);
+    }
+    mutex_unlock(&targets_lock);
+
+    return len;
+}
+
+static bool valid_rule_pct(int v)
+{
+    return v >= 0 && v <= POLICY_RULE_OFF;
+}
+
+static ssize_t policy_rules_store(struct kobject *kobj,
+                                  struct kobj_attribute *attr,
+                                  const char *buf,
+                                  size_t count)
+{
+    struct policy_rule r;
+    int level, n;
+
+    // The wait column is optional, rules written without it leave it off
+    r.wait = POLICY_RULE_OFF;
+    n = sscanf(buf, "%d %d %d %d %d %d %d", &level, &r.avg, &r.max, &r.proc,
+               &r.mem, &r.run, &r.wait);
+    if (n < 6 ||
+        level < 1 || level >= ARRAY_SIZE(policy_rules) ||
+        !valid_rule_pct(r.avg) || !valid_rule_pct(r.max) ||
+        r.proc < 0 || !valid_rule_pct(r.mem) || r.run < 0 ||
+        !valid_rule_pct(r.wait)) {
+        pr_info("adaptive_sched: invalid value for policy_rules\n");
+        return -EINVAL;
+    }
+
+    mutex_lock(&targets_lock);
+    policy_rules[level] = r;
+    mutex_unlock(&targets_lock);
+
+    return count;
+}
+
+static struct kobj_attribute policy_rules_attr =
+    __ATTR(policy_rules, 0664, policy_rules_show, policy_rules_store);
+
+static ssize_t policy_hysteresis_show(struct kobject *kobj,
+                                      struct kobj_attribute *attr,
+                                      char *buf)
+{
+    int margin, dwell;
+
+    mutex_lock(&targets_lock);
+    margin = policy_margin;
+    dwell = policy_dwell_ms;
+    mutex_unlock(&targets_lock);
+
+    return scnprintf(buf, PAGE_SIZE, "%d %d\n", margin, dwell);
+}
+
+static ssize_t policy_hysteresis_store(struct kobject *kobj,
+                                       struct kobj_attribute *attr,
+                                       const char *buf,
+                                       size_t count)
+{
+    int margin, dwell;
+
+    if (sscanf(buf, "%d %d", &margin, &dwell) != 2 ||
+        margin < 0 || margin > 50 || dwell < 0 || dwell > 60000) {
+        pr_info("adaptive_sched: invalid value for policy_hysteresis\n");
+        return -EINVAL;
+    }
+
+    mutex_lock(&targets_lock);
+    policy_margin = margin;
+    policy_dwell_ms = dwell;
+    mutex_unlock(&targets_lock);
+
+    return count;
+}
+
+static struct kobj_attribute policy_hysteresis_attr =
+    __ATTR(policy_hysteresis, 0664, policy_hysteresis_show,
+           policy_hysteresis_store);
+
+/*
+ * ----------------------
+ * sysfs: boost_affinity (CPU placement per boost level)
+ * ----------------------
+ * Read: one line per level, "<level> none|idle <n>|set <cpulist>".
+ * Write: "<level> none", "<level> idle <n>" or "<level> set <cpulist>"
+ * for levels 1..3. Targets currently at that level are re-placed.
+ */
+
+static ssize_t boost_affinity_show(struct kobject *kobj,
+                                   struct kobj_attribute *attr,
+                                   char *buf)
+{
+    const struct boost_affinity *aff;
+    ssize_t len = 0;
+    int level;
+
+    mutex_lock(&targets_lock);
+    for (level = 0; level < ARRAY_SIZE(level_affinity); level++) {
+        aff = &level_affinity[level];
+
+        if (aff->mode == AFFINITY_IDLE)
+            len += scnprintf(buf + len, PAGE_SIZE - len, "%d idle %d\n",
+                             level, aff->nr_cpus);
+        else if (aff->mode == AFFINITY_SET)
+            len += scnprintf(buf + len, PAGE_SIZE - len, "%d set %*pbl\n",
+                             level, cpumask_pr_args(aff->cpus));
+        else
+            len += scnprintf(buf + len, PAGE_SIZE - len, "%d none\n", level);
+    }
+    mutex_unlock(&targets_lock);
+
+    return len;
+}
+
+static ssize_t boost_affinity_store(struct kobject *kobj,
+                                    struct kobj_attribute *attr,
+                                    const char *buf,
+                                    size_t count)
+{
+    struct boost_affinity *aff;
+    struct adaptive_target *t;
+    cpumask_var_t cpus;
+    char cmd[8], list[64];
+    int level, n;
+    ssize_t ret = count;
+
+    if (sscanf(buf, "%d %7s", &level, cmd) != 2 || level < 1 ||
+        level >= ARRAY_SIZE(level_affinity)) {
+        pr_info("adaptive_sched: invalid value for boost_affinity\n");
+        return -EINVAL;
+    }
+
+    if (!alloc_cpumask_var(&cpus, GFP_KERNEL))
+        return -ENOMEM;
+
+    mutex_lock(&targets_lock);
+    aff = &level_affinity[level];
+
+    if (!strcmp(cmd, "none")) {
+        aff->mode = AFFINITY_NONE;
+    } else if (!strcmp(cmd, "idle") &&
+               sscanf(buf, "%*d %*s %d", &n) == 1 && n > 0) {
+        aff->mode = AFFINITY_IDLE;
+        aff->nr_cpus = min_t(int, n, nr_cpu_ids);
+    } else if (!strcmp(cmd, "set") &&
+               sscanf(buf, "%*d %*s %63s", list) == 1 &&
+               !cpulist_parse(list, cpus) && !cpumask_empty(cpus)) {
+        aff->mode = AFFINITY_SET;
+        cpumask_copy(aff->cpus, cpus);
+    } else {
+        pr_info("adaptive_sched: invalid value for boost_affinity\n");
+        ret = -EINVAL;
+        goto out;
+    }
+
+    list_for_each_entry(t, &target_list, list) {
+        if (t->boost == level)
+            update_target_affinity(t);
+    }
+
+out:
+    mutex_unlock(&targets_lock);
+    free_cpumask_var(cpus);
+
+    return ret;
+}
+
+static struct kobj_attribute boost_affinity_attr =
+    __ATTR(boost_affinity, 0664, boost_affinity_show, boost_affinity_store);
+
+/*
+ * ----------------------
+ * sysfs: boost_ioprio (IO priority per boost level)
+ * ----------------------
+ * Read: one line per level, "<level> none" or "<level> rt|be|idle <0-7>".
+ * Write the same for levels 1..3. Targets currently at that level are
+ * updated.
+ */
+
+static ssize_t boost_ioprio_show(struct kobject *kobj,
+                                 struct kobj_attribute *attr,
+                                 char *buf)
+{
+    ssize_t len = 0;
+    int level, ioprio;
+
+    mutex_lock(&targets_lock);
+    for (level = 0; level < ARRAY_SIZE(level_ioprio); level++) {
+        ioprio = level_ioprio[level];
+
+        if (ioprio)
+            len += scnprintf(buf + len, PAGE_SIZE - len, "%d %s %d\n", level,
+                             ioprio_class_names[IOPRIO_PRIO_CLASS(ioprio)],
+                             (int)IOPRIO_PRIO_DATA(ioprio));
+        else
+            len += scnprintf(buf + len, PAGE_SIZE - len, "%d none\n", level);
+    }
+    mutex_unlock(&targets_lock);
+
+    return len;
+}
+
+static ssize_t boost_ioprio_store(struct kobject *kobj,
+                                  struct kobj_attribute *attr,
+                                  const char *buf,
+                                  size_t count)
+{
+    struct adaptive_target *t;
+    char name[8];
+    int level, class, data = 0;
+
+    if (sscanf(buf, "%d %7s %d", &level, name, &data) < 2 || level < 1 ||
+        level >= ARRAY_SIZE(level_ioprio) || data < 0 || data >= IOPRIO_NR_LEVELS) {
+        pr_info("adaptive_sched: invalid value for boost_ioprio\n");
+        return -EINVAL;
+    }
+
+    for (class = 0; class < ARRAY_SIZE(ioprio_class_names); class++) {
+        if (!strcmp(name, ioprio_class_names[class]))
+            break;
+    }
+    if (class == ARRAY_SIZE(ioprio_class_names)) {
+        pr_info("adaptive_sched: invalid value for boost_ioprio\n");
+        return -EINVAL;
+    }
+
+    mutex_lock(&targets_lock);
+
+    level_ioprio[level] = class == IOPRIO_CLASS_NONE ? 0 :
+                          LEVEL_IOPRIO(class, data);
+
+    list_for_each_entry(t, &target_list, list) {
+        if (t->boost == level && !t->throttle)
+            set_target_ioprio(t);
+    }
+
+    mutex_unlock(&targets_lock);
+
+    return count;
+}
+
+static struct kobj_attribute boost_ioprio_attr =
+    __ATTR(boost_ioprio, 0664, boost_ioprio_show, boost_ioprio_store);
+
+/*
+ * ----------------------
+ * sysfs: snapshot (binary, read-only)
+ * ----------------------
+ * Returns struct adaptive_snapshot (adaptive_sched_uapi.h): load metrics,
+ * system counters and the primary target's process counters, gathered
+ * in one pass at read time (the task counts are those of the last sample). Fields the module cannot reach are left zero
+ * and their ADAPTIVE_SNAP_HAVE_* flag is cleared (PSI is not exported to
+ * modules, so psi_cpu_* are always missing for now).
+ */
+
+// bin_attribute callbacks take a const attribute since the sysfs constification
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 16, 0)
+#define ADAPTIVE_BIN_ATTR_CONST const
+#else
+#define ADAPTIVE_BIN_ATTR_CONST
+#endif
+
+static void snapshot_fill_system(struct adaptive_snapshot *snap)
+{
+    struct sysinfo si;
+    int i;
+
+    si_meminfo(&si);
+    snap->mem_total_kb = ((u64)si.totalram * si.mem_unit) >> 10;
+    snap->mem_available_kb = (u64)si_mem_available() << (PAGE_SHIFT - 10);
+
+    for (i = 0; i < 3; i++) {
+        unsigned long v = avenrun[i] + FIXED_1 / 200;
+
+        snap->loadavg[i] = LOAD_INT(v) * 100 + LOAD_FRAC(v);
+    }
+}
+
+static void snapshot_fill_target(struct adaptive_snapshot *snap,
+                                 struct pid *pid)
+{
+    struct task_struct *task, *t;
+    struct mm_struct *mm;
+    u64 runtime;
+
+    task = get_pid_task(pid, PIDTYPE_PID);
+
+    if (!task)
+        return;
+
+    mm = get_task_mm(task);
+    if (mm) {
+        snap->proc_vms_kb = (u64)mm->total_vm << (PAGE_SHIFT - 10);
+        snap->proc_rss_kb = (u64)get_mm_rss(mm) << (PAGE_SHIFT - 10);
+        mmput(mm);
+    }
+
+    rcu_read_lock();
+
+    snap->proc_threads = get_nr_threads(task);
+
+    // Same sums as /proc/<pid>/stat and /proc/<pid>/io: exited threads + live ones
+    runtime = READ_ONCE(task->signal->sum_sched_runtime);
+#ifdef CONFIG_TASK_IO_ACCOUNTING
+    snap->proc_read_bytes = READ_ONCE(task->signal->ioac.read_bytes);
+    snap->proc_write_bytes = READ_ONCE(task->signal->ioac.write_bytes);
+#endif
+
+    for_each_thread(task, t) {
+        runtime += READ_ONCE(t->se.sum_exec_runtime);
+#ifdef CONFIG_SCHED_INFO
+        snap->proc_run_delay_ns += READ_ONCE(t->sched_info.run_delay);
+#endif
+#ifdef CONFIG_TASK_IO_ACCOUNTING
+        snap->proc_read_bytes += READ_ONCE(t->ioac.read_bytes);
+        snap->proc_write_bytes += READ_ONCE(t->ioac.write_bytes);
+#endif
+    }
+
+    rcu_read_unlock();
+
+    snap->proc_runtime_ns = runtime;
+    snap->flags |= ADAPTIVE_SNAP_HAVE_TARGET;
+#ifdef CONFIG_TASK_IO_ACCOUNTING
+    snap->flags |= ADAPTIVE_SNAP_HAVE_IO;
+#endif
+
+    put_task_struct(task);
+}
+
+/*
+ * The task counts come from the last runqueue walk (at most RQ_SCAN_MIN_MS
+ * old): nr_running() / nr_iowait() are not exported, and counting the
+ * threads on every read would cost O(threads) per snapshot.
+ */
+static void fill_snapshot(struct adaptive_snapshot *snap)
+{
+    struct load_metrics m;
+    struct pid *pid = NULL;
+
+    memset(snap, 0, sizeof(*snap));
+    read_metrics(&m);
+
+    snap->version = ADAPTIVE_SNAPSHOT_VERSION;
+    snap->size = sizeof(*snap);
+    snap->nr_cpus = num_online_cpus();
+    snap->timestamp_ns = ktime_get_boottime_ns();
+    snap->seq = m.seq;
+
+    snap->avg_load = m.avg_load;
+    snap->max_load = m.max_load;
+
+    snap->rq_running = m.rq.nr_running;
+    snap->rq_waiting = m.rq.waiting;
+    snap->rq_max_depth = m.rq.max_depth;
+    snap->wait_pct = m.rq.wait_pct;
+#ifdef CONFIG_SCHED_INFO
+    snap->flags |= ADAPTIVE_SNAP_HAVE_DELAY;
+#endif
+
+    mutex_lock(&targets_lock);
+    snap->boost_level = boost_level;
+    snap->target_pid = target_pid;
+    if (primary_target)
+        pid = get_pid(primary_target->pid_ref);
+    mutex_unlock(&targets_lock);
+
+    snap->procs_running = m.rq.nr_running;
+    snap->procs_blocked = m.rq.nr_blocked;
+    snapshot_fill_system(snap);
+    if (pid) {
+        snapshot_fill_target(snap, pid);
+        put_pid(pid);
+    }
+
+    if (m.rq.target_pid == snap->target_pid)
+        snap->proc_wait_pct = m.rq.target_wait_pct;
+}
+
+static ssize_t snapshot_read(struct file *filp, struct kobject *kobj,
+                             ADAPTIVE_BIN_ATTR_CONST struct bin_attribute *attr,
+                             char *buf, loff_t off, size_t count)
+{
+    struct adaptive_snapshot snap;
+
+    if (off >= sizeof(snap))
+        return 0;
+
+    fill_snapshot(&snap);
+
+    count = min_t(size_t, count, sizeof(snap) - off);
+    memcpy(buf, (char *)&snap + off, count);
+
+    return count;
+}
+
+static struct bin_attribute snapshot_attr =
+    __BIN_ATTR(snapshot, 0444, snapshot_read, NULL,
+               sizeof(struct adaptive_snapshot));
+
+/*
+ * ----------------------
+ * sysfs: cpu_history (binary, read-only)
+ * ----------------------
+ * struct adaptive_cpu_history_header followed by nr_cpu_ids * depth
+ * struct adaptive_cpu_sample entries, CPU-major. Slots of offline CPUs
+ * (and slots not written yet) have ADAPTIVE_CPU_SAMPLE_VALID cleared.
+ *
+ * Each read() call copies a consistent view; a large table is returned
+ * over several calls, so readers should compare the header seq of the
+ * first read with a re-read header to detect a sample in between.
+ */
+
+static size_t cpu_history_bytes(void)
+{
+    return (size_t)nr_cpu_ids * history_depth *
+           sizeof(struct adaptive_cpu_sample);
+}
+
+static ssize_t cpu_history_read(struct file *filp, struct kobject *kobj,
+                                ADAPTIVE_BIN_ATTR_CONST struct bin_attribute *attr,
+                                char *buf, loff_t off, size_t count)
+{
+    struct adaptive_cpu_history_header hdr;
+    size_t total = sizeof(hdr) + cpu_history_bytes();
+    size_t done;
+    unsigned int seq;
+
+    if (off >= total)
+        return 0;
+
+    count = min_t(size_t, count, total - off);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.version = ADAPTIVE_CPU_HISTORY_VERSION;
+    hdr.size = sizeof(hdr);
+    hdr.nr_cpus = nr_cpu_ids;
+    hdr.depth = history_depth;
+    hdr.sample_size = sizeof(struct adaptive_cpu_sample);
+
+    do {
+        seq = read_seqbegin(&metrics_lock);
+        done = 0;
+
+        if (off < sizeof(hdr)) {
+            hdr.seq = metrics.seq;
+            hdr.head = history_head;
+
+            done = min_t(size_t, count, sizeof(hdr) - off);
+            memcpy(buf, (char *)&hdr + off, done);
+        }
+
+        if (done < count)
+            memcpy(buf + done,
+                   (char *)cpu_history + (off + done - sizeof(hdr)),
+                   count - done);
+    } while (read_seqretry(&metrics_lock, seq));
+
+    return count;
+}
+
+// .size is set in adaptive_sched_init() once history_depth is known
+static struct bin_attribute cpu_history_attr =
+    __BIN_ATTR(cpu_history, 0444, cpu_history_read, NULL, 0);
+
+/*
+ * ----------------------
+ * sysfs: top_table (binary, read-only)
+ * ----------------------
+ * struct adaptive_top_header followed by TOP_TASKS_MAX entries, see
+ * scan_top_tasks(). One read of the whole file is consistent.
+ */
+
+struct top_table {
+    struct adaptive_top_header hdr;
+    struct adaptive_top_task tasks[TOP_TASKS_MAX];
+};
+
+static ssize_t top_table_read(struct file *filp, struct kobject *kobj,
+                              ADAPTIVE_BIN_ATTR_CONST struct bin_attribute *attr,
+                              char *buf, loff_t off, size_t count)
+{
+    struct top_table *table;
+
+    if (off >= sizeof(*table))
+        return 0;
+
+    table = kzalloc(sizeof(*table), GFP_KERNEL);
+    if (!table)
+        return -ENOMEM;
+
+    table->hdr.version = ADAPTIVE_TOP_TABLE_VERSION;
+    table->hdr.size = sizeof(table->hdr);
+    table->hdr.entry_size = sizeof(table->tasks[0]);
+
+    mutex_lock(&top_lock);
+    table->hdr.nr = nr_top_tasks;
+    table->hdr.seq = top_seq;
+    table->hdr.interval_ns = top_interval_ns;
+    memcpy(table->tasks, top_tasks, sizeof(top_tasks[0]) * nr_top_tasks);
+    mutex_unlock(&top_lock);
+
+    count = min_t(size_t, count, sizeof(*table) - off);
+    memcpy(buf, (char *)table + off, count);
+    kfree(table);
+
+    return count;
+}
+
+static struct bin_attribute top_table_attr =
+    __BIN_ATTR(top_table, 0444, top_table_read, NULL,
+               sizeof(struct top_table));
+
+/*
+ * ----------------------
+ * /dev/adaptive_sched_log (binary metrics log)
+ * ----------------------
+ * Stream of struct adaptive_log_record, one per load sample, filled by
+ * load_work while the device is open so a logger can record every sample
+ * at a short sample_period_ms and drain them in batches. Nothing is
+ * collected while it is closed. The buffer holds log_buffer_kb (rounded
+ * down to a power of two) and is allocated on open.
+ */
+
+static unsigned int log_buffer_kb = 1024;
+module_param(log_buffer_kb, uint, 0444);
+MODULE_PARM_DESC(log_buffer_kb, "Size of the /dev/adaptive_sched_log buffer in KiB (default 1024)");
+
+// Largest batch one read() takes, copied out through a bounce buffer
+#define LOG_READ_MAX        (64 << 10)
+
+static DEFINE_MUTEX(log_lock);      // log_fifo, log_record, log_dropped
+static DECLARE_WAIT_QUEUE_HEAD(log_wait);
+static struct kfifo log_fifo;
+static void *log_buffer;
+static struct adaptive_log_record *log_record;  // staging, NULL while closed
+static u32 log_dropped;
+
+static size_t log_record_size(void)
+{
+    return sizeof(*log_record) + nr_cpu_ids * sizeof(log_record->cpus[0]);
+}
+
+// Called by load_work right after the sample was published
+static void log_sample(void)
+{
+    struct adaptive_log_record *rec;
+    size_t size = log_record_size();
+    unsigned int slot;
+    int cpu;
+
+    if (!READ_ONCE(log_record))
+        return;
+
+    mutex_lock(&log_lock);
+
+    rec = log_record;
+    if (!rec)
+        goto out;
+    if (kfifo_avail(&log_fifo) < size) {
+        log_dropped++;
+        goto out;
+    }
+
+    rec->version = ADAPTIVE_LOG_VERSION;
+    rec->size = size;
+    rec->nr_cpus = nr_cpu_ids;
+    rec->dropped = log_dropped;
+    fill_snapshot(&rec->snap);
+
+    // load_work is the only writer of cpu_history, no seqlock needed here
+    slot = (history_head + history_depth - 1) % history_depth;
+    for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+        rec->cpus[cpu] = cpu_history[cpu * history_depth + slot];
+
+    kfifo_in(&log_fifo, rec, size);
+    log_dropped = 0;
+    wake_up_interruptible(&log_wait);
+
+out:
+    mutex_unlock(&log_lock);
+}
+
+static int log_open(struct inode *inode, struct file *file)
+{
+    unsigned int bytes = rounddown_pow_of_two(
+        max_t(unsigned int, log_buffer_kb, 64) << 10);
+    struct adaptive_log_record *rec;
+    void *buffer;
+    int ret;
+
+    rec = kzalloc(log_record_size(), GFP_KERNEL);
+    buffer = vmalloc(bytes);
+    if (!rec || !buffer) {
+        ret = -ENOMEM;
+        goto err_free;
+    }
+
+    mutex_lock(&log_lock);
+    if (log_record) {
+        mutex_unlock(&log_lock);
+        ret = -EBUSY;
+        goto err_free;
+    }
+    ret = kfifo_init(&log_fifo, buffer, bytes);
+    if (ret) {
+        mutex_unlock(&log_lock);
+        goto err_free;
+    }
+    log_buffer = buffer;
+    log_dropped = 0;
+    WRITE_ONCE(log_record, rec);
+    mutex_unlock(&log_lock);
+
+    return nonseekable_open(inode, file);
+
+err_free:
+    vfree(buffer);
+    kfree(rec);
+    return ret;
+}
+
+static int log_release(struct inode *inode, struct file *file)
+{
+    mutex_lock(&log_lock);
+    kfree(log_record);
+    WRITE_ONCE(log_record, NULL);
+    vfree(log_buffer);
+    log_buffer = NULL;
+    mutex_unlock(&log_lock);
+
+    return 0;
+}
+
+static ssize_t log_read(struct file *file, char __user *buf, size_t count,
+                        loff_t *ppos)
+{
+    u32 head[2];        // version, size of the next record
+    size_t size = log_record_size();
+    size_t done = 0;
+    void *bounce;
+    int ret;
+
+    if (count < size)
+        return -EINVAL;
+
+    // log_sample() takes log_lock too: no user copy (and fault) under it
+    count = min_t(size_t, count, max_t(size_t, LOG_READ_MAX, size));
+    bounce = kvmalloc(count, GFP_KERNEL);
+    if (!bounce)
+        return -ENOMEM;
+
+    for (;;) {
+        mutex_lock(&log_lock);
+        if (!kfifo_is_empty(&log_fifo))
+            break;
+        mutex_unlock(&log_lock);
+
+        ret = -EAGAIN;
+        if (file->f_flags & O_NONBLOCK)
+            goto out;
+        ret = wait_event_interruptible(log_wait,
+                                       !kfifo_is_empty(&log_fifo));
+        if (ret)
+            goto out;
+    }
+
+    while (kfifo_out_peek(&log_fifo, head, sizeof(head)) == sizeof(head) &&
+           done + head[1] <= count)
+        done += kfifo_out(&log_fifo, (char *)bounce + done, head[1]);
+
+    mutex_unlock(&log_lock);
+
+    ret = copy_to_user(buf, bounce, done) ? -EFAULT : done;
+out:
+    kvfree(bounce);
+    return ret;
+}
+
+static __poll_t log_poll(struct file *file, poll_table *wait)
+{
+    __poll_t mask = 0;
+
+    poll_wait(file, &log_wait, wait);
+
+    mutex_lock(&log_lock);
+    if (!kfifo_is_empty(&log_fifo))
+        mask = EPOLLIN | EPOLLRDNORM;
+    mutex_unlock(&log_lock);
+
+    return mask;
+}
+
+static const struct file_operations log_fops = {
+    .owner   = THIS_MODULE,
+    .open    = log_open,
+    .release = log_release,
+    .read    = log_read,
+    .poll    = log_poll,
+    .llseek  = noop_llseek,
+};
+
+static struct miscdevice log_device = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name  = "adaptive_sched_log",
+    .fops  = &log_fops,
+    .mode  = 0400,
+};
+
+/*
+ * ----------------------
+ * sysfs: policy_model (binary, write-only)
+ * ----------------------
+ * Write a whole model.bin from offset 0 and in order, as cp or cat do.
+ * It is staged until header.total_size bytes have arrived, then checked
+ * with adaptive_model_valid() and swapped in for policy_mode "model".
+ * A write at offset 0 discards an incomplete upload.
+ */
+
+static void *model_upload;
+static size_t model_upload_len, model_upload_size;
+static DEFINE_MUTEX(model_upload_lock);
+
+static void discard_model_upload(void)
+{
+    kvfree(model_upload);
+    model_upload = NULL;
+    model_upload_len = 0;
+    model_upload_size = 0;
+}
+
+static ssize_t policy_model_write(struct file *filp, struct kobject *kobj,
+                                  ADAPTIVE_BIN_ATTR_CONST struct bin_attribute *attr,
+                                  char *buf, loff_t off, size_t count)
+{
+    const struct adaptive_model_header *h = (const void *)buf;
+    struct adaptive_model_header *old;
+    u32 nr_trees, nr_nodes;
+    ssize_t ret = count;
+
+    mutex_lock(&model_upload_lock);
+
+    if (off == 0) {
+        discard_model_upload();
+
+        if (count < sizeof(*h) || h->total_size < sizeof(*h) ||
+            h->total_size > ADAPTIVE_MODEL_MAX_SIZE) {
+            ret = -EINVAL;
+            goto out;
+        }
+
+        model_upload = kvmalloc(h->total_size, GFP_KERNEL);
+        if (!model_upload) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        model_upload_size = h->total_size;
+    }
+
+    if (!model_upload || off != model_upload_len ||
+        count > model_upload_size - model_upload_len) {
+        discard_model_upload();
+        ret = -EINVAL;
+        goto out;
+    }
+
+    memcpy((char *)model_upload + off, buf, count);
+    model_upload_len += count;
+    if (model_upload_len < model_upload_size)
+        goto out;
+
+    if (!adaptive_model_valid(model_upload, model_upload_size)) {
+        discard_model_upload();
+        ret = -EINVAL;
+        goto out;
+    }
+
+    h = model_upload;
+    nr_trees = h->nr_trees;
+    nr_nodes = h->nr_nodes;
+
+    mutex_lock(&targets_lock);
+    old = policy_model;
+    policy_model = model_upload;
+    reset_kernel_policy();
+    mutex_unlock(&targets_lock);
+
+    kvfree(old);
+    model_upload = NULL;
+    discard_model_upload();
+
+    pr_info("adaptive_sched: policy model loaded (%u trees, %u nodes)\n",
+            nr_trees, nr_nodes);
+
+out:
+    mutex_unlock(&model_upload_lock);
+    if (ret < 0)
+        pr_info("adaptive_sched: invalid value for policy_model\n");
+    return ret;
+}
+
+static struct bin_attribute policy_model_attr =
+    __BIN_ATTR(policy_model, 0200, NULL, policy_model_write,
+               ADAPTIVE_MODEL_MAX_SIZE);
+
+/*
+ * ----------------------
+ * sysfs group
+ * ----------------------
+ */
+
+static struct attribute *attrs[] = {
+    &boost_attr.attr,
+    &load_attr.attr,
+    &max_load_attr.attr,
+    &node_load_attr.attr,
+    &llc_load_attr.attr,
+    &runqueue_attr.attr,
+    &run_delay_attr.attr,
+    &overhead_attr.attr,
+    &top_tasks_attr.attr,
+    &notify_thresholds_attr.attr,
+    &sample_period_attr.attr,
+    &sample_adaptive_attr.attr,
+    &sample_interval_attr.attr,
+    &sample_mode_attr.attr,
+    &target_pid_attr.attr,
+    &targets_attr.attr,
+    &throttle_attr.attr,
+    &target_scope_attr.attr,
+    &boost_affinity_attr.attr,
+    &boost_ioprio_attr.attr,
+    &boost_policy_attr.attr,
+    &rt_budget_attr.attr,
+    &policy_mode_attr.attr,
+    &policy_rules_attr.attr,
+    &policy_hysteresis_attr.attr,
+    NULL,
+};
+
+static const struct attribute_group attr_group = {
+    .attrs = attrs,
+};
+
+static struct kobject *adaptive_kobj;
+
+/*
+ * ----------------------
+ * Helper: load change notification
+ * ----------------------
+ * Tracks the last notified value of one load metric and wakes up poll()ers
+ * of its sysfs file when it crosses a threshold band or moves by delta.
+ */
+
+struct load_notifier {
+    const char *attr_name;
+    int last_band;
+    int last_value;
+};
+
+static struct load_notifier avg_notifier = { "current_load", -1, 0 };
+static struct load_notifier max_notifier = { "max_load", -1, 0 };
+
+static int load_band(int load)
+{
+    if (load < READ_ONCE(notify_low))
+        return 0;
+    if (load < READ_ONCE(notify_high))
+        return 1;
+    return 2;
+}
+
+static void notify_load_change(struct load_notifier *n, int load)
+{
+    int band = load_band(load);
+    int delta = READ_ONCE(notify_delta);
+
+    if (band == n->last_band &&
+        (delta == 0 || abs(load - n->last_value) < delta))
+        return;
+
+    n->last_band = band;
+    n->last_value = load;
+
+    trace_adaptive_sched_notify(READ_ONCE(metrics.seq), n == &max_notifier, load);
+    sysfs_notify(adaptive_kobj, NULL, n->attr_name);
+}
+
+/*
+ * ----------------------
+ * Helper: choose the delay until the next sample
+ * ----------------------
+ * Fixed mode: sample_period_ms.
+ * Adaptive mode: sample_min_ms while avg_load moves by SAMPLE_CHANGE_PCT
+ * or more, or max_load is at/above notify_high; otherwise the period is
+ * doubled up to sample_max_ms.
+ */
+
+static int last_sampled_avg = 0;
+
+static unsigned long next_sample_delay(int avg, int max)
+{
+    unsigned int ms;
+
+    if (!READ_ONCE(sample_adaptive)) {
+        ms = READ_ONCE(sample_period_ms);
+    } else if (abs(avg - last_sampled_avg) >= SAMPLE_CHANGE_PCT ||
+               max >= READ_ONCE(notify_high)) {
+        ms = READ_ONCE(sample_min_ms);
+    } else {
+        ms = min(READ_ONCE(sample_cur_ms) * 2, READ_ONCE(sample_max_ms));
+        ms = max(ms, READ_ONCE(sample_min_ms));
+    }
+
+    last_sampled_avg = avg;
+    WRITE_ONCE(sample_cur_ms, ms);
+
+    return msecs_to_jiffies(ms);
+}
+
+/*
+ * ----------------------
+ * Helper: aggregate staged samples per NUMA node and per LLC domain
+ * ----------------------
+ */
+
+static void add_to_group(struct load_group *g, int load)
+{
+    // avg holds the running sum until finish_groups()
+    g->avg += load;
+    g->cnt++;
+    if (load > g->max)
+        g->max = load;
+}
+
+static void finish_groups(struct load_group *groups, int nr)
+{
+    int i;
+
+    for (i = 0; i < nr; i++) {
+        if (groups[i].cnt > 0)
+            groups[i].avg /= groups[i].cnt;
+    }
+}
+
+static void aggregate_groups(void)
+{
+    int cpu;
+
+    memset(node_groups_staging, 0, nr_node_ids * sizeof(*node_groups_staging));
+    memset(llc_groups_staging, 0, nr_cpu_ids * sizeof(*llc_groups_staging));
+
+    for_each_online_cpu(cpu) {
+        const struct adaptive_cpu_sample *sample = &cpu_staging[cpu];
+        int llc = cpumask_first(topology_die_cpumask(cpu));
+
+        if (!(sample->flags & ADAPTIVE_CPU_SAMPLE_VALID))
+            continue;
+
+        add_to_group(&node_groups_staging[cpu_to_node(cpu)], sample->busy);
+        if (llc < nr_cpu_ids)
+            add_to_group(&llc_groups_staging[llc], sample->busy);
+    }
+
+    finish_groups(node_groups_staging, nr_node_ids);
+    finish_groups(llc_groups_staging, nr_cpu_ids);
+}
+
+/*
+ * ----------------------
+ * Helper: publish one sample
+ * ----------------------
+ * Copies the staged per-CPU samples into the history ring and updates
+ * the load metrics in a single metrics_lock write section.
+ */
+
+static void publish_sample(int avg, int max, const struct rq_stats *rq)
+{
+    int cpu;
+
+    write_seqlock(&metrics_lock);
+
+    for_each_possible_cpu(cpu)
+        cpu_history[cpu * history_depth + history_head] = cpu_staging[cpu];
+    history_head = (history_head + 1) % history_depth;
+
+    memcpy(node_groups, node_groups_staging,
+           nr_node_ids * sizeof(*node_groups));
+    memcpy(llc_groups, llc_groups_staging,
+           nr_cpu_ids * sizeof(*llc_groups));
+
+    metrics.avg_load = avg;
+    metrics.max_load = max;
+    metrics.rq = *rq;
+    metrics.seq++;
+
+    write_sequnlock(&metrics_lock);
+}
+
+/*
+ * ----------------------
+ * Sampling: serial or one work item per NUMA node
+ * ----------------------
+ * sample_cpus() samples the online CPUs of a mask into cpu_staging and
+ * returns the partial sum / count / max. In node mode every node runs it
+ * for its own CPUs on one of them, so the kcpustat and cpu_state lines it
+ * touches are node-local, and the nodes work in parallel.
+ */
+
+struct load_partial {
+    int sum;
+    int cnt;
+    int max;
+};
+
+struct node_sampler {
+    struct work_struct work;
+    int node;
+    bool queued;
+    struct load_partial part;
+};
+
+// nr_node_ids entries, allocated in adaptive_sched_init()
+static struct node_sampler *node_samplers;
+
+static void sample_cpus(const struct cpumask *mask, struct load_partial *part)
+{
+    int cpu;
+
+    for_each_cpu(cpu, mask) {
+        int load;
+
+        if (!cpu_online(cpu))
+            continue;
+
+        load = get_cpu_load(cpu, &cpu_staging[cpu]);
+
+        if (load < 0)
+            load = 0;
+        if (load > 100)
+            load = 100;
+
+        part->sum += load;
+        part->cnt++;
+
+        if (load > part->max)
+            part->max = load;
+    }
+}
+
+static void node_sample_func(struct work_struct *work)
+{
+    struct node_sampler *ns = container_of(work, struct node_sampler, work);
+
+    sample_cpus(cpumask_of_node(ns->node), &ns->part);
+}
+
+static bool use_node_sampling(void)
+{
+    switch (READ_ONCE(sample_mode)) {
+    case SAMPLE_MODE_SERIAL:
+        return false;
+    case SAMPLE_MODE_NODE:
+        return true;
+    default:
+        return num_online_nodes() > 1;
+    }
+}
+
+static void sample_all_cpus(struct load_partial *total)
+{
+    struct node_sampler *ns;
+    int node, cpu;
+
+    memset(cpu_staging, 0, nr_cpu_ids * sizeof(*cpu_staging));
+
+    if (!use_node_sampling()) {
+        sample_cpus(cpu_possible_mask, total);
+        return;
+    }
+
+    for_each_online_node(node) {
+        ns = &node_samplers[node];
+        memset(&ns->part, 0, sizeof(ns->part));
+
+        // CPU-less nodes have nothing to sample
+        cpu = cpumask_any_and(cpumask_of_node(node), cpu_online_mask);
+        ns->queued = cpu < nr_cpu_ids;
+        if (ns->queued)
+            queue_work_on(cpu, system_highpri_wq, &ns->work);
+    }
+
+    for_each_online_node(node) {
+        ns = &node_samplers[node];
+        if (!ns->queued)
+            continue;
+
+        flush_work(&ns->work);
+
+        total->sum += ns->part.sum;
+        total->cnt += ns->part.cnt;
+        if (ns->part.max > total->max)
+            total->max = ns->part.max;
+    }
+}
+
+/*
+ * ----------------------
+ * Runqueue latency, sampled from load_work
+ * ----------------------
+ * nr_running() and the runqueues are not available to modules, so one
+ * RCU walk over all threads counts the runnable ones per CPU (into
+ * cpu_staging) and adds up how long they waited for a CPU
+ * (sched_info.run_delay) since the last walk. The primary target's
+ * threads are read separately from its struct pid.
+ *
+ * run_delay is per thread and leaves with it, so the delta of one sum
+ * over all live threads drops to 0 as soon as a thread that waited a lot
+ * exits, exactly under fork / exit churn. Deltas are therefore taken per
+ * thread group (system) and per thread (target) against the value of the
+ * last walk, in delay_entry tables private to load_work: an exit only
+ * loses what that thread waited since the last walk, and an id seen for
+ * the first time counts in full if it started after it. Threads that exit
+ * from a group which lives on still lower its sum, the group then adds 0
+ * for that walk, so wait_pct is a lower bound.
+ *
+ * The walk covers every thread in the system, so like the top task scan it
+ * runs at most every RQ_SCAN_MIN_MS; samples in between repeat the counts
+ * and wait_pct of the last walk (and the per-CPU depths of the previous
+ * history slot). The primary target is still sampled every time.
+ */
+#define RQ_SCAN_MIN_MS      200
+#define RQ_HASH_BITS        TOP_HASH_BITS
+
+struct delay_entry {
+    struct hlist_node node;
+    pid_t id;               // tgid (system) or tid (target)
+    u64 start_time;         // tells a reused id apart
+    u64 run_delay;          // at the last walk that saw it
+    u64 gen;                // that walk
+};
+
+static DEFINE_HASHTABLE(rq_group_delays, RQ_HASH_BITS);
+static DEFINE_HASHTABLE(rq_target_delays, RQ_HASH_BITS);
+
+static struct {
+    u64 gen;                // walks over all threads so far
+    u64 stamp_ns;           // last walk over all threads
+    struct rq_stats sys;    // system-wide fields of that walk
+    u64 target_gen;
+    u64 target_stamp_ns;
+    struct pid *target;     // primary target of the last sample (ref held)
+} rq_prev;
+
+/*
+ * Time an id waited since the last walk (at since), recorded for walk gen.
+ * Runs inside the RCU walk, hence GFP_ATOMIC; without memory the id just
+ * counts as new again next time.
+ */
+static u64 delay_since(struct hlist_head *table, pid_t id, u64 start_time,
+                       u64 run_delay, u64 since, u64 gen)
+{
+    struct hlist_head *head = &table[hash_min(id, RQ_HASH_BITS)];
+    struct delay_entry *e;
+    u64 delta;
+
+    hlist_for_each_entry(e, head, node) {
+        if (e->id == id)
+            break;
+    }
+
+    if (e && e->start_time == start_time) {
+        delta = run_delay > e->run_delay ? run_delay - e->run_delay : 0;
+    } else {
+        delta = since && start_time >= since ? run_delay : 0;
+        if (!e) {
+            e = kzalloc(sizeof(*e), GFP_ATOMIC);
+            if (!e)
+                return delta;
+            e->id = id;
+            hlist_add_head(&e->node, head);
+        }
+        e->start_time = start_time;
+    }
+
+    e->run_delay = run_delay;
+    e->gen = gen;
+    return delta;
+}
+
+// Forget the ids walk gen did not see; gen 0 (before any walk) clears all
+static void delay_prune(struct hlist_head *table, u64 gen)
+{
+    struct delay_entry *e;
+    struct hlist_node *tmp;
+    int bkt;
+
+    for (bkt = 0; bkt < 1 << RQ_HASH_BITS; bkt++) {
+        hlist_for_each_entry_safe(e, tmp, &table[bkt], node) {
+            if (e->gen != gen) {
+                hlist_del(&e->node);
+                kfree(e);
+            }
+        }
+    }
+}
+
+// Total run_delay of the target's threads, the part since since in *waited
+static u64 target_run_delay(struct pid *pid, u64 since, u64 *waited)
+{
+    u64 delay = 0;
+#ifdef CONFIG_SCHED_INFO
+    struct task_struct *task, *t;
+    u64 run_delay;
+
+    rq_prev.target_gen++;
+    rcu_read_lock();
+    task = pid_task(pid, PIDTYPE_PID);
+    if (task) {
+        for_each_thread(task, t) {
+            run_delay = READ_ONCE(t->sched_info.run_delay);
+            delay += run_delay;
+            *waited += delay_since(rq_target_delays, task_pid_nr(t),
+                                   t->start_time, run_delay, since,
+                                   rq_prev.target_gen);
+        }
+    }
+    rcu_read_unlock();
+    delay_prune(rq_target_delays, rq_prev.target_gen);
+#endif
+
+    return delay;
+}
+
+static unsigned int delay_pct(u64 delay, u64 elapsed)
+{
+    if (!elapsed)
+        return 0;
+
+    return (unsigned int)min_t(u64, div64_u64(delay * 100, elapsed),
+                               UINT_MAX);
+}
+
+/*
+ * Helper: per-CPU depths of the previous sample, for samples that skip the
+ * walk. load_work is the only writer of cpu_history, so no lock is needed.
+ */
+static void repeat_rq_depths(void)
+{
+    unsigned int prev = (history_head + history_depth - 1) % history_depth;
+    int cpu;
+
+    for_each_online_cpu(cpu)
+        cpu_staging[cpu].nr_running =
+            cpu_history[cpu * history_depth + prev].nr_running;
+}
+
+static void sample_runqueues(struct rq_stats *rq)
+{
+    struct task_struct *p, *t;
+    struct pid *pid = NULL;
+    u64 now = ktime_get_ns();
+    u64 elapsed = rq_prev.stamp_ns ? now - rq_prev.stamp_ns : 0;
+    u64 target_elapsed = rq_prev.target_stamp_ns ?
+                         now - rq_prev.target_stamp_ns : 0;
+    u64 run_delay, waited = 0;
+    unsigned int depth, nr_cpus = num_online_cpus();
+    int cpu;
+
+    if (rq_prev.stamp_ns && elapsed < (u64)RQ_SCAN_MIN_MS * NSEC_PER_MSEC) {
+        *rq = rq_prev.sys;
+        repeat_rq_depths();
+        goto target;
+    }
+
+    memset(rq, 0, sizeof(*rq));
+    rq_prev.gen++;
+
+    rcu_read_lock();
+    for_each_process(p) {
+        run_delay = 0;
+        for_each_thread(p, t) {
+#ifdef CONFIG_SCHED_INFO
+            run_delay += READ_ONCE(t->sched_info.run_delay);
+#endif
+            if (!task_is_running(t)) {
+                if (t->in_iowait)
+                    rq->nr_blocked++;
+                continue;
+            }
+
+            rq->nr_running++;
+            cpu = task_cpu(t);
+            if (cpu < nr_cpu_ids && cpu_staging[cpu].nr_running < U16_MAX)
+                cpu_staging[cpu].nr_running++;
+        }
+
+        if (IS_ENABLED(CONFIG_SCHED_INFO))
+            waited += delay_since(rq_group_delays, task_tgid_nr(p),
+                                  p->start_time, run_delay,
+                                  rq_prev.stamp_ns, rq_prev.gen);
+    }
+    rcu_read_unlock();
+
+    if (IS_ENABLED(CONFIG_SCHED_INFO))
+        delay_prune(rq_group_delays, rq_prev.gen);
 
-// Maximum per-CPU load among all online CPUs (0..100), read-only via sysfs
-static int max_load = 0;
+    for_each_online_cpu(cpu) {
+        depth = cpu_staging[cpu].nr_running;
+        if (depth > 1)
+            rq->waiting += depth - 1;
+        if (depth > rq->max_depth)
+            rq->max_depth = depth;
+    }
 
-// Target process ID that will be controlled by this module
-static pid_t target_pid = 0;
+    if (nr_cpus)
+        rq->wait_pct = delay_pct(waited, elapsed * nr_cpus);
+    rq_prev.stamp_ns = now;
+    rq_prev.sys = *rq;
 
-// Work item that periodically updates load metrics
-static struct delayed_work load_work;
+target:
+    rq->target_pid = 0;
+    rq->target_wait_pct = 0;
+    rq->target_run_delay_ns = 0;
 
-// Previous values used for per-CPU load delta calculations
-static u64 prev_idle[NR_CPUS];
-static u64 prev_total[NR_CPUS];
+    mutex_lock(&targets_lock);
+    if (primary_target) {
+        pid = get_pid(primary_target->pid_ref);
+        rq->target_pid = primary_target->pid;
+    }
+    mutex_unlock(&targets_lock);
 
-/*
- * ----------------------
- * Helper: map boost_level -> nice value
- * ----------------------
- *  boost_level = 0 -> nice = 0   (default priority)
- *  boost_level = 1 -> nice = -2  (slightly increased priority)
- *  boost_level = 2 -> nice = -5  (higher priority)
- *  boost_level = 3 -> nice = -10 (aggressive boost)
- */
+    if (pid) {
+        bool same = pid == rq_prev.target;
 
-static int boost_to_nice(int boost)
-{
-    switch (boost) {
-    case 0: return 0;
-    case 1: return -2;
-    case 2: return -5;
-    case 3:
-    default:
-        return -10;
+        waited = 0;
+        rq->target_run_delay_ns = target_run_delay(pid,
+            same ? rq_prev.target_stamp_ns : 0, &waited);
+        if (same)
+            rq->target_wait_pct = delay_pct(waited, target_elapsed);
     }
+
+    put_pid(rq_prev.target);
+    rq_prev.target = pid;
+    rq_prev.target_stamp_ns = now;
 }
 
 /*
  * ----------------------
- * Helper: compute real CPU load (%) using kernel cpustat
+ * Top CPU consumers, scanned from load_work
  * ----------------------
- * Method: compare per-CPU usage counters since last sample.
- * CPU load = (busy_time / total_time) * 100
  */
 
-static int get_cpu_load(int cpu)
+static struct tgid_runtime *find_tgid_runtime(struct task_struct *leader)
 {
-    struct kernel_cpustat *kcpustat_ptr;
-    u64 user, nice, system, idle, iowait, irq, softirq, steal;
-    u64 idle_all, total;
-    u64 diff_idle, diff_total;
+    struct tgid_runtime *r;
+    pid_t tgid = task_tgid_nr(leader);
 
-    if (cpu >= NR_CPUS)
-        return 0;
+    hash_for_each_possible(tgid_runtimes, r, node, tgid) {
+        if (r->tgid == tgid)
+            return r;
+    }
 
-    kcpustat_ptr = &kcpustat_cpu(cpu);
+    return NULL;
+}
 
-    user    = kcpustat_ptr->cpustat[CPUTIME_USER];
-    nice    = kcpustat_ptr->cpustat[CPUTIME_NICE];
-    system  = kcpustat_ptr->cpustat[CPUTIME_SYSTEM];
-    idle    = kcpustat_ptr->cpustat[CPUTIME_IDLE];
-    iowait  = kcpustat_ptr->cpustat[CPUTIME_IOWAIT];
-    irq     = kcpustat_ptr->cpustat[CPUTIME_IRQ];
-    softirq = kcpustat_ptr->cpustat[CPUTIME_SOFTIRQ];
-    steal   = kcpustat_ptr->cpustat[CPUTIME_STEAL];
+static void top_heap_sift_down(int i)
+{
+    struct adaptive_top_task tmp;
+    int child;
 
-    idle_all = idle + iowait;
-    total = user + nice + system + idle_all + irq + softirq + steal;
+    while ((child = 2 * i + 1) < nr_top_heap) {
+        if (child + 1 < nr_top_heap &&
+            top_heap[child + 1].cpu_x10 < top_heap[child].cpu_x10)
+            child++;
+        if (top_heap[i].cpu_x10 <= top_heap[child].cpu_x10)
+            break;
 
-    // First measurement for this CPU: initialize
-    if (prev_total[cpu] == 0) {
-        prev_total[cpu] = total;
-        prev_idle[cpu]  = idle_all;
-        return 0;
+        tmp = top_heap[i];
+        top_heap[i] = top_heap[child];
+        top_heap[child] = tmp;
+        i = child;
     }
+}
 
-    diff_total = total - prev_total[cpu];
-    diff_idle  = idle_all - prev_idle[cpu];
-
-    prev_total[cpu] = total;
-    prev_idle[cpu]  = idle_all;
+static void top_heap_sift_up(int i)
+{
+    struct adaptive_top_task tmp;
+    int parent;
 
-    if (diff_total == 0)
-        return 0;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (top_heap[parent].cpu_x10 <= top_heap[i].cpu_x10)
+            break;
 
-    return (int)(((diff_total - diff_idle) * 100) / diff_total);
+        tmp = top_heap[i];
+        top_heap[i] = top_heap[parent];
+        top_heap[parent] = tmp;
+        i = parent;
+    }
 }
 
 /*
- * ----------------------
- * Helper: apply boost level to target PID
- * ----------------------
- * This adjusts the nice value of the target process.
+ * Offer a process to the top-N heap: O(1) when it is lighter than the
+ * current minimum, O(log N) otherwise. Returns the slot to fill, or NULL.
  */
+static struct adaptive_top_task *top_heap_offer(unsigned int cpu_x10)
+{
+    if (nr_top_heap < TOP_TASKS_MAX) {
+        top_heap[nr_top_heap].cpu_x10 = cpu_x10;
+        return &top_heap[nr_top_heap++];
+    }
 
-static void apply_boost_to_target(void)
+    if (top_heap[0].cpu_x10 >= cpu_x10)
+        return NULL;
+
+    top_heap[0].cpu_x10 = cpu_x10;
+    return &top_heap[0];
+}
+
+static void top_heap_fixup(struct adaptive_top_task *tt)
 {
-    struct pid *pid_struct;
-    struct task_struct *task;
-    int new_nice;
+    int i = tt - top_heap;
 
-    if (target_pid <= 0) {
-        pr_info("adaptive_sched: no target_pid set, nothing to boost\n");
-        return;
-    }
+    if (i == 0)
+        top_heap_sift_down(0);
+    else
+        top_heap_sift_up(i);
+}
+
+static int cmp_top_task(const void *a, const void *b)
+{
+    const struct adaptive_top_task *x = a, *y = b;
+
+    if (x->cpu_x10 != y->cpu_x10)
+        return x->cpu_x10 > y->cpu_x10 ? -1 : 1;
+    return 0;
+}
+
+static void scan_top_tasks(void)
+{
+    struct task_struct *p, *t, *busiest;
+    struct adaptive_top_task *tt;
+    struct tgid_runtime *r;
+    struct hlist_node *tmp;
+    u64 now = ktime_get_ns();
+    u64 elapsed = now - top_stamp_ns;
+    u64 runtime, run_delay, delta, delay_delta, busiest_rt, rt;
+    bool fresh;
+    int bkt;
 
-    pid_struct = find_vpid(target_pid);
-    if (!pid_struct) {
-        pr_info("adaptive_sched: target_pid %d not found (no pid_struct)\n",
-                target_pid);
+    if (top_stamp_ns && elapsed < (u64)TOP_SCAN_MIN_MS * NSEC_PER_MSEC)
         return;
+
+    top_gen++;
+    nr_top_heap = 0;
+
+    rcu_read_lock();
+    for_each_process(p) {
+        if (p->flags & PF_KTHREAD)
+            continue;
+
+        runtime = READ_ONCE(p->signal->sum_sched_runtime);
+        run_delay = 0;
+        busiest = p;
+        busiest_rt = 0;
+        for_each_thread(p, t) {
+            rt = READ_ONCE(t->se.sum_exec_runtime);
+            runtime += rt;
+#ifdef CONFIG_SCHED_INFO
+            run_delay += READ_ONCE(t->sched_info.run_delay);
+#endif
+            if (rt > busiest_rt) {
+                busiest_rt = rt;
+                busiest = t;
+            }
+        }
+
+        r = find_tgid_runtime(p);
+        if (r && r->start_time != p->start_time) {
+            hash_del(&r->node);
+            kfree(r);
+            r = NULL;
+        }
+
+        if (r) {
+            // Threads that exited take their run_delay with them
+            delta = runtime > r->runtime ? runtime - r->runtime : 0;
+            delay_delta = run_delay > r->run_delay ?
+                          run_delay - r->run_delay : 0;
+        } else {
+            r = kzalloc(sizeof(*r), GFP_ATOMIC);
+            if (!r)
+                continue;
+            r->tgid = task_tgid_nr(p);
+            r->start_time = p->start_time;
+            hash_add(tgid_runtimes, &r->node, r->tgid);
+
+            // Started since the last scan: all of its time is recent
+            fresh = top_stamp_ns && p->start_time >= top_stamp_ns;
+            delta = fresh ? runtime : 0;
+            delay_delta = fresh ? run_delay : 0;
+        }
+
+        r->runtime = runtime;
+        r->run_delay = run_delay;
+        r->gen = top_gen;
+
+        if (!top_stamp_ns || !delta)
+            continue;
+
+        tt = top_heap_offer((unsigned int)div64_u64(delta * 1000, elapsed));
+        if (!tt)
+            continue;
+
+        tt->pid = task_pid_nr(busiest);
+        tt->tgid = task_tgid_nr(p);
+        tt->nr_threads = get_nr_threads(p);
+        tt->run_delay_ns = delay_delta;
+        get_task_comm(tt->comm, p);
+        top_heap_fixup(tt);
     }
+    rcu_read_unlock();
 
-    task = pid_task(pid_struct, PIDTYPE_PID);
-    if (!task) {
-        pr_info("adaptive_sched: target_pid %d not found (no task_struct)\n",
-                target_pid);
-        return;
+    // Forget processes that have exited
+    hash_for_each_safe(tgid_runtimes, bkt, tmp, r, node) {
+        if (r->gen != top_gen) {
+            hash_del(&r->node);
+            kfree(r);
+        }
     }
 
-    new_nice = boost_to_nice(boost_level);
+    top_stamp_ns = now;
+
+    sort(top_heap, nr_top_heap, sizeof(top_heap[0]), cmp_top_task, NULL);
 
-    pr_info("adaptive_sched: applying boost_level=%d (nice=%d) to pid=%d (comm=%s)\n",
-            boost_level, new_nice, target_pid, task->comm);
+    mutex_lock(&top_lock);
+    memcpy(top_tasks, top_heap, sizeof(top_heap[0]) * nr_top_heap);
+    nr_top_tasks = nr_top_heap;
+    top_seq = top_gen;
+    top_interval_ns = elapsed;
+    mutex_unlock(&top_lock);
+}
+
+static void free_tgid_runtimes(void)
+{
+    struct tgid_runtime *r;
+    struct hlist_node *tmp;
+    int bkt;
 
-    set_user_nice(task, new_nice);
+    hash_for_each_safe(tgid_runtimes, bkt, tmp, r, node) {
+        hash_del(&r->node);
+        kfree(r);
+    }
 }
 
 /*
  * ----------------------
- * sysfs: boost_level
+ * In-kernel boost policy (policy_mode "kernel"), runs from load_work
  * ----------------------
  */
 
-static ssize_t boost_show(struct kobject *kobj,
-                          struct kobj_attribute *attr,
-                          char *buf)
-{
-    return scnprintf(buf, PAGE_SIZE, "%d\n", boost_level);
-}
+struct policy_input {
+    int avg;
+    int max;
+    int proc;       // CPU % of the target process since the last sample
+    int mem;        // memory used %
+    int run;        // runnable tasks
+    int blocked;    // tasks in iowait
+    int wait;       // runqueue wait % of the target, 0 if not sampled
+};
 
-static ssize_t boost_store(struct kobject *kobj,
-                           struct kobj_attribute *attr,
-                           const char *buf,
-                           size_t count)
+static int mem_used_pct(void)
 {
-    int val;
+    struct sysinfo si;
+    unsigned long avail;
 
-    if (kstrtoint(buf, 10, &val) == 0) {
-        if (val < 0) val = 0;
-        if (val > 3) val = 3;
+    si_meminfo(&si);
+    if (!si.totalram)
+        return 0;
 
-        boost_level = val;
-        pr_info("adaptive_sched: boost_level set to %d\n", boost_level);
+    avail = min_t(unsigned long, si_mem_available(), si.totalram);
+    return (int)div64_u64((u64)(si.totalram - avail) * 100, si.totalram);
+}
 
-        apply_boost_to_target();
-    } else {
-        pr_info("adaptive_sched: invalid value for boost_level\n");
+// CPU time of the whole process, like /proc/<pid>/stat utime + stime
+static u64 process_runtime(struct pid *pid)
+{
+    struct task_struct *task, *t;
+    u64 runtime = 0;
+
+    rcu_read_lock();
+    task = pid_task(pid, PIDTYPE_PID);
+    if (task) {
+        runtime = READ_ONCE(task->signal->sum_sched_runtime);
+        for_each_thread(task, t)
+            runtime += READ_ONCE(t->se.sum_exec_runtime);
     }
+    rcu_read_unlock();
 
-    return count;
+    return runtime;
 }
 
-static struct kobj_attribute boost_attr =
-    __ATTR(boost_level, 0664, boost_show, boost_store);
+static int target_cpu_pct(struct adaptive_target *t)
+{
+    u64 now = ktime_get_ns();
+    u64 runtime = process_runtime(t->pid_ref);
+    int pct = 0;
 
-/*
- * ----------------------
- * sysfs: current_load (average load, read-only)
- * ----------------------
- */
+    if (kpolicy.target == t && now > kpolicy.stamp_ns &&
+        runtime >= kpolicy.runtime_ns)
+        pct = (int)div64_u64((runtime - kpolicy.runtime_ns) * 100,
+                             now - kpolicy.stamp_ns);
 
-static ssize_t load_show(struct kobject *kobj,
-                         struct kobj_attribute *attr,
-                         char *buf)
+    if (kpolicy.target != t) {
+        kpolicy.target = t;
+        kpolicy.down_since_ns = 0;
+    }
+    kpolicy.runtime_ns = runtime;
+    kpolicy.stamp_ns = now;
+
+    return pct;
+}
+
+static int rule_threshold(int v, int margin)
 {
-    return scnprintf(buf, PAGE_SIZE, "%d\n", current_load);
+    return v >= POLICY_RULE_OFF ? INT_MAX : v - margin;
 }
 
-static struct kobj_attribute load_attr =
-    __ATTR(current_load, 0444, load_show, NULL);
+static bool rule_fires(const struct policy_rule *r, struct policy_input *in,
+                       int margin)
+{
+    if (in->avg >= rule_threshold(r->avg, margin) ||
+        in->max >= rule_threshold(r->max, margin) ||
+        in->proc >= rule_threshold(r->proc, margin) ||
+        in->wait >= rule_threshold(r->wait, margin))
+        return true;
 
-/*
- * ----------------------
- * sysfs: max_load (maximum per-CPU load, read-only)
- * ----------------------
- */
+    return in->mem >= rule_threshold(r->mem, margin) && in->run >= r->run;
+}
 
-static ssize_t max_load_show(struct kobject *kobj,
-                             struct kobj_attribute *attr,
-                             char *buf)
+static int eval_policy_rules(struct policy_input *in, int margin)
 {
-    return scnprintf(buf, PAGE_SIZE, "%d\n", max_load);
-}
+    int level;
 
-static struct kobj_attribute max_load_attr =
-    __ATTR(max_load, 0444, max_load_show, NULL);
+    for (level = ARRAY_SIZE(policy_rules) - 1; level > 0; level--) {
+        if (rule_fires(&policy_rules[level], in, margin))
+            return level;
+    }
 
-/*
- * ----------------------
- * sysfs: target_pid
- * ----------------------
- */
+    return 0;
+}
 
-static ssize_t target_pid_show(struct kobject *kobj,
-                               struct kobj_attribute *attr,
-                               char *buf)
+// Scaled value of one model feature; PSI is not available to modules
+static s64 model_feature(const struct adaptive_model_feature *f,
+                         const struct policy_input *in,
+                         const struct adaptive_snapshot *snap)
 {
-    return scnprintf(buf, PAGE_SIZE, "%d\n", target_pid);
+    s64 scale = f->scale;
+
+    switch (f->id) {
+    case ADAPTIVE_FEAT_AVG_LOAD:
+        return in->avg * scale;
+    case ADAPTIVE_FEAT_MAX_LOAD:
+        return in->max * scale;
+    case ADAPTIVE_FEAT_PROC_CPU:
+        return in->proc * scale;
+    case ADAPTIVE_FEAT_MEM_USED_PCT:
+        return in->mem * scale;
+    case ADAPTIVE_FEAT_PROCS_RUNNING:
+        return in->run * scale;
+    case ADAPTIVE_FEAT_PROCS_BLOCKED:
+        return in->blocked * scale;
+    case ADAPTIVE_FEAT_LOADAVG1:
+    case ADAPTIVE_FEAT_LOADAVG5:
+    case ADAPTIVE_FEAT_LOADAVG15:
+        return ((u64)avenrun[f->id - ADAPTIVE_FEAT_LOADAVG1] * f->scale) >> FSHIFT;
+    case ADAPTIVE_FEAT_PROC_VMS_KB:
+        return snap->proc_vms_kb * scale;
+    case ADAPTIVE_FEAT_PROC_RSS_KB:
+        return snap->proc_rss_kb * scale;
+    case ADAPTIVE_FEAT_PROC_THREADS:
+        return snap->proc_threads * scale;
+    case ADAPTIVE_FEAT_PROC_READ_BYTES:
+        return snap->proc_read_bytes * scale;
+    case ADAPTIVE_FEAT_PROC_WRITE_BYTES:
+        return snap->proc_write_bytes * scale;
+    default:
+        return 0;
+    }
 }
 
-static ssize_t target_pid_store(struct kobject *kobj,
-                                struct kobj_attribute *attr,
-                                const char *buf,
-                                size_t count)
+static int eval_policy_model(const struct adaptive_model_header *h,
+                             const struct policy_input *in,
+                             struct adaptive_target *t)
 {
-    pid_t pid_val;
+    const struct adaptive_model_feature *features = adaptive_model_features(h);
+    struct adaptive_snapshot snap;
+    s64 x[ADAPTIVE_FEAT_COUNT];
+    u32 i;
 
-    if (kstrtoint(buf, 10, &pid_val) == 0) {
-        if (pid_val < 0) pid_val = 0;
+    memset(&snap, 0, sizeof(snap));
+    snapshot_fill_target(&snap, t->pid_ref);
 
-        target_pid = pid_val;
-        pr_info("adaptive_sched: target_pid set to %d\n", target_pid);
+    for (i = 0; i < h->nr_features; i++)
+        x[i] = model_feature(&features[i], in, &snap);
 
-        if (target_pid > 0)
-            apply_boost_to_target();
+    return clamp_boost(adaptive_model_eval(h, x));
+}
 
-    } else {
-        pr_info("adaptive_sched: invalid value for target_pid\n");
-    }
+static void run_kernel_policy(int avg, int max, const struct rq_stats *rq)
+{
+    struct policy_input in = {
+        .avg = avg,
+        .max = max,
+        .run = rq->nr_running,
+        .blocked = rq->nr_blocked,
+    };
+    struct adaptive_target *t;
+    int raw, hold, level;
+    bool use_model;
+    u64 start;
 
-    return count;
-}
+    mutex_lock(&targets_lock);
 
-static struct kobj_attribute target_pid_attr =
-    __ATTR(target_pid, 0664, target_pid_show, target_pid_store);
+    t = primary_target;
+    if (policy_mode == POLICY_MODE_USER || !t) {
+        reset_kernel_policy();
+        goto out;
+    }
+    start = ktime_get_ns();
 
-/*
- * ----------------------
- * sysfs group
- * ----------------------
- */
+    in.proc = target_cpu_pct(t);
+    in.mem = mem_used_pct();
+    if (rq->target_pid == t->pid)
+        in.wait = min_t(unsigned int, rq->target_wait_pct, 100);
 
-static struct attribute *attrs[] = {
-    &boost_attr.attr,
-    &load_attr.attr,
-    &max_load_attr.attr,
-    &target_pid_attr.attr,
-    NULL,
-};
+    use_model = policy_mode == POLICY_MODE_MODEL && policy_model;
+    if (use_model)
+        raw = eval_policy_model(policy_model, &in, t);
+    else
+        raw = eval_policy_rules(&in, 0);
+    level = t->boost;
 
-static const struct attribute_group attr_group = {
-    .attrs = attrs,
-};
+    // The dwell is time, not samples: the sample period adapts to the load
+    if (raw > level) {
+        level = raw;
+        kpolicy.down_since_ns = 0;
+    } else if (raw < level) {
+        hold = use_model ? raw : eval_policy_rules(&in, policy_margin);
+        if (hold >= level) {
+            kpolicy.down_since_ns = 0;
+        } else if (!kpolicy.down_since_ns) {
+            kpolicy.down_since_ns = start;
+        }
+        if (kpolicy.down_since_ns && start - kpolicy.down_since_ns >=
+            (u64)policy_dwell_ms * NSEC_PER_MSEC) {
+            level = hold;
+            kpolicy.down_since_ns = 0;
+        }
+    } else {
+        kpolicy.down_since_ns = 0;
+    }
+    overhead_account(OVERHEAD_POLICY, start);
 
-static struct kobject *adaptive_kobj;
+    if (level != t->boost) {
+        pr_debug("adaptive_sched: %s policy boost_level %d -> %d (avg=%d max=%d proc=%d wait=%d mem=%d)\n",
+                 use_model ? "model" : "kernel", t->boost, level,
+                 in.avg, in.max, in.proc, in.wait, in.mem);
+        boost_level = level;
+        t->boost = level;
+        apply_boost_to_target(t, BOOST_REASON_POLICY);
+        sysfs_notify(adaptive_kobj, NULL, "boost_level");
+    }
+
+out:
+    mutex_unlock(&targets_lock);
+}
 
 /*
  * ----------------------
@@ -298,37 +4617,48 @@ static struct kobject *adaptive_kobj;
 
 static void load_work_func(struct work_struct *work)
 {
-    int cpu;
-    int sum = 0;
-    int cnt = 0;
-    int local_max = 0;
+    struct load_partial total = { 0, 0, 0 };
+    struct rq_stats rq;
+    unsigned long delay;
+    u64 start = ktime_get_ns(), step;
+    int local_max;
+    int avg;
 
-    for_each_online_cpu(cpu) {
-        int load = get_cpu_load(cpu);
+    sample_all_cpus(&total);
+    sample_runqueues(&rq);
+    overhead_account(OVERHEAD_SAMPLE, start);
 
-        if (load < 0)
-            load = 0;
-        if (load > 100)
-            load = 100;
+    if (total.cnt > 0)
+        avg = total.sum / total.cnt;
+    else
+        avg = 0;
 
-        sum += load;
-        cnt++;
+    local_max = total.max;
 
-        if (load > local_max)
-            local_max = load;
-    }
+    aggregate_groups();
 
-    if (cnt > 0)
-        current_load = sum / cnt;
-    else
-        current_load = 0;
+    publish_sample(avg, local_max, &rq);
+
+    pr_debug("adaptive_sched: avg_load=%d%%, max_load=%d%%, rq_waiting=%u, wait=%u%%\n",
+             avg, local_max, rq.waiting, rq.wait_pct);
 
-    max_load = local_max;
+    notify_load_change(&avg_notifier, avg);
+    notify_load_change(&max_notifier, local_max);
 
-    pr_debug("adaptive_sched: avg_load=%d%%, max_load=%d%%\n",
-             current_load, max_load);
+    run_kernel_policy(avg, local_max, &rq);
+    log_sample();
+    refresh_targets();
 
-    schedule_delayed_work(&load_work, msecs_to_jiffies(500));
+    step = ktime_get_ns();
+    scan_top_tasks();
+    overhead_account(OVERHEAD_TOP_SCAN, step);
+
+    delay = next_sample_delay(avg, local_max);
+    trace_adaptive_sched_sample(READ_ONCE(metrics.seq), avg, local_max,
+                                rq.nr_running, rq.waiting, rq.wait_pct,
+                                READ_ONCE(sample_cur_ms));
+    overhead_account(OVERHEAD_LOAD_WORK, start);
+    schedule_delayed_work(&load_work, delay);
 }
 
 /*
@@ -337,42 +4667,185 @@ static void load_work_func(struct work_struct *work)
  * ----------------------
  */
 
+static void free_level_affinity(void)
+{
+    int level;
+
+    for (level = 0; level < ARRAY_SIZE(level_affinity); level++)
+        free_cpumask_var(level_affinity[level].cpus);
+}
+
 static int __init adaptive_sched_init(void)
 {
-    int ret;
+    int ret, node, level;
 
     pr_info("adaptive_sched: init\n");
 
+    if (!valid_period(sample_period_ms))
+        sample_period_ms = 500;
+    if (!valid_period(sample_min_ms) || !valid_period(sample_max_ms) ||
+        sample_min_ms > sample_max_ms) {
+        sample_min_ms = 50;
+        sample_max_ms = 2000;
+    }
+    sample_cur_ms = sample_period_ms;
+
+    if (history_depth == 0 || history_depth > HISTORY_DEPTH_MAX)
+        history_depth = 64;
+
+    cpu_history = kvcalloc((size_t)nr_cpu_ids * history_depth,
+                           sizeof(*cpu_history), GFP_KERNEL);
+    cpu_staging = kvcalloc(nr_cpu_ids, sizeof(*cpu_staging), GFP_KERNEL);
+    node_samplers = kcalloc(nr_node_ids, sizeof(*node_samplers), GFP_KERNEL);
+    node_groups = kcalloc(nr_node_ids, sizeof(*node_groups), GFP_KERNEL);
+    node_groups_staging = kcalloc(nr_node_ids, sizeof(*node_groups), GFP_KERNEL);
+    llc_groups = kvcalloc(nr_cpu_ids, sizeof(*llc_groups), GFP_KERNEL);
+    llc_groups_staging = kvcalloc(nr_cpu_ids, sizeof(*llc_groups), GFP_KERNEL);
+    if (!cpu_history || !cpu_staging || !node_samplers ||
+        !node_groups || !node_groups_staging ||
+        !llc_groups || !llc_groups_staging) {
+        ret = -ENOMEM;
+        goto err_free;
+    }
+
+    for (node = 0; node < nr_node_ids; node++) {
+        node_samplers[node].node = node;
+        INIT_WORK(&node_samplers[node].work, node_sample_func);
+    }
+
+    for (level = 0; level < ARRAY_SIZE(level_affinity); level++) {
+        if (!zalloc_cpumask_var(&level_affinity[level].cpus, GFP_KERNEL)) {
+            ret = -ENOMEM;
+            goto err_free;
+        }
+    }
+    cpu_history_attr.size = sizeof(struct adaptive_cpu_history_header) +
+                            cpu_history_bytes();
+
+    ret = cpuhp_setup_state_nocalls(CPUHP_AP_ONLINE_DYN, "adaptive_sched:online",
+                                    adaptive_cpu_online, adaptive_cpu_offline);
+    if (ret < 0) {
+        pr_err("adaptive_sched: failed to register CPU hotplug callbacks\n");
+        goto err_free;
+    }
+    adaptive_cpuhp_state = ret;
+
+    // Initialized before the sysfs files exist: sample_* writes reschedule it
+    INIT_DELAYED_WORK(&load_work, load_work_func);
+
     adaptive_kobj = kobject_create_and_add("adaptive_sched", kernel_kobj);
     if (!adaptive_kobj) {
         pr_err("adaptive_sched: failed to create kobject\n");
-        return -ENOMEM;
+        ret = -ENOMEM;
+        goto err_cpuhp;
     }
 
     ret = sysfs_create_group(adaptive_kobj, &attr_group);
     if (ret) {
         pr_err("adaptive_sched: failed to create sysfs group\n");
-        kobject_put(adaptive_kobj);
-        return ret;
+        goto err_put;
     }
 
-    INIT_DELAYED_WORK(&load_work, load_work_func);
-    schedule_delayed_work(&load_work, msecs_to_jiffies(500));
+    ret = sysfs_create_bin_file(adaptive_kobj, &snapshot_attr);
+    if (ret) {
+        pr_err("adaptive_sched: failed to create snapshot file\n");
+        goto err_group;
+    }
+
+    ret = sysfs_create_bin_file(adaptive_kobj, &cpu_history_attr);
+    if (ret) {
+        pr_err("adaptive_sched: failed to create cpu_history file\n");
+        goto err_snapshot;
+    }
+
+    ret = sysfs_create_bin_file(adaptive_kobj, &top_table_attr);
+    if (ret) {
+        pr_err("adaptive_sched: failed to create top_table file\n");
+        goto err_cpu_history;
+    }
+
+    ret = sysfs_create_bin_file(adaptive_kobj, &policy_model_attr);
+    if (ret) {
+        pr_err("adaptive_sched: failed to create policy_model file\n");
+        goto err_top_table;
+    }
+
+    ret = misc_register(&log_device);
+    if (ret) {
+        pr_err("adaptive_sched: failed to register /dev/%s\n", log_device.name);
+        goto err_policy_model;
+    }
+
+    schedule_delayed_work(&load_work, msecs_to_jiffies(sample_cur_ms));
 
     pr_info("adaptive_sched: sysfs interface created, work scheduled\n");
     return 0;
+
+err_policy_model:
+    sysfs_remove_bin_file(adaptive_kobj, &policy_model_attr);
+err_top_table:
+    sysfs_remove_bin_file(adaptive_kobj, &top_table_attr);
+err_cpu_history:
+    sysfs_remove_bin_file(adaptive_kobj, &cpu_history_attr);
+err_snapshot:
+    sysfs_remove_bin_file(adaptive_kobj, &snapshot_attr);
+err_group:
+    sysfs_remove_group(adaptive_kobj, &attr_group);
+err_put:
+    kobject_put(adaptive_kobj);
+err_cpuhp:
+    cpuhp_remove_state_nocalls(adaptive_cpuhp_state);
+err_free:
+    free_level_affinity();
+    kvfree(llc_groups_staging);
+    kvfree(llc_groups);
+    kfree(node_groups_staging);
+    kfree(node_groups);
+    kfree(node_samplers);
+    kvfree(cpu_staging);
+    kvfree(cpu_history);
+    return ret;
 }
 
 static void __exit adaptive_sched_exit(void)
 {
     pr_info("adaptive_sched: exit\n");
 
-    cancel_delayed_work_sync(&load_work);
-
+    // Remove the files first: sample_* writes may re-arm load_work
+    misc_deregister(&log_device);
     if (adaptive_kobj) {
+        sysfs_remove_bin_file(adaptive_kobj, &policy_model_attr);
+        sysfs_remove_bin_file(adaptive_kobj, &top_table_attr);
+        sysfs_remove_bin_file(adaptive_kobj, &cpu_history_attr);
+        sysfs_remove_bin_file(adaptive_kobj, &snapshot_attr);
         sysfs_remove_group(adaptive_kobj, &attr_group);
-        kobject_put(adaptive_kobj);
     }
+
+    cancel_delayed_work_sync(&load_work);
+
+    if (adaptive_kobj)
+        kobject_put(adaptive_kobj);
+
+    cpuhp_remove_state_nocalls(adaptive_cpuhp_state);
+
+    mutex_lock(&targets_lock);
+    clear_targets();
+    mutex_unlock(&targets_lock);
+
+    put_pid(rq_prev.target);
+    kvfree(policy_model);
+    discard_model_upload();
+    delay_prune(rq_group_delays, 0);
+    delay_prune(rq_target_delays, 0);
+    free_tgid_runtimes();
+    free_level_affinity();
+    kvfree(llc_groups_staging);
+    kvfree(llc_groups);
+    kfree(node_groups_staging);
+    kfree(node_groups);
+    kfree(node_samplers);
+    kvfree(cpu_staging);
+    kvfree(cpu_history);
 }
 
 module_init(adaptive_sched_init);
@@ -0,0 +1,207 @@
+/*
+ * adaptive_sched_trace.h - tracepoints of the adaptive_sched module
+ *
+ * Events, under the adaptive_sched system:
+ *  - adaptive_sched_sample  every load sample (load_work)
+ *  - adaptive_sched_notify  current_load / max_load woke up poll()ers
+ *  - adaptive_sched_target  a target was added, removed or made primary
+ *  - adaptive_sched_boost   a target moved to a boost level (restore at 0)
+ *
+ * seq is the load sample counter in all of them, so a boost can be
+ * matched with the sample and the notification that led to it, e.g.
+ *   perf record -e 'adaptive_sched:*' -a
+ *   bpftrace -e 'tracepoint:adaptive_sched:adaptive_sched_boost { ... }'
+ * Disabled, each one costs a patched-out branch.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM adaptive_sched
+
+#if !defined(_ADAPTIVE_SCHED_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _ADAPTIVE_SCHED_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#ifndef _ADAPTIVE_SCHED_TRACE_ENUMS
+#define _ADAPTIVE_SCHED_TRACE_ENUMS
+
+// Why apply_boost_to_target() ran
+enum adaptive_boost_reason {
+    BOOST_REASON_USER = 0,      // boost_level written by userspace
+    BOOST_REASON_POLICY,        // in-kernel policy (policy_mode kernel/model)
+    BOOST_REASON_TARGET,        // target_pid / targets / throttle command
+    BOOST_REASON_CONFIG,        // target_scope, boost_policy or rt_budget changed
+    BOOST_REASON_BUDGET,        // SCHED_FIFO budget spent or restored
+};
+
+enum adaptive_target_action {
+    TARGET_ACTION_ADD = 0,
+    TARGET_ACTION_DEL,
+    TARGET_ACTION_PRIMARY,
+};
+
+#endif /* _ADAPTIVE_SCHED_TRACE_ENUMS */
+
+TRACE_DEFINE_ENUM(BOOST_REASON_USER);
+TRACE_DEFINE_ENUM(BOOST_REASON_POLICY);
+TRACE_DEFINE_ENUM(BOOST_REASON_TARGET);
+TRACE_DEFINE_ENUM(BOOST_REASON_CONFIG);
+TRACE_DEFINE_ENUM(BOOST_REASON_BUDGET);
+TRACE_DEFINE_ENUM(TARGET_ACTION_ADD);
+TRACE_DEFINE_ENUM(TARGET_ACTION_DEL);
+TRACE_DEFINE_ENUM(TARGET_ACTION_PRIMARY);
+
+#define show_boost_reason(r)                        \
+    __print_symbolic(r,                             \
+        { BOOST_REASON_USER,   "user" },            \
+        { BOOST_REASON_POLICY, "policy" },          \
+        { BOOST_REASON_TARGET, "target" },          \
+        { BOOST_REASON_CONFIG, "config" },          \
+        { BOOST_REASON_BUDGET, "budget" })
+
+#define show_target_action(a)                       \
+    __print_symbolic(a,                             \
+        { TARGET_ACTION_ADD,     "add" },           \
+        { TARGET_ACTION_DEL,     "del" },           \
+        { TARGET_ACTION_PRIMARY, "primary" })
+
+TRACE_EVENT(adaptive_sched_sample,
+
+    TP_PROTO(u64 seq, int avg_load, int max_load, unsigned int nr_running,
+             unsigned int waiting, unsigned int wait_pct, unsigned int period_ms),
+
+    TP_ARGS(seq, avg_load, max_load, nr_running, waiting, wait_pct, period_ms),
+
+    TP_STRUCT__entry(
+        __field(u64,          seq)
+        __field(int,          avg_load)
+        __field(int,          max_load)
+        __field(unsigned int, nr_running)
+        __field(unsigned int, waiting)
+        __field(unsigned int, wait_pct)
+        __field(unsigned int, period_ms)
+    ),
+
+    TP_fast_assign(
+        __entry->seq        = seq;
+        __entry->avg_load   = avg_load;
+        __entry->max_load   = max_load;
+        __entry->nr_running = nr_running;
+        __entry->waiting    = waiting;
+        __entry->wait_pct   = wait_pct;
+        __entry->period_ms  = period_ms;
+    ),
+
+    TP_printk("seq=%llu avg=%d max=%d running=%u waiting=%u wait=%u%% next=%ums",
+              __entry->seq, __entry->avg_load, __entry->max_load,
+              __entry->nr_running, __entry->waiting, __entry->wait_pct,
+              __entry->period_ms)
+);
+
+// metric: 0 current_load, 1 max_load
+TRACE_EVENT(adaptive_sched_notify,
+
+    TP_PROTO(u64 seq, int metric, int value),
+
+    TP_ARGS(seq, metric, value),
+
+    TP_STRUCT__entry(
+        __field(u64, seq)
+        __field(int, metric)
+        __field(int, value)
+    ),
+
+    TP_fast_assign(
+        __entry->seq    = seq;
+        __entry->metric = metric;
+        __entry->value  = value;
+    ),
+
+    TP_printk("seq=%llu %s=%d", __entry->seq,
+              __print_symbolic(__entry->metric,
+                               { 0, "current_load" }, { 1, "max_load" }),
+              __entry->value)
+);
+
+TRACE_EVENT(adaptive_sched_target,
+
+    TP_PROTO(int action, pid_t pid, int scope, int policy, int boost,
+             bool throttle),
+
+    TP_ARGS(action, pid, scope, policy, boost, throttle),
+
+    TP_STRUCT__entry(
+        __field(int,   action)
+        __field(pid_t, pid)
+        __field(int,   scope)
+        __field(int,   policy)
+        __field(int,   boost)
+        __field(bool,  throttle)
+    ),
+
+    TP_fast_assign(
+        __entry->action   = action;
+        __entry->pid      = pid;
+        __entry->scope    = scope;
+        __entry->policy   = policy;
+        __entry->boost    = boost;
+        __entry->throttle = throttle;
+    ),
+
+    TP_printk("%s pid=%d scope=%d policy=%d level=%d%s",
+              show_target_action(__entry->action), __entry->pid,
+              __entry->scope, __entry->policy, __entry->boost,
+              __entry->throttle ? " throttle" : "")
+);
+
+/*
+ * old_nice / new_nice are those of the target's own task (0 for cgroup
+ * targets); nr_tasks is the number of tasks changed, -1 if it has exited.
+ */
+TRACE_EVENT(adaptive_sched_boost,
+
+    TP_PROTO(u64 seq, pid_t pid, int policy, int old_level, int new_level,
+             int old_nice, int new_nice, int nr_tasks, int reason),
+
+    TP_ARGS(seq, pid, policy, old_level, new_level, old_nice, new_nice,
+            nr_tasks, reason),
+
+    TP_STRUCT__entry(
+        __field(u64,   seq)
+        __field(pid_t, pid)
+        __field(int,   policy)
+        __field(int,   old_level)
+        __field(int,   new_level)
+        __field(int,   old_nice)
+        __field(int,   new_nice)
+        __field(int,   nr_tasks)
+        __field(int,   reason)
+    ),
+
+    TP_fast_assign(
+        __entry->seq       = seq;
+        __entry->pid       = pid;
+        __entry->policy    = policy;
+        __entry->old_level = old_level;
+        __entry->new_level = new_level;
+        __entry->old_nice  = old_nice;
+        __entry->new_nice  = new_nice;
+        __entry->nr_tasks  = nr_tasks;
+        __entry->reason    = reason;
+    ),
+
+    TP_printk("seq=%llu pid=%d policy=%d level=%d->%d nice=%d->%d tasks=%d reason=%s",
+              __entry->seq, __entry->pid, __entry->policy,
+              __entry->old_level, __entry->new_level,
+              __entry->old_nice, __entry->new_nice, __entry->nr_tasks,
+              show_boost_reason(__entry->reason))
+);
+
+#endif /* _ADAPTIVE_SCHED_TRACE_H */
+
+// Must be outside the protection above
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE adaptive_sched_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,343 @@
+/*
+ * adaptive_sched_uapi.h - binary interface of the adaptive_sched module
+ *
+ * Shared between the kernel module and userspace tools. All structures
+ * have a fixed layout (naturally aligned, no implicit padding) and start
+ * with a version and a size, so readers can reject layouts they do not
+ * know and older readers can ignore fields appended at the end.
+ */
+
+#ifndef _ADAPTIVE_SCHED_UAPI_H
+#define _ADAPTIVE_SCHED_UAPI_H
+
+#include <linux/types.h>
+
+/*
+ * ----------------------
+ * /sys/kernel/adaptive_sched/snapshot
+ * ----------------------
+ * One read returns all counters the control loop needs, gathered in a
+ * single kernel pass. Target fields describe the primary target
+ * (target_pid) and are valid only with ADAPTIVE_SNAP_HAVE_TARGET.
+ */
+
+#define ADAPTIVE_SNAPSHOT_VERSION   1
+
+#define ADAPTIVE_SNAP_HAVE_TARGET   (1U << 0)   // proc_* fields are valid
+#define ADAPTIVE_SNAP_HAVE_IO       (1U << 1)   // proc_*_bytes are valid
+#define ADAPTIVE_SNAP_HAVE_PSI      (1U << 2)   // psi_cpu_* are valid
+#define ADAPTIVE_SNAP_HAVE_DELAY    (1U << 3)   // wait_pct, proc_*wait* are valid
+
+struct adaptive_snapshot {
+    __u32 version;              // ADAPTIVE_SNAPSHOT_VERSION
+    __u32 size;                 // sizeof(struct adaptive_snapshot)
+    __u32 flags;                // ADAPTIVE_SNAP_HAVE_*
+    __u32 nr_cpus;              // online CPUs
+
+    __u64 timestamp_ns;         // CLOCK_BOOTTIME when the snapshot was taken
+    __u64 seq;                  // number of load samples taken so far
+
+    // Module load metrics
+    __s32 avg_load;             // current_load, 0..100
+    __s32 max_load;             // max_load, 0..100
+    __s32 boost_level;          // boost_level of the primary target
+    __s32 target_pid;           // primary target, 0 if none
+
+    // System-wide counters (/proc/meminfo, /proc/stat, /proc/loadavg)
+    __u64 mem_total_kb;
+    __u64 mem_available_kb;
+    __u32 procs_running;        // of the last sample, like rq_running
+    __u32 procs_blocked;        // tasks sleeping in iowait
+    __u32 loadavg[3];           // 1/5/15 min load average * 100
+    __u32 psi_cpu_some;         // avg10 * 100
+    __u32 psi_cpu_full;         // avg10 * 100
+
+    // Primary target process (/proc/<pid>/status, /proc/<pid>/io)
+    __u32 proc_threads;
+    __u64 proc_vms_kb;
+    __u64 proc_rss_kb;
+    __u64 proc_read_bytes;
+    __u64 proc_write_bytes;
+    __u64 proc_runtime_ns;      // CPU time consumed by the whole process
+
+    // Runqueue latency of the last load sample (appended, check size)
+    __u32 rq_running;           // runnable tasks, running or queued
+    __u32 rq_waiting;           // runnable tasks queued behind another one
+    __u32 rq_max_depth;         // deepest per-CPU runqueue
+    __u32 wait_pct;             // runqueue wait per online CPU, % of the sample
+    __u64 proc_run_delay_ns;    // target: total time spent waiting on a runqueue
+    __u32 proc_wait_pct;        // target: runqueue wait in the last sample, % of it
+    __u32 reserved;
+};
+
+/*
+ * ----------------------
+ * /sys/kernel/adaptive_sched/cpu_history
+ * ----------------------
+ * struct adaptive_cpu_history_header, then nr_cpus * depth samples,
+ * CPU-major: sample[cpu * depth + slot]. The newest sample sits at slot
+ * (head + depth - 1) % depth. All percentages are of the sample interval;
+ * busy includes irq, softirq and steal.
+ */
+
+#define ADAPTIVE_CPU_HISTORY_VERSION    1
+
+#define ADAPTIVE_CPU_SAMPLE_VALID       (1U << 0)   // CPU was online and sampled
+
+struct adaptive_cpu_sample {
+    __u8  busy;
+    __u8  iowait;
+    __u8  irq;
+    __u8  softirq;
+    __u8  steal;
+    __u8  flags;                // ADAPTIVE_CPU_SAMPLE_*
+    __u16 nr_running;           // runnable tasks on the CPU, formerly reserved (0)
+};
+
+struct adaptive_cpu_history_header {
+    __u32 version;              // ADAPTIVE_CPU_HISTORY_VERSION
+    __u32 size;                 // sizeof(struct adaptive_cpu_history_header)
+    __u32 nr_cpus;              // nr_cpu_ids (possible CPUs)
+    __u32 depth;                // samples per CPU
+    __u64 seq;                  // snapshot seq of the newest sample
+    __u32 head;                 // next slot to be written
+    __u32 sample_size;          // sizeof(struct adaptive_cpu_sample)
+};
+
+/*
+ * ----------------------
+ * /sys/kernel/adaptive_sched/top_table
+ * ----------------------
+ * struct adaptive_top_header followed by ADAPTIVE_TOP_TASKS_MAX entries,
+ * the first nr of them valid, heaviest first. CPU usage and run delay
+ * cover the interval_ns before the scan; cpu_x10 is relative to one CPU.
+ */
+
+#define ADAPTIVE_TOP_TABLE_VERSION  1
+#define ADAPTIVE_TOP_TASKS_MAX      16
+#define ADAPTIVE_TOP_COMM_LEN       16
+
+struct adaptive_top_header {
+    __u32 version;              // ADAPTIVE_TOP_TABLE_VERSION
+    __u32 size;                 // sizeof(struct adaptive_top_header)
+    __u32 nr;                   // valid entries
+    __u32 entry_size;           // sizeof(struct adaptive_top_task)
+    __u64 seq;                  // scan number
+    __u64 interval_ns;          // length of the scanned interval
+};
+
+struct adaptive_top_task {
+    __s32 pid;                  // busiest thread (most CPU time in total)
+    __s32 tgid;
+    __u32 cpu_x10;              // CPU % * 10
+    __u32 nr_threads;
+    __u64 run_delay_ns;         // time spent waiting on a runqueue, all threads
+    char  comm[ADAPTIVE_TOP_COMM_LEN];
+};
+
+/*
+ * ----------------------
+ * /dev/adaptive_sched_log
+ * ----------------------
+ * While the device is open (one reader at a time) every load sample
+ * appends one record to a kernel buffer: the snapshot as load_work saw it
+ * plus that sample of every CPU (offline ones without
+ * ADAPTIVE_CPU_SAMPLE_VALID). read() returns whole records only, as many
+ * as fit, and blocks unless O_NONBLOCK while the buffer is empty; a
+ * buffer smaller than one record gets -EINVAL. Records that did not fit
+ * into a full kernel buffer are counted in the next record's dropped.
+ */
+
+#define ADAPTIVE_LOG_VERSION        1
+
+struct adaptive_log_record {
+    __u32 version;              // ADAPTIVE_LOG_VERSION
+    __u32 size;                 // whole record, cpus[] included
+    __u32 nr_cpus;              // entries in cpus[] (nr_cpu_ids)
+    __u32 dropped;              // records lost right before this one
+    struct adaptive_snapshot snap;
+    struct adaptive_cpu_sample cpus[];
+};
+
+/*
+ * ----------------------
+ * /sys/kernel/adaptive_sched/policy_model (write-only), model.bin
+ * ----------------------
+ * A tree ensemble (RandomForest exported by export_model.py) as flat
+ * tables: struct adaptive_model_header, nr_features feature entries,
+ * nr_trees root indices (__u32), then nr_nodes nodes starting at the next
+ * 8-byte boundary (see adaptive_model_nodes_offset()).
+ *
+ * All comparisons are on integers: a feature value v is used as
+ * floor(v * scale) and a split sends it left when that is <= threshold.
+ * Nodes of a tree are stored in preorder, so the left child of a split is
+ * the next node and right > the node's own index. A leaf stores the class
+ * weights of its samples in threshold, 16 bits per class (class c in bits
+ * 16c..16c+15, fractions of 65535); the ensemble predicts the class with
+ * the largest sum over all trees, i.e. soft voting like sklearn.
+ */
+
+#define ADAPTIVE_MODEL_MAGIC        0x4c444d41  // "AMDL"
+#define ADAPTIVE_MODEL_VERSION      1
+#define ADAPTIVE_MODEL_MAX_CLASSES  4
+#define ADAPTIVE_MODEL_MAX_SIZE     (4U << 20)
+
+// Feature ids, named like the CSV log columns
+enum adaptive_model_feature_id {
+    ADAPTIVE_FEAT_AVG_LOAD = 0,
+    ADAPTIVE_FEAT_MAX_LOAD,
+    ADAPTIVE_FEAT_PROC_CPU,
+    ADAPTIVE_FEAT_MEM_USED_PCT,
+    ADAPTIVE_FEAT_PROCS_RUNNING,
+    ADAPTIVE_FEAT_PROCS_BLOCKED,
+    ADAPTIVE_FEAT_LOADAVG1,
+    ADAPTIVE_FEAT_LOADAVG5,
+    ADAPTIVE_FEAT_LOADAVG15,
+    ADAPTIVE_FEAT_PSI_CPU_SOME,
+    ADAPTIVE_FEAT_PSI_CPU_FULL,
+    ADAPTIVE_FEAT_PROC_VMS_KB,
+    ADAPTIVE_FEAT_PROC_RSS_KB,
+    ADAPTIVE_FEAT_PROC_THREADS,
+    ADAPTIVE_FEAT_PROC_READ_BYTES,
+    ADAPTIVE_FEAT_PROC_WRITE_BYTES,
+    ADAPTIVE_FEAT_COUNT,
+};
+
+struct adaptive_model_header {
+    __u32 magic;                // ADAPTIVE_MODEL_MAGIC
+    __u32 version;              // ADAPTIVE_MODEL_VERSION
+    __u32 size;                 // sizeof(struct adaptive_model_header)
+    __u32 total_size;           // whole file
+    __u32 nr_features;
+    __u32 nr_trees;
+    __u32 nr_nodes;
+    __u32 nr_classes;           // <= ADAPTIVE_MODEL_MAX_CLASSES
+    __u8  classes[ADAPTIVE_MODEL_MAX_CLASSES];  // boost level of each class
+    __u32 reserved;
+};
+
+struct adaptive_model_feature {
+    __u32 id;                   // enum adaptive_model_feature_id
+    __u32 scale;                // value resolution, see above
+};
+
+#define ADAPTIVE_MODEL_LEAF         (-1)
+
+struct adaptive_model_node {
+    __s64 threshold;            // split threshold, or the leaf's class weights
+    __s32 feature;              // index into the feature table, or ADAPTIVE_MODEL_LEAF
+    __u32 right;                // right child of a split
+};
+
+/*
+ * Shared by the module and the userspace evaluator. data points to a
+ * whole model file, 8-byte aligned; x[] holds the scaled feature values
+ * in feature table order.
+ */
+
+static inline __u32 adaptive_model_nodes_offset(const struct adaptive_model_header *h)
+{
+    __u32 off = h->size + h->nr_features * sizeof(struct adaptive_model_feature) +
+                h->nr_trees * sizeof(__u32);
+
+    return (off + 7) & ~7U;
+}
+
+static inline const struct adaptive_model_feature *
+adaptive_model_features(const struct adaptive_model_header *h)
+{
+    return (const struct adaptive_model_feature *)((const char *)h + h->size);
+}
+
+static inline const __u32 *adaptive_model_roots(const struct adaptive_model_header *h)
+{
+    return (const __u32 *)(adaptive_model_features(h) + h->nr_features);
+}
+
+static inline const struct adaptive_model_node *
+adaptive_model_nodes(const struct adaptive_model_header *h)
+{
+    return (const struct adaptive_model_node *)((const char *)h +
+                                                adaptive_model_nodes_offset(h));
+}
+
+// Non-zero if the len bytes at h are a well-formed model
+static inline int adaptive_model_valid(const struct adaptive_model_header *h,
+                                       __u64 len)
+{
+    const struct adaptive_model_feature *features;
+    const struct adaptive_model_node *nodes;
+    const __u32 *roots;
+    __u32 i, off;
+
+    if (len < sizeof(*h) || len > ADAPTIVE_MODEL_MAX_SIZE ||
+        h->magic != ADAPTIVE_MODEL_MAGIC || h->version != ADAPTIVE_MODEL_VERSION ||
+        h->size < sizeof(*h) || h->size > len || h->total_size != len)
+        return 0;
+
+    if (!h->nr_classes || h->nr_classes > ADAPTIVE_MODEL_MAX_CLASSES ||
+        h->nr_features > ADAPTIVE_FEAT_COUNT || !h->nr_trees ||
+        h->nr_trees > len / sizeof(__u32) ||
+        h->nr_nodes > len / sizeof(struct adaptive_model_node))
+        return 0;
+
+    off = adaptive_model_nodes_offset(h);
+    if (off > len || (len - off) / sizeof(*nodes) < h->nr_nodes)
+        return 0;
+
+    features = adaptive_model_features(h);
+    roots = adaptive_model_roots(h);
+    nodes = adaptive_model_nodes(h);
+
+    for (i = 0; i < h->nr_features; i++) {
+        if (features[i].id >= ADAPTIVE_FEAT_COUNT || !features[i].scale)
+            return 0;
+    }
+
+    for (i = 0; i < h->nr_trees; i++) {
+        if (roots[i] >= h->nr_nodes)
+            return 0;
+    }
+
+    // Children always come after their parent, so every walk ends
+    for (i = 0; i < h->nr_nodes; i++) {
+        if (nodes[i].feature == ADAPTIVE_MODEL_LEAF)
+            continue;
+        if (nodes[i].feature < 0 || (__u32)nodes[i].feature >= h->nr_features ||
+            nodes[i].right <= i + 1 || nodes[i].right >= h->nr_nodes)
+            return 0;
+    }
+
+    return 1;
+}
+
+// Boost level predicted by a valid model
+static inline int adaptive_model_eval(const struct adaptive_model_header *h,
+                                      const __s64 *x)
+{
+    const struct adaptive_model_node *nodes = adaptive_model_nodes(h);
+    const struct adaptive_model_node *n;
+    const __u32 *roots = adaptive_model_roots(h);
+    __u64 totals[ADAPTIVE_MODEL_MAX_CLASSES] = { 0 };
+    __u64 weights;
+    __u32 i, c, best = 0;
+
+    for (i = 0; i < h->nr_trees; i++) {
+        n = &nodes[roots[i]];
+        while (n->feature != ADAPTIVE_MODEL_LEAF)
+            n = x[n->feature] <= n->threshold ? n + 1 : &nodes[n->right];
+
+        weights = (__u64)n->threshold;
+        for (c = 0; c < h->nr_classes; c++)
+            totals[c] += (weights >> (16 * c)) & 0xffff;
+    }
+
+    for (c = 1; c < h->nr_classes; c++) {
+        if (totals[c] > totals[best])
+            best = c;
+    }
+
+    return h->classes[best];
+}
+
+#endif /* _ADAPTIVE_SCHED_UAPI_H */
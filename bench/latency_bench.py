@@ -0,0 +1,337 @@
+#!/usr/bin/env python3
+"""
+latency_bench.py — tail latency of a probe under noisy neighbours, per
+ADAPTIVE_MODE.
+
+Every run starts noisy_neighbors.sh, starts latency_probe (wakeup-to-run
+latency, see latency_probe.c) and, unless the mode is "off", the
+controller with ADAPTIVE_MODE=<mode> and the probe pinned as its target
+(ADAPTIVE_TARGET_PID). Each mode is run --repeats times, in a rotating
+order so slow drifts of the machine do not favour one mode. ml and hybrid
+are skipped without a model (ADAPTIVE_MODEL_BIN, or logs/model.pkl for
+the Python controller); every run records the controller's
+effective_mode, and runs whose controller fell back to another mode are
+left out of the summary.
+
+Results are written next to each other:
+  <output>.json  configuration, host, every run's probe output and the
+                 summary
+  <output>.csv   summary, one row per mode and metric: mean of the
+                 per-run percentile over the repeats, its standard
+                 deviation, a Student t confidence interval and the
+                 change against the baseline mode (off if it was run)
+
+Needs root and the module loaded (except for --modes off):
+  sudo ./latency_bench.py --repeats 5 --duration 30
+"""
+
+import argparse
+import csv
+import json
+import math
+import os
+import platform
+import signal
+import statistics
+import subprocess
+import sys
+import time
+from pathlib import Path
+from typing import Any, Dict, List, Optional
+
+SCRIPT_DIR = Path(__file__).resolve().parent
+REPO_DIR = SCRIPT_DIR.parent
+PROBE_BIN = SCRIPT_DIR / "latency_probe"
+NOISE_SCRIPT = REPO_DIR / "noisy_neighbors.sh"
+CONTROLLER_PY = REPO_DIR / "userspace_daemon" / "adaptive_controller.py"
+CONTROLLER_CTL = REPO_DIR / "userspace_daemon" / "adaptive_ctl"
+MODEL_BIN_PATH = Path(os.environ.get("ADAPTIVE_MODEL_BIN",
+                                     REPO_DIR / "userspace_daemon" / "model.bin"))
+MODEL_PKL_PATH = REPO_DIR / "userspace_daemon" / "logs" / "model.pkl"
+SYSFS_BASE = Path("/sys/kernel/adaptive_sched")
+
+MODES = ("off", "base", "ml", "hybrid")
+MODEL_MODES = ("ml", "hybrid")
+FALLBACK_MARK = "Falling back to MODE="
+METRICS = ("p50_us", "p99_us", "p999_us", "mean_us", "max_us")
+
+# two-sided Student t quantiles by degrees of freedom, beyond the table
+# the normal quantile is close enough
+T_QUANTILES = {
+    0.90: (6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812,
+           1.796, 1.782, 1.771, 1.761, 1.753, 1.746, 1.740, 1.734, 1.729, 1.725,
+           1.721, 1.717, 1.714, 1.711, 1.708, 1.706, 1.703, 1.701, 1.699, 1.697),
+    0.95: (12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+           2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+           2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042),
+    0.99: (63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+           3.106, 3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+           2.831, 2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750),
+}
+Z_QUANTILES = {0.90: 1.645, 0.95: 1.960, 0.99: 2.576}
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Probe tail latency per adaptive mode")
+    parser.add_argument("--modes", type=str, default=",".join(MODES),
+                        help="comma separated, from: " + ", ".join(MODES))
+    parser.add_argument("--repeats", type=int, default=5)
+    parser.add_argument("--duration", type=float, default=30.0,
+                        help="measured seconds per run")
+    parser.add_argument("--warmup", type=float, default=3.0,
+                        help="seconds of probe samples discarded at the start")
+    parser.add_argument("--settle", type=float, default=3.0,
+                        help="seconds the noise runs before the probe starts")
+    parser.add_argument("--cooldown", type=float, default=2.0,
+                        help="seconds between runs")
+    parser.add_argument("--probe", choices=("wakeup", "timer"), default="wakeup")
+    parser.add_argument("--threads", type=int, default=2)
+    parser.add_argument("--interval-us", type=int, default=1000)
+    parser.add_argument("--work-us", type=int, default=100)
+    parser.add_argument("--controller", choices=("py", "ctl"), default="py",
+                        help="adaptive_controller.py or the native adaptive_ctl")
+    parser.add_argument("--no-noise", action="store_true",
+                        help="do not start noisy_neighbors.sh")
+    parser.add_argument("--confidence", type=float, choices=sorted(T_QUANTILES),
+                        default=0.95)
+    parser.add_argument("--output", type=str, default=None,
+                        help="output prefix, default results/latency-<date>")
+    return parser.parse_args()
+
+
+# ----------------------------
+# Statistics
+# ----------------------------
+
+def t_quantile(confidence: float, df: int) -> float:
+    table = T_QUANTILES[confidence]
+    return table[df - 1] if df <= len(table) else Z_QUANTILES[confidence]
+
+
+def summarize(values: List[float], confidence: float) -> Dict[str, Any]:
+    """Mean, standard deviation and confidence interval of the mean."""
+    n = len(values)
+    mean = statistics.fmean(values) if n else 0.0
+    stdev = statistics.stdev(values) if n > 1 else 0.0
+    half = t_quantile(confidence, n - 1) * stdev / math.sqrt(n) if n > 1 else 0.0
+    return {
+        "n": n,
+        "mean": round(mean, 3),
+        "stdev": round(stdev, 3),
+        "ci_low": round(mean - half, 3),
+        "ci_high": round(mean + half, 3),
+    }
+
+
+def build_summary(runs: List[Dict[str, Any]], modes: List[str],
+                  confidence: float) -> Dict[str, Dict[str, Any]]:
+    summary: Dict[str, Dict[str, Any]] = {}
+    for mode in modes:
+        # a controller that fell back to another mode did not measure this one
+        ok = [r for r in runs if r["mode"] == mode and "p50_us" in r and
+              r.get("effective_mode", mode) == mode]
+        summary[mode] = {m: summarize([r[m] for r in ok], confidence) for m in METRICS}
+
+    baseline = "off" if "off" in modes else modes[0]
+    for mode in modes:
+        for m in METRICS:
+            base = summary[baseline][m]["mean"]
+            cur = summary[mode][m]
+            cur["vs_baseline_pct"] = round((cur["mean"] - base) * 100.0 / base, 1) \
+                if base else None
+    return summary
+
+
+# ----------------------------
+# Processes
+# ----------------------------
+
+def set_boost(level: int):
+    try:
+        (SYSFS_BASE / "boost_level").write_text(f"{level}\n")
+    except OSError:
+        pass
+
+
+def start_noise(seconds: float) -> Optional[subprocess.Popen]:
+    # own session: noisy_neighbors.sh stops itself with kill 0
+    return subprocess.Popen(["bash", str(NOISE_SCRIPT), str(int(math.ceil(seconds)))],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                            start_new_session=True)
+
+
+def start_controller(kind: str, mode: str, pid: int, log_path: Path) -> subprocess.Popen:
+    env = dict(os.environ, ADAPTIVE_MODE=mode, ADAPTIVE_TARGET_PID=str(pid),
+               ADAPTIVE_LOG_FILE="")
+    cmd = [str(CONTROLLER_CTL)] if kind == "ctl" else [sys.executable, str(CONTROLLER_PY)]
+    with log_path.open("w") as log:
+        return subprocess.Popen(cmd, env=env, stdout=log, stderr=subprocess.STDOUT,
+                                start_new_session=True)
+
+
+def have_model(kind: str) -> bool:
+    """Whether the controller can run ml / hybrid (adaptive_ctl: model.bin only)."""
+    return MODEL_BIN_PATH.exists() or (kind == "py" and MODEL_PKL_PATH.exists())
+
+
+def effective_mode(mode: str, log_path: Path) -> str:
+    """The mode the controller actually ran, from its fallback warning."""
+    try:
+        for line in log_path.read_text(errors="replace").splitlines():
+            if FALLBACK_MARK in line:
+                return line.split(FALLBACK_MARK, 1)[1].split()[0].lower()
+    except OSError:
+        pass
+    return mode
+
+
+def stop_process(proc: Optional[subprocess.Popen], sig: int = signal.SIGINT):
+    if proc is None or proc.poll() is not None:
+        return
+    try:
+        os.killpg(proc.pid, sig)
+        proc.wait(timeout=5)
+    except (ProcessLookupError, subprocess.TimeoutExpired):
+        try:
+            os.killpg(proc.pid, signal.SIGKILL)
+        except ProcessLookupError:
+            pass
+        proc.wait()
+
+
+def run_once(args, mode: str, run: int, log_dir: Path) -> Dict[str, Any]:
+    probe_cmd = [str(PROBE_BIN), "-m", args.probe, "-t", str(args.threads),
+                 "-i", str(args.interval_us), "-c", str(args.work_us),
+                 "-d", str(args.duration), "-W", str(args.warmup)]
+    noise = controller = None
+    result: Dict[str, Any] = {"mode": mode, "run": run}
+    log_path = log_dir / f"controller-{mode}-{run}.log"
+
+    set_boost(0)
+    try:
+        if not args.no_noise:
+            noise = start_noise(args.settle + args.warmup + args.duration + 10)
+            time.sleep(args.settle)
+
+        probe = subprocess.Popen(probe_cmd, stdout=subprocess.PIPE, text=True)
+        if mode != "off":
+            controller = start_controller(args.controller, mode, probe.pid, log_path)
+        out, _ = probe.communicate()
+    finally:
+        stop_process(controller)
+        stop_process(noise, signal.SIGTERM)
+        set_boost(0)
+
+    if controller is not None:
+        result["effective_mode"] = effective_mode(mode, log_path)
+        if result["effective_mode"] != mode:
+            print(f"[WARN] controller ran mode={result['effective_mode']} instead of "
+                  f"{mode} in run={run}, left out of the summary (see {log_path})")
+
+    if probe.returncode != 0 or not out.strip():
+        print(f"[WARN] probe failed in mode={mode} run={run} (exit {probe.returncode})")
+        return result
+
+    result.update(json.loads(out.strip().splitlines()[-1]))
+    return result
+
+
+# ----------------------------
+# Output
+# ----------------------------
+
+def host_info() -> Dict[str, Any]:
+    cpu_model = platform.processor()
+    try:
+        for line in Path("/proc/cpuinfo").read_text().splitlines():
+            if line.startswith("model name"):
+                cpu_model = line.split(":", 1)[1].strip()
+                break
+    except OSError:
+        pass
+    return {"kernel": platform.release(), "cpu_model": cpu_model,
+            "cpus": os.cpu_count()}
+
+
+def write_results(prefix: Path, args, modes: List[str], runs: List[Dict[str, Any]],
+                  summary: Dict[str, Dict[str, Any]]):
+    config = {k: v for k, v in vars(args).items() if k != "output"}
+    config["modes"] = modes
+    with prefix.with_suffix(".json").open("w") as f:
+        json.dump({"config": config, "host": host_info(), "runs": runs,
+                   "summary": summary}, f, indent=2)
+
+    with prefix.with_suffix(".csv").open("w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["mode", "metric", "n", "mean_us", "stdev_us",
+                         "ci_low_us", "ci_high_us", "vs_baseline_pct"])
+        for mode in modes:
+            for m in METRICS:
+                s = summary[mode][m]
+                writer.writerow([mode, m[:-3], s["n"], s["mean"], s["stdev"],
+                                 s["ci_low"], s["ci_high"], s["vs_baseline_pct"]])
+
+
+def main():
+    args = parse_args()
+    modes = [m.strip().lower() for m in args.modes.split(",") if m.strip()]
+    unknown = [m for m in modes if m not in MODES]
+    if not modes or unknown:
+        print(f"[ERROR] Unknown mode(s): {', '.join(unknown) or '(none)'}")
+        sys.exit(1)
+    if any(m != "off" for m in modes) and not SYSFS_BASE.exists():
+        print(f"[ERROR] {SYSFS_BASE} not found: load adaptive_sched.ko or use --modes off")
+        sys.exit(1)
+
+    missing = [m for m in modes if m in MODEL_MODES and not have_model(args.controller)]
+    if missing:
+        print(f"[WARN] {MODEL_BIN_PATH} not found, skipping mode(s) "
+              f"{', '.join(missing)} (logs/export_model.py)")
+        modes = [m for m in modes if m not in missing]
+        if not modes:
+            print("[ERROR] No mode left to run")
+            sys.exit(1)
+
+    if not PROBE_BIN.exists():
+        subprocess.run(["make", "-C", str(SCRIPT_DIR), "latency_probe"], check=True)
+    if args.controller == "ctl" and not CONTROLLER_CTL.exists():
+        subprocess.run(["make", "-C", str(CONTROLLER_CTL.parent)], check=True)
+
+    prefix = Path(args.output) if args.output else \
+        SCRIPT_DIR / "results" / time.strftime("latency-%Y%m%d-%H%M%S")
+    prefix.parent.mkdir(parents=True, exist_ok=True)
+    log_dir = prefix.parent
+
+    print(f"[INFO] Modes: {', '.join(modes)}, {args.repeats} repeats of "
+          f"{args.duration:g}s ({args.probe} probe, {args.threads} threads)")
+
+    runs: List[Dict[str, Any]] = []
+    for run in range(args.repeats):
+        # rotate the order so no mode always runs first or last
+        order = modes[run % len(modes):] + modes[:run % len(modes)]
+        for mode in order:
+            result = run_once(args, mode, run, log_dir)
+            runs.append(result)
+            if "p50_us" in result:
+                print(f"[INFO] run {run + 1}/{args.repeats} mode={mode}: "
+                      f"p50={result['p50_us']:.1f}us p99={result['p99_us']:.1f}us "
+                      f"p99.9={result['p999_us']:.1f}us")
+            time.sleep(args.cooldown)
+
+    summary = build_summary(runs, modes, args.confidence)
+    write_results(prefix, args, modes, runs, summary)
+
+    pct = int(args.confidence * 100)
+    print()
+    print(f"{'mode':<8} {'metric':<6} {'mean_us':>10}  {pct}% CI")
+    for mode in modes:
+        for m in ("p50_us", "p99_us", "p999_us"):
+            s = summary[mode][m]
+            vs = f"  ({s['vs_baseline_pct']:+.1f}%)" if s["vs_baseline_pct"] else ""
+            print(f"{mode:<8} {m[:-3]:<6} {s['mean']:>10.1f}  "
+                  f"[{s['ci_low']:.1f}, {s['ci_high']:.1f}]{vs}")
+    print(f"[INFO] Results: {prefix.with_suffix('.json')}, {prefix.with_suffix('.csv')}")
+
+
+if __name__ == "__main__":
+    main()
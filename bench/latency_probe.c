@@ -0,0 +1,365 @@
+/*
+ * latency_probe.c - wakeup latency probe for the adaptive_sched benchmarks
+ *
+ * Measures how long a task that becomes runnable waits before it runs,
+ * which is what boosting is supposed to shorten under noisy neighbours:
+ *
+ *   wakeup  (default, schbench-like) the main thread wakes every worker
+ *           through its eventfd once per interval; latency is the time
+ *           from the write() to the worker running after read()
+ *   timer   (cyclictest-like) every worker sleeps until an absolute
+ *           deadline with clock_nanosleep(); latency is how late it runs
+ *
+ * After each wakeup a worker burns -c microseconds of CPU, like serving a
+ * request, so the probe shows up as a (light) CPU user. All workers are
+ * threads of this process, so target_scope=group boosts all of them.
+ *
+ * Samples taken during the first -W seconds are discarded. At the end one
+ * JSON object with the percentiles (microseconds) is printed on stdout;
+ * bench/latency_bench.py aggregates those over runs and modes.
+ *
+ *   latency_probe [-m wakeup|timer] [-t threads] [-i interval_us]
+ *                 [-d seconds] [-W warmup_seconds] [-c work_us]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS     64
+#define NSEC_PER_SEC    1000000000ULL
+#define NSEC_PER_USEC   1000ULL
+
+enum probe_mode {
+    PROBE_WAKEUP = 0,
+    PROBE_TIMER,
+};
+
+static const char * const probe_names[] = {
+    [PROBE_WAKEUP] = "wakeup",
+    [PROBE_TIMER]  = "timer",
+};
+
+static struct {
+    int mode;
+    int threads;
+    uint64_t interval_ns;
+    double duration;
+    double warmup;
+    uint64_t work_ns;
+} cfg = {
+    .mode = PROBE_WAKEUP,
+    .threads = 2,
+    .interval_ns = 1000 * NSEC_PER_USEC,
+    .duration = 30.0,
+    .warmup = 2.0,
+    .work_ns = 100 * NSEC_PER_USEC,
+};
+
+struct worker {
+    pthread_t thread;
+    int efd;                        // wakeup mode: kicked by the main thread
+    _Atomic uint64_t wake_ns;       // wakeup mode: time of the last kick
+    uint32_t *samples;              // latencies in ns, saturated at 4 s
+    size_t nr_samples;
+    size_t capacity;
+    uint64_t overruns;              // wakeups missed while still busy
+};
+
+static struct worker workers[MAX_THREADS];
+
+static atomic_bool recording;
+static atomic_bool done;
+static volatile sig_atomic_t stop;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void ns_to_timespec(uint64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static void burn(uint64_t ns)
+{
+    uint64_t end = now_ns() + ns;
+
+    while (now_ns() < end)
+        ;
+}
+
+static void record(struct worker *w, uint64_t lat)
+{
+    if (!atomic_load_explicit(&recording, memory_order_relaxed))
+        return;
+    if (w->nr_samples == w->capacity)
+        return;
+    w->samples[w->nr_samples++] = lat > UINT32_MAX ? UINT32_MAX : (uint32_t)lat;
+}
+
+/*
+ * ----------------------
+ * Workers
+ * ----------------------
+ */
+
+static void *wakeup_worker(void *arg)
+{
+    struct worker *w = arg;
+    uint64_t kicks, woke;
+
+    while (!atomic_load(&done)) {
+        if (read(w->efd, &kicks, sizeof(kicks)) != sizeof(kicks)) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        woke = now_ns();
+        if (atomic_load(&done))
+            break;
+
+        record(w, woke - atomic_load(&w->wake_ns));
+        if (kicks > 1)
+            w->overruns += kicks - 1;
+        burn(cfg.work_ns);
+    }
+
+    return NULL;
+}
+
+static void *timer_worker(void *arg)
+{
+    struct worker *w = arg;
+    struct timespec ts;
+    uint64_t next = now_ns() + cfg.interval_ns, woke;
+
+    while (!atomic_load(&done)) {
+        ns_to_timespec(next, &ts);
+        if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            continue;
+        woke = now_ns();
+
+        record(w, woke - next);
+        burn(cfg.work_ns);
+
+        next += cfg.interval_ns;
+        while (next < now_ns()) {
+            next += cfg.interval_ns;
+            w->overruns++;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * ----------------------
+ * Results
+ * ----------------------
+ */
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of sorted samples, in microseconds
+static double percentile(const uint32_t *v, size_t n, double p)
+{
+    size_t rank;
+
+    if (!n)
+        return 0.0;
+    rank = (size_t)(p / 100.0 * n + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > n)
+        rank = n;
+    return v[rank - 1] / (double)NSEC_PER_USEC;
+}
+
+static int report(void)
+{
+    uint32_t *all;
+    uint64_t overruns = 0;
+    double sum = 0;
+    size_t n = 0, i;
+    int t;
+
+    for (t = 0; t < cfg.threads; t++)
+        n += workers[t].nr_samples;
+
+    all = malloc((n ? n : 1) * sizeof(*all));
+    if (!all) {
+        perror("malloc");
+        return 1;
+    }
+
+    n = 0;
+    for (t = 0; t < cfg.threads; t++) {
+        memcpy(all + n, workers[t].samples,
+               workers[t].nr_samples * sizeof(*all));
+        n += workers[t].nr_samples;
+        overruns += workers[t].overruns;
+    }
+    for (i = 0; i < n; i++)
+        sum += all[i];
+    qsort(all, n, sizeof(*all), cmp_u32);
+
+    printf("{\"probe\": \"%s\", \"pid\": %d, \"threads\": %d, "
+           "\"interval_us\": %llu, \"work_us\": %llu, \"samples\": %zu, "
+           "\"overruns\": %llu, \"mean_us\": %.3f, \"min_us\": %.3f, "
+           "\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, "
+           "\"p999_us\": %.3f, \"max_us\": %.3f}\n",
+           probe_names[cfg.mode], getpid(), cfg.threads,
+           (unsigned long long)(cfg.interval_ns / NSEC_PER_USEC),
+           (unsigned long long)(cfg.work_ns / NSEC_PER_USEC), n,
+           (unsigned long long)overruns,
+           n ? sum / n / NSEC_PER_USEC : 0.0,
+           percentile(all, n, 0.0), percentile(all, n, 50.0),
+           percentile(all, n, 90.0), percentile(all, n, 99.0),
+           percentile(all, n, 99.9), percentile(all, n, 100.0));
+
+    free(all);
+    return n ? 0 : 1;
+}
+
+/*
+ * ----------------------
+ * Main
+ * ----------------------
+ */
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-m wakeup|timer] [-t threads] [-i interval_us]\n"
+            "          [-d seconds] [-W warmup_seconds] [-c work_us]\n", prog);
+    exit(2);
+}
+
+static void parse_args(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:t:i:d:W:c:h")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (!strcmp(optarg, "wakeup"))
+                cfg.mode = PROBE_WAKEUP;
+            else if (!strcmp(optarg, "timer"))
+                cfg.mode = PROBE_TIMER;
+            else
+                usage(argv[0]);
+            break;
+        case 't':
+            cfg.threads = atoi(optarg);
+            break;
+        case 'i':
+            cfg.interval_ns = strtoull(optarg, NULL, 10) * NSEC_PER_USEC;
+            break;
+        case 'd':
+            cfg.duration = atof(optarg);
+            break;
+        case 'W':
+            cfg.warmup = atof(optarg);
+            break;
+        case 'c':
+            cfg.work_ns = strtoull(optarg, NULL, 10) * NSEC_PER_USEC;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (cfg.threads < 1 || cfg.threads > MAX_THREADS || !cfg.interval_ns ||
+        cfg.duration <= 0 || cfg.warmup < 0 || cfg.work_ns >= cfg.interval_ns)
+        usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction sa = { .sa_handler = on_signal };
+    uint64_t start, record_at, end, next;
+    struct timespec ts;
+    uint64_t one = 1;
+    int t;
+
+    parse_args(argc, argv);
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (t = 0; t < cfg.threads; t++) {
+        struct worker *w = &workers[t];
+
+        w->capacity = (size_t)(cfg.duration * NSEC_PER_SEC / cfg.interval_ns) + 16;
+        w->samples = malloc(w->capacity * sizeof(*w->samples));
+        w->efd = eventfd(0, 0);
+        if (!w->samples || w->efd < 0) {
+            perror("latency_probe");
+            return 1;
+        }
+        if (pthread_create(&w->thread, NULL, cfg.mode == PROBE_TIMER ?
+                           timer_worker : wakeup_worker, w)) {
+            fprintf(stderr, "latency_probe: cannot create thread %d\n", t);
+            return 1;
+        }
+    }
+
+    start = now_ns();
+    record_at = start + (uint64_t)(cfg.warmup * NSEC_PER_SEC);
+    end = record_at + (uint64_t)(cfg.duration * NSEC_PER_SEC);
+
+    // The main thread is the waker in wakeup mode, the clock otherwise
+    next = start + cfg.interval_ns;
+    while (!stop && next < end) {
+        ns_to_timespec(next, &ts);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        if (next >= record_at)
+            atomic_store(&recording, true);
+
+        if (cfg.mode == PROBE_WAKEUP) {
+            for (t = 0; t < cfg.threads; t++) {
+                atomic_store(&workers[t].wake_ns, now_ns());
+                if (write(workers[t].efd, &one, sizeof(one)) < 0)
+                    stop = 1;
+            }
+        }
+        next += cfg.mode == PROBE_WAKEUP ? cfg.interval_ns : NSEC_PER_SEC / 10;
+    }
+
+    atomic_store(&recording, false);
+    atomic_store(&done, true);
+    for (t = 0; t < cfg.threads; t++) {
+        if (write(workers[t].efd, &one, sizeof(one)) < 0)
+            pthread_cancel(workers[t].thread);
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    return report();
+}
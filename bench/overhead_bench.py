@@ -0,0 +1,413 @@
+#!/usr/bin/env python3
+"""
+overhead_bench.py — what the adaptive machinery itself costs.
+
+Sections (--sections, all by default):
+  sysfs      pread() latency of every attribute through a persistent fd,
+             as the controllers read them, and write latency of the ones
+             that take their own value back (boost_level, sample_period_ms)
+  boost      apply_boost_to_target(): boost_level toggled on a pinned
+             sleeping child, timed from userspace and by the module
+  load_work  load_work_func() and its parts from the module's overhead
+             attribute at a 10 ms sample period, for every CPU count in
+             --cpus (other CPUs are taken offline meanwhile, then restored)
+  policy     decide_boost_level() and the exported trees' predict()
+             (model.bin, logs/export_model.py), no module needed
+  loop       one adaptive_controller.main_loop() pass per ADAPTIVE_MODE,
+             prediction included, with the load-event waits taken out
+
+Every metric has one headline value in microseconds ("us"). --save keeps
+them as JSON; --baseline compares against such a file and exits with 1
+when a metric got slower by more than --threshold percent (and by more
+than --min-delta-us), so a regression in the hot path shows up:
+  sudo ./overhead_bench.py --save before.json
+  ... rebuild / reload ...
+  sudo ./overhead_bench.py --baseline before.json
+"""
+
+import argparse
+import json
+import os
+import platform
+import statistics
+import subprocess
+import sys
+import time
+from pathlib import Path
+from typing import Any, Callable, Dict, List, Optional
+
+SCRIPT_DIR = Path(__file__).resolve().parent
+DAEMON_DIR = SCRIPT_DIR.parent / "userspace_daemon"
+sys.path.insert(0, str(DAEMON_DIR))
+from boost_policy import decide_boost_level  # noqa: E402
+from model_tables import load_model_tables  # noqa: E402
+
+SYSFS_BASE = Path("/sys/kernel/adaptive_sched")
+CPU_SYSFS = Path("/sys/devices/system/cpu")
+MODEL_BIN_PATH = Path(os.environ.get("ADAPTIVE_MODEL_BIN", DAEMON_DIR / "model.bin"))
+
+SECTIONS = ("sysfs", "boost", "load_work", "policy", "loop")
+MODES = ("base", "ml", "hybrid")
+
+# attributes whose show output is a valid store input
+WRITE_BACK_ATTRS = ("boost_level", "sample_period_ms")
+# write-only or with read side effects
+SKIP_READ_ATTRS = ("policy_model",)
+
+LOAD_WORK_PERIOD_MS = 10
+
+# representative inputs for the policy section
+SAMPLE_FEATURES = {
+    "avg_load": 65, "max_load": 92, "proc_cpu": 45.0, "mem_used_pct": 72.5,
+    "procs_running": 7, "procs_blocked": 1, "loadavg1": 5.2, "loadavg5": 4.8,
+    "loadavg15": 4.1, "psi_cpu_some": 12.3, "psi_cpu_full": 0.0,
+    "proc_vms_kb": 1200000, "proc_rss_kb": 350000, "proc_threads": 24,
+    "proc_read_bytes": 10 << 20, "proc_write_bytes": 2 << 20, "proc_wait_pct": 15,
+}
+
+# one timed main_loop run in a child, so ADAPTIVE_MODE is read afresh;
+# argv: iterations, batches. Prints the per-pass time of every batch in us.
+LOOP_CHILD = """
+import json, os, sys, time
+devnull = open(os.devnull, "w")
+real_stdout, sys.stdout = sys.stdout, devnull
+import adaptive_controller as c
+n, batches = int(sys.argv[1]), int(sys.argv[2])
+c.main_loop(interval=0.0, iterations=n)  # warm up
+times = []
+for _ in range(batches):
+    t0 = time.perf_counter()
+    c.main_loop(interval=0.0, iterations=0)
+    t1 = time.perf_counter()
+    c.main_loop(interval=0.0, iterations=n)
+    t2 = time.perf_counter()
+    times.append(((t2 - t1) - (t1 - t0)) * 1e6 / n)
+real_stdout.write(json.dumps(times) + "\\n")
+"""
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Adaptive scheduler overhead microbenchmarks")
+    parser.add_argument("--sections", type=str, default=",".join(SECTIONS),
+                        help="comma separated, from: " + ", ".join(SECTIONS))
+    parser.add_argument("--iterations", type=int, default=2000,
+                        help="timed calls per sysfs / policy metric")
+    parser.add_argument("--boost-toggles", type=int, default=500)
+    parser.add_argument("--load-seconds", type=float, default=5.0,
+                        help="seconds of load_work sampling per CPU count")
+    parser.add_argument("--cpus", type=str, default="",
+                        help="comma separated online CPU counts for load_work, "
+                             "default only the current one")
+    parser.add_argument("--loop-iterations", type=int, default=200)
+    parser.add_argument("--loop-batches", type=int, default=5)
+    parser.add_argument("--save", type=str, default=None,
+                        help="write the results to this JSON file")
+    parser.add_argument("--baseline", type=str, default=None,
+                        help="JSON file of an earlier run to compare with")
+    parser.add_argument("--threshold", type=float, default=20.0,
+                        help="percent slower than the baseline that counts as a regression")
+    parser.add_argument("--min-delta-us", type=float, default=0.5,
+                        help="ignore differences smaller than this")
+    return parser.parse_args()
+
+
+# ----------------------------
+# Helpers
+# ----------------------------
+
+def percentile(sorted_values: List[float], p: float) -> float:
+    if not sorted_values:
+        return 0.0
+    rank = min(len(sorted_values), max(1, round(p / 100.0 * len(sorted_values))))
+    return sorted_values[rank - 1]
+
+
+def time_calls(fn: Callable[[], Any], n: int) -> Dict[str, float]:
+    """Time n calls of fn individually: median (headline) and p99 in us."""
+    samples = []
+    clock = time.perf_counter_ns
+    for _ in range(n):
+        t0 = clock()
+        fn()
+        samples.append((clock() - t0) / 1000.0)
+    samples.sort()
+    return {"us": round(statistics.median(samples), 3),
+            "p99_us": round(percentile(samples, 99.0), 3)}
+
+
+def read_text(path: Path) -> Optional[str]:
+    try:
+        return path.read_text().strip()
+    except OSError:
+        return None
+
+
+def write_text(path: Path, value: str) -> bool:
+    try:
+        path.write_text(f"{value}\n")
+        return True
+    except OSError as e:
+        print(f"[WARN] Cannot write {value!r} to {path}: {e}")
+        return False
+
+
+def read_overhead() -> Dict[str, Dict[str, int]]:
+    """The module's overhead attribute: name -> count, avg_ns, max_ns, last_ns."""
+    stats: Dict[str, Dict[str, int]] = {}
+    for line in (read_text(SYSFS_BASE / "overhead") or "").splitlines():
+        parts = line.split()
+        if len(parts) == 5:
+            stats[parts[0]] = dict(zip(("count", "avg_ns", "max_ns", "last_ns"),
+                                       map(int, parts[1:])))
+        elif len(parts) == 2:
+            stats[parts[0]] = {"value": int(parts[1])}
+    return stats
+
+
+def kernel_metric(stat: Dict[str, int]) -> Dict[str, float]:
+    return {"us": round(stat["avg_ns"] / 1000.0, 3),
+            "max_us": round(stat["max_ns"] / 1000.0, 3), "count": stat["count"]}
+
+
+def spawn_sleeper() -> subprocess.Popen:
+    return subprocess.Popen(["sleep", "3600"])
+
+
+# ----------------------------
+# Sections
+# ----------------------------
+
+def bench_sysfs(args, results: Dict[str, Dict[str, float]]):
+    for path in sorted(SYSFS_BASE.iterdir()):
+        if path.name in SKIP_READ_ATTRS or not path.is_file():
+            continue
+        try:
+            fd = os.open(path, os.O_RDONLY)
+        except OSError:
+            continue
+        try:
+            os.pread(fd, 1 << 16, 0)
+            results[f"sysfs/read/{path.name}"] = \
+                time_calls(lambda: os.pread(fd, 1 << 16, 0), args.iterations)
+        except OSError:
+            pass
+        finally:
+            os.close(fd)
+
+    for name in WRITE_BACK_ATTRS:
+        path = SYSFS_BASE / name
+        value = read_text(path)
+        if value is None:
+            continue
+        data = f"{value}\n".encode()
+        fd = os.open(path, os.O_WRONLY)
+        try:
+            results[f"sysfs/write/{name}"] = \
+                time_calls(lambda: os.pwrite(fd, data, 0), args.iterations // 4 or 1)
+        finally:
+            os.close(fd)
+
+
+def bench_boost(args, results: Dict[str, Dict[str, float]]):
+    old_pid = read_text(SYSFS_BASE / "target_pid") or "0"
+    old_boost = read_text(SYSFS_BASE / "boost_level") or "0"
+    sleeper = spawn_sleeper()
+    fd = None
+    try:
+        if not write_text(SYSFS_BASE / "target_pid", str(sleeper.pid)):
+            return
+        write_text(SYSFS_BASE / "overhead", "reset")
+        levels = [b"1\n", b"0\n"]
+        state = {"i": 0}
+        fd = os.open(SYSFS_BASE / "boost_level", os.O_WRONLY)
+
+        def toggle():
+            os.pwrite(fd, levels[state["i"] & 1], 0)
+            state["i"] += 1
+
+        results["boost/write_boost_level"] = time_calls(toggle, args.boost_toggles)
+        stat = read_overhead().get("boost")
+        if stat and stat["count"]:
+            results["boost/apply_boost_to_target"] = kernel_metric(stat)
+    finally:
+        if fd is not None:
+            os.close(fd)
+        write_text(SYSFS_BASE / "boost_level", "0")
+        write_text(SYSFS_BASE / "target_pid", old_pid)
+        write_text(SYSFS_BASE / "boost_level", old_boost)
+        sleeper.kill()
+        sleeper.wait()
+
+
+def online_cpus() -> List[int]:
+    cpus = []
+    for part in (read_text(CPU_SYSFS / "online") or "0").split(","):
+        lo, _, hi = part.partition("-")
+        cpus.extend(range(int(lo), int(hi or lo) + 1))
+    return cpus
+
+
+def set_online(cpu: int, online: bool) -> bool:
+    path = CPU_SYSFS / f"cpu{cpu}" / "online"
+    return path.exists() and write_text(path, "1" if online else "0")
+
+
+def bench_load_work(args, results: Dict[str, Dict[str, float]]):
+    initial = online_cpus()
+    counts = [int(c) for c in args.cpus.split(",") if c.strip()] or [len(initial)]
+    old_period = read_text(SYSFS_BASE / "sample_period_ms")
+    old_adaptive = read_text(SYSFS_BASE / "sample_adaptive")
+    offlined: List[int] = []
+    try:
+        if old_adaptive:
+            _, lo, hi = old_adaptive.split()
+            write_text(SYSFS_BASE / "sample_adaptive", f"0 {lo} {hi}")
+        write_text(SYSFS_BASE / "sample_period_ms", str(LOAD_WORK_PERIOD_MS))
+
+        for count in sorted(counts):
+            # keep the first `count` CPUs, hotplug the rest
+            for cpu in initial[count:]:
+                if cpu not in offlined and set_online(cpu, False):
+                    offlined.append(cpu)
+            for cpu in [c for c in offlined if c in initial[:count]]:
+                if set_online(cpu, True):
+                    offlined.remove(cpu)
+
+            write_text(SYSFS_BASE / "overhead", "reset")
+            time.sleep(args.load_seconds)
+            stats = read_overhead()
+            cpus = stats.get("cpus", {}).get("value", count)
+            if cpus != count:
+                print(f"[WARN] Wanted {count} online CPUs, have {cpus}")
+            for name in ("load_work", "sample", "top_scan", "policy"):
+                stat = stats.get(name)
+                if stat and stat["count"]:
+                    results[f"load_work/{name}/cpus={cpus}"] = kernel_metric(stat)
+    finally:
+        for cpu in offlined:
+            set_online(cpu, True)
+        if old_period:
+            write_text(SYSFS_BASE / "sample_period_ms", old_period)
+        if old_adaptive:
+            write_text(SYSFS_BASE / "sample_adaptive", old_adaptive)
+
+
+def bench_policy(args, results: Dict[str, Dict[str, float]]):
+    f = SAMPLE_FEATURES
+    results["policy/decide_boost_level"] = time_calls(
+        lambda: decide_boost_level(f["avg_load"], f["max_load"], f["proc_cpu"], f),
+        args.iterations)
+
+    tables = load_model_tables(MODEL_BIN_PATH)
+    if tables is None:
+        print(f"[WARN] {MODEL_BIN_PATH} not found, skipping predict (logs/export_model.py)")
+        return
+    results["policy/predict_boost_ml"] = time_calls(lambda: tables.predict(f),
+                                                    args.iterations)
+
+
+def bench_loop(args, results: Dict[str, Dict[str, float]]):
+    old_pid = read_text(SYSFS_BASE / "target_pid") or "0"
+    old_boost = read_text(SYSFS_BASE / "boost_level") or "0"
+    sleeper = spawn_sleeper()
+    try:
+        for mode in MODES:
+            if mode != "base" and not MODEL_BIN_PATH.exists():
+                print(f"[WARN] {MODEL_BIN_PATH} not found, skipping loop mode={mode}")
+                continue
+            env = dict(os.environ, ADAPTIVE_MODE=mode, ADAPTIVE_POLICY_MODE="user",
+                       ADAPTIVE_TARGET_PID=str(sleeper.pid), ADAPTIVE_IDLE_TIMEOUT="0")
+            proc = subprocess.run(
+                [sys.executable, "-c", LOOP_CHILD, str(args.loop_iterations),
+                 str(args.loop_batches)],
+                cwd=DAEMON_DIR, env=env, capture_output=True, text=True)
+            if proc.returncode != 0 or not proc.stdout.strip():
+                print(f"[WARN] loop mode={mode} failed: {proc.stderr.strip()[-200:]}")
+                continue
+            times = sorted(json.loads(proc.stdout.strip().splitlines()[-1]))
+            results[f"loop/main_loop/{mode}"] = {"us": round(statistics.median(times), 3),
+                                                 "max_us": round(times[-1], 3)}
+    finally:
+        write_text(SYSFS_BASE / "boost_level", "0")
+        write_text(SYSFS_BASE / "target_pid", old_pid)
+        write_text(SYSFS_BASE / "boost_level", old_boost)
+        sleeper.kill()
+        sleeper.wait()
+
+
+BENCHES = {
+    "sysfs": bench_sysfs,
+    "boost": bench_boost,
+    "load_work": bench_load_work,
+    "policy": bench_policy,
+    "loop": bench_loop,
+}
+NEEDS_MODULE = ("sysfs", "boost", "load_work", "loop")
+
+
+# ----------------------------
+# Baseline comparison
+# ----------------------------
+
+def compare(results: Dict[str, Dict[str, float]], baseline_path: Path,
+            threshold: float, min_delta: float) -> int:
+    baseline = json.loads(baseline_path.read_text())["results"]
+    regressions = 0
+
+    print()
+    print(f"{'metric':<48} {'before':>10} {'after':>10} {'change':>8}")
+    for name in sorted(set(results) & set(baseline)):
+        before, after = baseline[name]["us"], results[name]["us"]
+        change = (after - before) * 100.0 / before if before else 0.0
+        slower = change > threshold and after - before > min_delta
+        regressions += slower
+        print(f"{name:<48} {before:>10.3f} {after:>10.3f} {change:>+7.1f}%"
+              f"{'  REGRESSION' if slower else ''}")
+    for name in sorted(set(baseline) - set(results)):
+        print(f"{name:<48} {baseline[name]['us']:>10.3f} {'-':>10}")
+
+    print(f"[INFO] {regressions} regression(s) over {threshold:g}% "
+          f"against {baseline_path}")
+    return regressions
+
+
+def main():
+    args = parse_args()
+    sections = [s.strip() for s in args.sections.split(",") if s.strip()]
+    unknown = [s for s in sections if s not in SECTIONS]
+    if unknown:
+        print(f"[ERROR] Unknown section(s): {', '.join(unknown)}")
+        sys.exit(1)
+
+    have_module = SYSFS_BASE.exists()
+    results: Dict[str, Dict[str, float]] = {}
+    for section in sections:
+        if section in NEEDS_MODULE and not have_module:
+            print(f"[WARN] {SYSFS_BASE} not found, skipping {section}")
+            continue
+        if section == "load_work" and not (SYSFS_BASE / "overhead").exists():
+            print("[WARN] module without overhead statistics, skipping load_work")
+            continue
+        print(f"[INFO] Running {section} ...")
+        BENCHES[section](args, results)
+
+    print()
+    print(f"{'metric':<48} {'us':>10}  extra")
+    for name, m in results.items():
+        extra = ", ".join(f"{k}={v}" for k, v in m.items() if k != "us")
+        print(f"{name:<48} {m['us']:>10.3f}  {extra}")
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump({"host": {"kernel": platform.release(), "cpus": os.cpu_count(),
+                                "python": platform.python_version()},
+                       "timestamp": time.time(), "results": results}, f, indent=2)
+        print(f"[INFO] Results saved to {args.save}")
+
+    if args.baseline and compare(results, Path(args.baseline), args.threshold,
+                                 args.min_delta_us):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,12 +1,17 @@
 #!/usr/bin/env python3
 import os
 import time
+import atexit
+import itertools
+import select
+import struct
 import subprocess
 from pathlib import Path
 from typing import Optional, Tuple, Dict, Any
 
-import pandas as pd
-from joblib import load
+from boost_policy import BoostTransition, combine_hybrid, decide_boost_level
+from mem_protect import MemoryGuard, release_on_exit
+from model_tables import ModelTables, load_model_tables
 
 # ----------------------------
 # Mode selection
@@ -14,6 +19,45 @@ from joblib import load
 # Possible values: "base", "ml", "hybrid"
 MODE = os.environ.get("ADAPTIVE_MODE", "hybrid").lower()
 
+# Boost scope for the target: "task" (main thread only) or "group"
+# (every thread of the target process, including new ones)
+TARGET_SCOPE = os.environ.get("ADAPTIVE_TARGET_SCOPE", "group").lower()
+
+# Pin the target to this PID (e.g. bench/latency_bench.py's probe): it is
+# never auto-switched away and the controller exits once it is gone.
+# 0 picks the target by CPU usage.
+TARGET_PID = int(os.environ.get("ADAPTIVE_TARGET_PID", "0"))
+
+# Boost mechanism: "nice", "batch", "uclamp", "fifo" or "deadline"
+# (see boost_policy in the kernel module). Empty keeps the module setting.
+BOOST_POLICY = os.environ.get("ADAPTIVE_BOOST_POLICY", "").lower()
+
+# Throttle set: instead of switching to a heavier competing process, put it
+# into the module's throttle set with this policy ("demote", "idle" or
+# "batch"). Empty disables throttling. Cgroups listed in
+# ADAPTIVE_THROTTLE_CGROUPS (comma separated, relative to the cgroup2
+# mount) are throttled as well and get THROTTLE_CPU_MAX written to their
+# cpu.max while the target is boosted; the original cpu.max is restored.
+THROTTLE_POLICY = os.environ.get("ADAPTIVE_THROTTLE_POLICY", "").lower()
+THROTTLE_CGROUPS = [p for p in os.environ.get("ADAPTIVE_THROTTLE_CGROUPS", "").split(",") if p]
+THROTTLE_CPU_MAX = os.environ.get("ADAPTIVE_THROTTLE_CPU_MAX", "50000 100000")
+THROTTLE_MAX_PIDS = 8
+
+# Who decides boost_level: "user" (this controller), "kernel" (the rule
+# table in the module, see policy_rules) or "model" (model.bin uploaded to
+# the module's policy_model). In kernel and model mode the controller only
+# picks the target and reports the level the module chose.
+POLICY_MODE = os.environ.get("ADAPTIVE_POLICY_MODE", "user").lower()
+
+# How long to block waiting for a load event while nothing is boosted.
+# The kernel module wakes us up earlier when load crosses a threshold.
+IDLE_TIMEOUT = float(os.environ.get("ADAPTIVE_IDLE_TIMEOUT", "5.0"))
+
+# Features are re-read only when current_load / max_load or the target
+# change, and at least this often (seconds) to pick up slow drifts such
+# as memory usage.
+FEATURE_MAX_AGE = float(os.environ.get("ADAPTIVE_FEATURE_MAX_AGE", "2.0"))
+
 # ----------------------------
 # Paths to kernel module sysfs interface
 # ----------------------------
@@ -23,6 +67,15 @@ PATH_CURRENT_LOAD = SYSFS_BASE / "current_load"
 PATH_MAX_LOAD = SYSFS_BASE / "max_load"
 PATH_BOOST_LEVEL = SYSFS_BASE / "boost_level"
 PATH_TARGET_PID = SYSFS_BASE / "target_pid"
+PATH_TARGET_SCOPE = SYSFS_BASE / "target_scope"
+PATH_BOOST_POLICY = SYSFS_BASE / "boost_policy"
+PATH_THROTTLE = SYSFS_BASE / "throttle"
+PATH_POLICY_MODE = SYSFS_BASE / "policy_mode"
+PATH_POLICY_MODEL = SYSFS_BASE / "policy_model"
+PATH_TOP_TASKS = SYSFS_BASE / "top_tasks"
+PATH_TOP_TABLE = SYSFS_BASE / "top_table"
+PATH_SNAPSHOT = SYSFS_BASE / "snapshot"
+PATH_CPU_HISTORY = SYSFS_BASE / "cpu_history"
 
 # ----------------------------
 # Paths to /proc and pressure information
@@ -32,6 +85,7 @@ PROC_STAT = Path("/proc/stat")
 PROC_MEMINFO = Path("/proc/meminfo")
 PROC_LOADAVG = Path("/proc/loadavg")
 PROC_PSI_CPU = Path("/proc/pressure/cpu")
+CGROUP2_ROOT = Path("/sys/fs/cgroup")
 
 # ----------------------------
 # Paths for ML model
@@ -39,6 +93,9 @@ PROC_PSI_CPU = Path("/proc/pressure/cpu")
 
 SCRIPT_DIR = Path(__file__).resolve().parent
 MODEL_PATH = SCRIPT_DIR / "logs" / "model.pkl"
+# Tree tables exported from model.pkl by logs/export_model.py; preferred,
+# they need neither pandas nor sklearn
+MODEL_BIN_PATH = Path(os.environ.get("ADAPTIVE_MODEL_BIN", SCRIPT_DIR / "model.bin"))
 
 # ----------------------------
 # Generic helpers
@@ -66,6 +123,24 @@ def write_int(path: Path, value: int) -> bool:
         return False
 
 
+def write_boost(level: int) -> bool:
+    """Write boost_level, unless the module's own policy owns it."""
+    if POLICY_MODE != "user":
+        return True
+    return write_int(PATH_BOOST_LEVEL, level)
+
+
+def write_text(path: Path, value: str) -> bool:
+    """Write a string value to a sysfs file. Returns True on success."""
+    try:
+        with path.open("w") as f:
+            f.write(value)
+        return True
+    except (FileNotFoundError, PermissionError, OSError) as e:
+        print(f"[ERROR] Failed to write '{value}' to {path}: {e}")
+        return False
+
+
 # ----------------------------
 # Kernel metrics (from our module)
 # ----------------------------
@@ -77,6 +152,57 @@ def get_kernel_metrics() -> Tuple[Optional[int], Optional[int]]:
     return avg_load, max_load
 
 
+class LoadEventWaiter:
+    """
+    Block until the kernel module signals a load change or a timeout expires.
+
+    The module calls sysfs_notify() on current_load / max_load when they
+    cross the notify_thresholds bands, which wakes up poll() with POLLPRI.
+    Falls back to plain time.sleep() if the files cannot be polled.
+    """
+
+    def __init__(self):
+        self.poller = None
+        self.fds = []
+        try:
+            poller = select.poll()
+            for path in (PATH_CURRENT_LOAD, PATH_MAX_LOAD):
+                fd = os.open(path, os.O_RDONLY)
+                self.fds.append(fd)
+                os.read(fd, 32)  # a read arms the notification
+                poller.register(fd, select.POLLPRI | select.POLLERR)
+            self.poller = poller
+        except OSError as e:
+            print(f"[WARN] Load events unavailable, using fixed interval: {e}")
+            self.close()
+
+    def wait(self, timeout: float) -> bool:
+        """Wait up to timeout seconds. Returns True if woken by an event."""
+        if self.poller is None:
+            time.sleep(timeout)
+            return False
+
+        events = self.poller.poll(timeout * 1000.0)
+        for fd in self.fds:
+            os.pread(fd, 32, 0)  # re-arm
+        return bool(events)
+
+    def loads(self) -> Tuple[Optional[int], Optional[int]]:
+        """current_load and max_load through the open fds (re-arms as well)."""
+        if self.poller is None:
+            return get_kernel_metrics()
+        try:
+            return tuple(int(os.pread(fd, 32, 0)) for fd in self.fds)
+        except (OSError, ValueError):
+            return get_kernel_metrics()
+
+    def close(self):
+        for fd in self.fds:
+            os.close(fd)
+        self.fds = []
+        self.poller = None
+
+
 # ----------------------------
 # System-level features from /proc
 # ----------------------------
@@ -181,19 +307,337 @@ def get_system_features() -> Dict[str, Any]:
     return features
 
 
+# ----------------------------
+# Binary snapshot (one read instead of parsing /proc)
+# ----------------------------
+
+# struct adaptive_snapshot from adaptive_sched_uapi.h (version 1)
+SNAPSHOT_VERSION = 1
+SNAPSHOT_STRUCT = struct.Struct("<4I2Q4i2Q2I3I2II5Q")
+SNAPSHOT_FIELDS = (
+    "version", "size", "flags", "nr_cpus",
+    "timestamp_ns", "seq",
+    "avg_load", "max_load", "boost_level", "target_pid",
+    "mem_total_kb", "mem_available_kb",
+    "procs_running", "procs_blocked",
+    "loadavg1", "loadavg5", "loadavg15",
+    "psi_cpu_some", "psi_cpu_full",
+    "proc_threads", "proc_vms_kb", "proc_rss_kb",
+    "proc_read_bytes", "proc_write_bytes", "proc_runtime_ns",
+)
+
+# Runqueue latency fields appended to version 1, present when size allows
+SNAPSHOT_DELAY_STRUCT = struct.Struct("<4IQ2I")
+SNAPSHOT_DELAY_FIELDS = (
+    "rq_running", "rq_waiting", "rq_max_depth", "wait_pct",
+    "proc_run_delay_ns", "proc_wait_pct", "reserved",
+)
+
+SNAP_HAVE_TARGET = 1 << 0
+SNAP_HAVE_IO = 1 << 1
+SNAP_HAVE_PSI = 1 << 2
+SNAP_HAVE_DELAY = 1 << 3
+
+
+class SnapshotReader:
+    """Keep the snapshot file open and read it with a single pread()."""
+
+    def __init__(self):
+        self.fd: Optional[int] = None
+        try:
+            self.fd = os.open(PATH_SNAPSHOT, os.O_RDONLY)
+        except OSError as e:
+            print(f"[WARN] Snapshot unavailable, parsing /proc instead: {e}")
+
+    def read(self) -> Optional[Dict[str, Any]]:
+        if self.fd is None:
+            return None
+        try:
+            data = os.pread(self.fd, SNAPSHOT_STRUCT.size +
+                            SNAPSHOT_DELAY_STRUCT.size, 0)
+        except OSError as e:
+            print(f"[WARN] Failed to read snapshot: {e}")
+            return None
+        if len(data) < SNAPSHOT_STRUCT.size:
+            return None
+
+        snap = dict(zip(SNAPSHOT_FIELDS, SNAPSHOT_STRUCT.unpack_from(data)))
+        if snap["version"] != SNAPSHOT_VERSION:
+            print(f"[WARN] Unknown snapshot version {snap['version']}")
+            os.close(self.fd)
+            self.fd = None
+            return None
+
+        end = SNAPSHOT_STRUCT.size + SNAPSHOT_DELAY_STRUCT.size
+        if snap["size"] >= end and len(data) >= end:
+            snap.update(zip(SNAPSHOT_DELAY_FIELDS,
+                            SNAPSHOT_DELAY_STRUCT.unpack_from(
+                                data, SNAPSHOT_STRUCT.size)))
+        else:
+            snap["flags"] &= ~SNAP_HAVE_DELAY
+        return snap
+
+
+def snapshot_system_features(snap: Dict[str, Any],
+                             wanted: Optional[frozenset] = None) -> Dict[str, Any]:
+    """
+    System-level features (same keys as get_system_features()). Sources
+    outside the snapshot are only parsed if wanted (default: all) needs them.
+    """
+    features: Dict[str, Any] = {
+        "procs_running": snap["procs_running"],
+        "procs_blocked": snap["procs_blocked"],
+        "loadavg1": snap["loadavg1"] / 100.0,
+        "loadavg5": snap["loadavg5"] / 100.0,
+        "loadavg15": snap["loadavg15"] / 100.0,
+    }
+    if snap["mem_total_kb"]:
+        features["mem_used_pct"] = (
+            1.0 - snap["mem_available_kb"] / snap["mem_total_kb"]
+        ) * 100.0
+    if "rq_waiting" in snap:
+        features["rq_waiting"] = snap["rq_waiting"]
+        features["rq_max_depth"] = snap["rq_max_depth"]
+    if snap["flags"] & SNAP_HAVE_DELAY:
+        features["wait_pct"] = snap["wait_pct"]
+    if snap["flags"] & SNAP_HAVE_PSI:
+        features["psi_cpu_some"] = snap["psi_cpu_some"] / 100.0
+        features["psi_cpu_full"] = snap["psi_cpu_full"] / 100.0
+    elif wanted is None or wanted & PSI_FEATURES:
+        features.update(parse_cpu_psi())
+    return features
+
+
+def snapshot_process_features(snap: Dict[str, Any], pid: int,
+                              wanted: Optional[frozenset] = None) -> Optional[Dict[str, Any]]:
+    """Process-level features of the primary target, None if not in snapshot."""
+    if snap["target_pid"] != pid or not snap["flags"] & SNAP_HAVE_TARGET:
+        return None
+
+    features: Dict[str, Any] = {
+        "proc_vms_kb": snap["proc_vms_kb"],
+        "proc_rss_kb": snap["proc_rss_kb"],
+        "proc_threads": snap["proc_threads"],
+    }
+    if snap["flags"] & SNAP_HAVE_IO:
+        features["proc_read_bytes"] = snap["proc_read_bytes"]
+        features["proc_write_bytes"] = snap["proc_write_bytes"]
+    elif wanted is None or wanted & IO_FEATURES:
+        features.update(parse_proc_io(pid))
+    if snap["flags"] & SNAP_HAVE_DELAY:
+        features["proc_run_delay_ns"] = snap["proc_run_delay_ns"]
+        features["proc_wait_pct"] = snap["proc_wait_pct"]
+    return features
+
+
+# ----------------------------
+# Per-CPU load history
+# ----------------------------
+
+# struct adaptive_cpu_history_header / adaptive_cpu_sample (version 1)
+CPU_HISTORY_VERSION = 1
+CPU_HISTORY_HEADER = struct.Struct("<4IQ2I")
+CPU_SAMPLE = struct.Struct("<6BH")
+CPU_SAMPLE_VALID = 1 << 0
+CPU_TREND_SAMPLES = 8  # how far back cpu_busy_trend looks
+
+
+class CpuHistoryReader:
+    """Read the per-CPU ring buffer exported by the module."""
+
+    def __init__(self):
+        self.fd: Optional[int] = None
+        try:
+            self.fd = os.open(PATH_CPU_HISTORY, os.O_RDONLY)
+        except OSError as e:
+            print(f"[WARN] Per-CPU history unavailable: {e}")
+
+    def read(self) -> Optional[Dict[str, Any]]:
+        """Return header fields plus "busy": per-CPU lists, oldest first."""
+        if self.fd is None:
+            return None
+
+        # The table spans several read() calls: retry if a sample landed
+        # in between (header seq changed)
+        for _ in range(3):
+            data = self._read_all()
+            if data is None or len(data) < CPU_HISTORY_HEADER.size:
+                return None
+            again = self._read_header()
+            if again is not None and again[:CPU_HISTORY_HEADER.size] == \
+                    data[:CPU_HISTORY_HEADER.size]:
+                break
+        version, size, nr_cpus, depth, seq, head, sample_size = \
+            CPU_HISTORY_HEADER.unpack_from(data)
+        if version != CPU_HISTORY_VERSION or sample_size != CPU_SAMPLE.size:
+            return None
+
+        busy = []
+        for cpu in range(nr_cpus):
+            samples = []
+            for i in range(depth):
+                slot = (head + i) % depth
+                off = size + (cpu * depth + slot) * sample_size
+                if off + sample_size > len(data):
+                    break
+                fields = CPU_SAMPLE.unpack_from(data, off)
+                if fields[5] & CPU_SAMPLE_VALID:
+                    samples.append(fields[0])
+            busy.append(samples)
+
+        return {"seq": seq, "depth": depth, "busy": busy}
+
+    def _read_header(self) -> Optional[bytes]:
+        try:
+            return os.pread(self.fd, CPU_HISTORY_HEADER.size, 0)
+        except OSError:
+            return None
+
+    def _read_all(self) -> Optional[bytes]:
+        chunks = []
+        offset = 0
+        try:
+            while True:
+                chunk = os.pread(self.fd, 65536, offset)
+                if not chunk:
+                    break
+                chunks.append(chunk)
+                offset += len(chunk)
+        except OSError as e:
+            print(f"[WARN] Failed to read cpu_history: {e}")
+            return None
+        return b"".join(chunks)
+
+
+def cpu_history_features(history: Dict[str, Any]) -> Dict[str, Any]:
+    """Per-core imbalance and trend derived from the history ring."""
+    latest = [samples[-1] for samples in history["busy"] if samples]
+    if not latest:
+        return {}
+
+    features: Dict[str, Any] = {
+        "cpu_busy_spread": max(latest) - min(latest),
+    }
+
+    old = [samples[-1 - CPU_TREND_SAMPLES] for samples in history["busy"]
+           if len(samples) > CPU_TREND_SAMPLES]
+    if old:
+        features["cpu_busy_trend"] = sum(latest) / len(latest) - sum(old) / len(old)
+    return features
+
+
 # ----------------------------
 # Process-level features
 # ----------------------------
 
-def pick_target_pid(min_cpu: float = 5.0) -> Optional[int]:
+TARGET_BLACKLIST_PREFIXES = (
+    "systemd", "kthreadd", "rcu_", "migration", "idle",
+    "adaptive_daemon", "adaptive_controller", "gnome-shell", "Xorg"
+)
+
+# top_tasks changes once per kernel scan (>= 1 s), so one read serves
+# every lookup of a control iteration
+TOP_TASKS_MAX_AGE = 0.1
+
+_top_tasks_cache: Tuple[float, Optional[list]] = (0.0, None)
+
+# struct adaptive_top_header / adaptive_top_task (version 1)
+TOP_TABLE_VERSION = 1
+TOP_TABLE_HEADER = struct.Struct("<4I2Q")
+TOP_TABLE_ENTRY = struct.Struct("<2i2IQ16s")
+
+_top_table_fd: Optional[int] = None
+_top_table_missing = False
+
+
+def read_top_table() -> Optional[list]:
     """
-    Pick a target PID based on CPU usage.
+    Read the module's binary top_table in one pread(): a list of dicts
+    (pid, tgid, comm, cpu, nr_threads, run_delay_ns), heaviest first.
+    None if the module does not export it.
+    """
+    global _top_table_fd, _top_table_missing
 
-    Strategy:
-    - Use 'ps' to list processes sorted by CPU usage.
-    - Ignore system processes and this daemon itself.
-    - Return the first process with CPU >= min_cpu.
+    if _top_table_missing:
+        return None
+    if _top_table_fd is None:
+        try:
+            _top_table_fd = os.open(PATH_TOP_TABLE, os.O_RDONLY)
+        except OSError:
+            _top_table_missing = True
+            return None
+
+    try:
+        data = os.pread(_top_table_fd, 4096, 0)
+    except OSError:
+        return None
+    if len(data) < TOP_TABLE_HEADER.size:
+        return None
+
+    version, size, nr, entry_size, _seq, _interval = \
+        TOP_TABLE_HEADER.unpack_from(data)
+    if version != TOP_TABLE_VERSION or entry_size < TOP_TABLE_ENTRY.size:
+        return None
+
+    entries = []
+    for i in range(nr):
+        off = size + i * entry_size
+        if off + TOP_TABLE_ENTRY.size > len(data):
+            break
+        pid, tgid, cpu_x10, nr_threads, run_delay_ns, comm = \
+            TOP_TABLE_ENTRY.unpack_from(data, off)
+        entries.append({
+            "pid": pid,
+            "tgid": tgid,
+            "comm": comm.split(b"\0", 1)[0].decode(errors="replace"),
+            "cpu": cpu_x10 / 10.0,
+            "nr_threads": nr_threads,
+            "run_delay_ns": run_delay_ns,
+        })
+
+    return entries
+
+
+def read_top_tasks() -> Optional[list]:
+    """
+    Read the module's top-N table: [(pid, comm, cpu%)], heaviest first,
+    CPU usage over the last kernel scan. Uses the binary top_table, or the
+    text top_tasks on older modules. None if the module exports neither.
     """
+    global _top_tasks_cache
+
+    now = time.monotonic()
+    stamp, tasks = _top_tasks_cache
+    if tasks is not None and now - stamp < TOP_TASKS_MAX_AGE:
+        return tasks
+
+    table = read_top_table()
+    if table is not None:
+        tasks = [(e["tgid"], e["comm"], e["cpu"]) for e in table]
+        _top_tasks_cache = (now, tasks)
+        return tasks
+
+    try:
+        text = PATH_TOP_TASKS.read_text()
+    except OSError:
+        return None
+
+    tasks = []
+    for line in text.splitlines():
+        parts = line.split(None, 2)
+        if len(parts) < 3:
+            continue
+        try:
+            tasks.append((int(parts[0]), parts[2], float(parts[1])))
+        except ValueError:
+            continue
+
+    _top_tasks_cache = (now, tasks)
+    return tasks
+
+
+def list_ps_tasks() -> Optional[list]:
+    """Fallback for read_top_tasks(): lifetime-averaged pcpu from ps."""
     try:
         result = subprocess.run(
             ["ps", "-eo", "pid,comm,pcpu", "--sort=-pcpu"],
@@ -205,35 +649,41 @@ def pick_target_pid(min_cpu: float = 5.0) -> Optional[int]:
         print(f"[WARN] ps command failed: {e}")
         return None
 
-    lines = result.stdout.strip().splitlines()
-    if not lines:
-        return None
-
-    header_skipped = False
-    for line in lines:
-        if not header_skipped:
-            header_skipped = True
-            continue
-
+    tasks = []
+    for line in result.stdout.strip().splitlines()[1:]:
         parts = line.split(None, 3)  # pid, comm, pcpu
         if len(parts) < 3:
             continue
 
         pid_str, comm, cpu_str = parts[:3]
         try:
-            pid = int(pid_str)
-            cpu = float(cpu_str.replace(",", "."))
+            tasks.append((int(pid_str), comm, float(cpu_str.replace(",", "."))))
         except ValueError:
             continue
 
+    return tasks
+
+
+def pick_target_pid(min_cpu: float = 5.0) -> Optional[int]:
+    """
+    Pick a target PID based on CPU usage.
+
+    Strategy:
+    - Use the module's top-N table (recent CPU usage), or 'ps' without it.
+    - Ignore system processes and this daemon itself.
+    - Return the first process with CPU >= min_cpu.
+    """
+    tasks = read_top_tasks()
+    if tasks is None:
+        tasks = list_ps_tasks()
+    if not tasks:
+        return None
+
+    for pid, comm, cpu in tasks:
         if cpu < min_cpu:
             continue
 
-        blacklist_prefixes = (
-            "systemd", "kthreadd", "rcu_", "migration", "idle",
-            "adaptive_daemon", "adaptive_controller", "gnome-shell", "Xorg"
-        )
-        if any(comm.startswith(p) for p in blacklist_prefixes):
+        if any(comm.startswith(p) for p in TARGET_BLACKLIST_PREFIXES):
             continue
 
         print(f"[INFO] Selected target pid={pid} (comm={comm}, cpu={cpu:.1f}%)")
@@ -242,8 +692,55 @@ def pick_target_pid(min_cpu: float = 5.0) -> Optional[int]:
     return None
 
 
+CLK_TCK = os.sysconf("SC_CLK_TCK")
+
+# pid -> (utime + stime ticks, monotonic time) of the previous call
+_proc_cpu_prev: Dict[int, Tuple[int, float]] = {}
+
+
+def read_proc_cpu_ticks(pid: int) -> Optional[int]:
+    """utime + stime of a process from /proc/<pid>/stat, in clock ticks."""
+    try:
+        text = Path(f"/proc/{pid}/stat").read_text()
+    except OSError:
+        return None
+
+    # comm may contain spaces, fields start after the last ')'
+    fields = text[text.rfind(")") + 2:].split()
+    try:
+        return int(fields[11]) + int(fields[12])
+    except (IndexError, ValueError):
+        return None
+
+
 def estimate_process_cpu(pid: int) -> Optional[float]:
-    """Get CPU usage for a specific PID using ps."""
+    """
+    Recent CPU usage of a PID. Taken from top_tasks when the process is
+    listed there, otherwise from the /proc/<pid>/stat delta since the
+    previous call, and from ps (lifetime average) for the very first call.
+    Returns None if the process is gone.
+    """
+    now = time.monotonic()
+    ticks = read_proc_cpu_ticks(pid)
+    if ticks is None:
+        _proc_cpu_prev.pop(pid, None)
+        return None
+
+    prev = _proc_cpu_prev.get(pid)
+    _proc_cpu_prev[pid] = (ticks, now)
+    if len(_proc_cpu_prev) > 64:
+        _proc_cpu_prev.clear()
+        _proc_cpu_prev[pid] = (ticks, now)
+
+    tasks = read_top_tasks()
+    if tasks:
+        for top_pid, _, cpu in tasks:
+            if top_pid == pid:
+                return cpu
+
+    if prev is not None and now > prev[1]:
+        return (ticks - prev[0]) * 100.0 / CLK_TCK / (now - prev[1])
+
     try:
         result = subprocess.run(
             ["ps", "-p", str(pid), "-o", "pcpu="],
@@ -313,49 +810,21 @@ def get_process_features(pid: int) -> Dict[str, Any]:
     return features
 
 
-# ----------------------------
-# Rule-based decision logic
-# ----------------------------
-
-def decide_boost_level(avg_load: int,
-                       max_load: int,
-                       proc_cpu: Optional[float],
-                       features: Dict[str, Any]) -> int:
-    """
-    Rule-based controller using system + process features.
-    This is the same base logic as in adaptive_daemon (for compatibility).
-    """
-    if avg_load is None or max_load is None:
-        return 0
-
-    mem_used = features.get("mem_used_pct", 0.0)
-    procs_running = features.get("procs_running", 0)
-
-    if max_load >= 90 or \
-       (proc_cpu is not None and proc_cpu >= 80) or \
-       (mem_used >= 90 and procs_running >= 8):
-        return 3
-
-    if avg_load >= 70 or \
-       (proc_cpu is not None and proc_cpu >= 60) or \
-       (mem_used >= 80 and procs_running >= 6):
-        return 2
-
-    if avg_load >= 40 or \
-       (proc_cpu is not None and proc_cpu >= 30) or \
-       (mem_used >= 70 and procs_running >= 4):
-        return 1
-
-    return 0
-
-
 # ----------------------------
 # ML model loading and prediction
 # ----------------------------
 
 ML_MODEL = None
-if MODE in ("ml", "hybrid"):
+ML_TABLES: Optional[ModelTables] = None
+if MODE in ("ml", "hybrid") or POLICY_MODE == "model":
+    ML_TABLES = load_model_tables(MODEL_BIN_PATH)
+    if ML_TABLES is not None:
+        print(f"[INFO] Loaded tree tables from {MODEL_BIN_PATH} "
+              f"({len(ML_TABLES.roots)} trees)")
+if MODE in ("ml", "hybrid") and ML_TABLES is None:
     if MODEL_PATH.exists():
+        from joblib import load
+
         print(f"[INFO] Loading ML model from {MODEL_PATH} ...")
         ML_MODEL = load(MODEL_PATH)
         print("[INFO] Model loaded!")
@@ -366,10 +835,14 @@ if MODE in ("ml", "hybrid"):
 
 
 def predict_boost_ml(features: Dict[str, Any]) -> int:
-    """Predict boost using trained ML model."""
+    """Predict boost using the exported tree tables, or the sklearn model."""
+    if ML_TABLES is not None:
+        return ML_TABLES.predict(features)
     if ML_MODEL is None:
         return 0
 
+    import pandas as pd
+
     # Use exactly the features the model was trained on
     row = {name: features.get(name, 0) for name in ML_MODEL.feature_names_in_}
     df = pd.DataFrame([row])
@@ -377,26 +850,228 @@ def predict_boost_ml(features: Dict[str, Any]) -> int:
     return boost
 
 
-def combine_hybrid(ml_boost: int, rule_boost: int) -> int:
+def upload_policy_model() -> bool:
+    """Write model.bin to the module's policy_model (for POLICY_MODE "model")."""
+    if ML_TABLES is None or not PATH_POLICY_MODEL.exists():
+        return False
+    try:
+        with PATH_POLICY_MODEL.open("wb") as f:
+            f.write(MODEL_BIN_PATH.read_bytes())
+        return True
+    except OSError as e:
+        print(f"[ERROR] Failed to upload {MODEL_BIN_PATH} to {PATH_POLICY_MODEL}: {e}")
+        return False
+
+
+# ----------------------------
+# Feature pipeline
+# ----------------------------
+
+# Inputs of decide_boost_level() (boost_policy.py) besides avg_load,
+# max_load and proc_cpu
+RULE_FEATURES = frozenset({"mem_used_pct", "procs_running", "proc_wait_pct"})
+
+PSI_FEATURES = frozenset({"psi_cpu_some", "psi_cpu_full"})
+IO_FEATURES = frozenset({"proc_read_bytes", "proc_write_bytes"})
+HISTORY_FEATURES = frozenset({"cpu_busy_spread", "cpu_busy_trend"})
+
+# /proc readers and the features each of them yields
+SYSTEM_SOURCES = (
+    (parse_meminfo, frozenset({"mem_used_pct"})),
+    (parse_proc_stat, frozenset({"procs_running", "procs_blocked"})),
+    (parse_loadavg, frozenset({"loadavg1", "loadavg5", "loadavg15"})),
+    (parse_cpu_psi, PSI_FEATURES),
+)
+PROCESS_SOURCES = (
+    (parse_proc_status, frozenset({"proc_vms_kb", "proc_rss_kb", "proc_threads"})),
+    (parse_proc_io, IO_FEATURES),
+)
+
+# Everything the snapshot carries (one pread instead of the readers above)
+SNAPSHOT_FEATURES = frozenset().union(
+    *(keys for _, keys in SYSTEM_SOURCES + PROCESS_SOURCES),
+    {"rq_waiting", "rq_max_depth", "wait_pct", "proc_run_delay_ns", "proc_wait_pct"},
+)
+
+
+def policy_features() -> frozenset:
+    """Features the active boost policy reads."""
+    if POLICY_MODE != "user":
+        return frozenset()  # the module decides, we only report its level
+
+    wanted = frozenset()
+    if MODE in ("base", "hybrid"):
+        wanted |= RULE_FEATURES
+    if MODE in ("ml", "hybrid"):
+        if ML_TABLES is not None:
+            wanted |= {name for name, _ in ML_TABLES.features}
+        elif ML_MODEL is not None:
+            wanted |= set(ML_MODEL.feature_names_in_)
+    return wanted
+
+
+class FeaturePipeline:
+    """
+    Collect the features in `wanted` and nothing else.
+
+    The cheap signals (current_load, max_load, target pid) key a cache:
+    while they stay the same the previous features are returned without
+    touching the snapshot or /proc, up to FEATURE_MAX_AGE seconds.
+    """
+
+    def __init__(self, wanted: frozenset):
+        self.wanted = wanted
+        self.snapshot = SnapshotReader() if wanted & SNAPSHOT_FEATURES else None
+        self.cpu_history = CpuHistoryReader() if wanted & HISTORY_FEATURES else None
+        self.system_sources = [f for f, keys in SYSTEM_SOURCES if wanted & keys]
+        self.process_sources = [f for f, keys in PROCESS_SOURCES if wanted & keys]
+        self.key: Optional[Tuple[Any, ...]] = None
+        self.stamp = 0.0
+        self.features: Dict[str, Any] = {}
+
+    def collect(self, avg_load: Optional[int], max_load: Optional[int],
+                pid: int) -> Dict[str, Any]:
+        """Wanted system and process features for pid (cached, do not modify)."""
+        now = time.monotonic()
+        key = (avg_load, max_load, pid)
+        if key == self.key and now - self.stamp < FEATURE_MAX_AGE:
+            return self.features
+
+        features: Dict[str, Any] = {}
+        snap = self.snapshot.read() if self.snapshot is not None else None
+        proc_features = None
+        if snap is not None:
+            features.update(snapshot_system_features(snap, self.wanted))
+            proc_features = snapshot_process_features(snap, pid, self.wanted)
+        else:
+            for source in self.system_sources:
+                features.update(source())
+        if proc_features is None:
+            proc_features = {}
+            for source in self.process_sources:
+                proc_features.update(source(pid))
+        features.update(proc_features)
+
+        if self.cpu_history is not None:
+            history = self.cpu_history.read()
+            if history is not None:
+                features.update(cpu_history_features(history))
+
+        self.key = key
+        self.stamp = now
+        self.features = features
+        return features
+
+
+# ----------------------------
+# Throttle set (noisy neighbors)
+# ----------------------------
+
+class ThrottleSet:
     """
-    Hybrid combination:
-    - If ML and rules are close (difference <= 1), trust ML.
-    - If ML strongly disagrees, keep rule-based decision as a safety net.
+    Deprioritize processes and cgroups competing with the target.
+
+    PIDs and cgroups go into the module's "throttle" file; their throttle
+    level follows the target's boost level. Configured cgroups also get a
+    cpu.max quota while the target is boosted. release() undoes everything.
     """
-    if abs(ml_boost - rule_boost) <= 1:
-        return ml_boost
-    return rule_boost
+
+    def __init__(self):
+        self.enabled = bool(THROTTLE_POLICY) and PATH_THROTTLE.exists()
+        self.pids: Dict[int, int] = {}
+        self.saved_cpu_max: Dict[str, str] = {}
+        self.level = 0
+
+    def add_pid(self, pid: int, level: int) -> bool:
+        if not self.enabled or pid in self.pids or len(self.pids) >= THROTTLE_MAX_PIDS:
+            return False
+        if write_text(PATH_THROTTLE, f"add {pid} {level} group {THROTTLE_POLICY}"):
+            self.pids[pid] = level
+            print(f"[INFO] Throttling competing pid {pid} (level={level}, {THROTTLE_POLICY})")
+            return True
+        return False
+
+    def set_level(self, level: int):
+        """Move every throttled entry to level, release all at level 0."""
+        if not self.enabled or level == self.level:
+            return
+        if level == 0:
+            self.release()
+            return
+
+        for pid in list(self.pids):
+            if not write_text(PATH_THROTTLE, f"add {pid} {level} group {THROTTLE_POLICY}"):
+                del self.pids[pid]      # process is gone
+            else:
+                self.pids[pid] = level
+        for path in THROTTLE_CGROUPS:
+            write_text(PATH_THROTTLE, f"addcg {path} {level} {THROTTLE_POLICY}")
+            self._set_cpu_max(path, THROTTLE_CPU_MAX)
+        self.level = level
+
+    def release(self):
+        if not self.enabled:
+            return
+        if self.pids or self.level > 0:
+            write_text(PATH_THROTTLE, "clear")
+        for path, value in list(self.saved_cpu_max.items()):
+            self._write_cpu_max(path, value)
+        self.saved_cpu_max.clear()
+        self.pids.clear()
+        self.level = 0
+
+    def _set_cpu_max(self, path: str, value: str):
+        cpu_max = CGROUP2_ROOT / path.lstrip("/") / "cpu.max"
+        if path not in self.saved_cpu_max:
+            try:
+                self.saved_cpu_max[path] = cpu_max.read_text().strip()
+            except OSError as e:
+                print(f"[WARN] Cannot read {cpu_max}: {e}")
+                return
+        self._write_cpu_max(path, value)
+
+    def _write_cpu_max(self, path: str, value: str):
+        write_text(CGROUP2_ROOT / path.lstrip("/") / "cpu.max", value)
 
 
 # ----------------------------
 # Main control loop
 # ----------------------------
 
-def main_loop(interval: float = 0.5):
+def main_loop(interval: float = 0.5, iterations: Optional[int] = None):
+    """
+    Run the controller. iterations bounds the number of loop passes
+    (bench/overhead_bench.py times them), None runs until interrupted.
+    """
     print("[INFO] Adaptive controller started")
     print(f"[INFO] Mode: {MODE}")
     print(f"[INFO] Using sysfs base: {SYSFS_BASE}")
 
+    if PATH_TARGET_SCOPE.exists() and write_text(PATH_TARGET_SCOPE, TARGET_SCOPE):
+        print(f"[INFO] Target scope: {TARGET_SCOPE}")
+    if POLICY_MODE == "model" and upload_policy_model():
+        print(f"[INFO] Model uploaded to {PATH_POLICY_MODEL}")
+    if PATH_POLICY_MODE.exists() and write_text(PATH_POLICY_MODE, POLICY_MODE):
+        print(f"[INFO] Policy mode: {POLICY_MODE}")
+    if BOOST_POLICY and PATH_BOOST_POLICY.exists() and write_text(PATH_BOOST_POLICY, BOOST_POLICY):
+        print(f"[INFO] Boost policy: {BOOST_POLICY}")
+
+    waiter = LoadEventWaiter()
+    pipeline = FeaturePipeline(policy_features())
+    print(f"[INFO] Policy features: {', '.join(sorted(pipeline.wanted)) or 'none'}")
+    transition = BoostTransition()
+    if POLICY_MODE == "user":
+        print(f"[INFO] Boost transitions: margin={transition.margin:g}, "
+              f"dwell={transition.dwell:g}s")
+    throttle = ThrottleSet()
+    if throttle.enabled:
+        print(f"[INFO] Throttle policy: {THROTTLE_POLICY}")
+        atexit.register(throttle.release)
+    memguard = MemoryGuard()
+    if memguard.enabled:
+        print(f"[INFO] Memory protection from {memguard.threshold:g}% used")
+        release_on_exit(memguard)
+
     last_target_pid: Optional[int] = None
     last_boost_level: Optional[int] = None
     hold_start: Optional[float] = None
@@ -406,33 +1081,44 @@ def main_loop(interval: float = 0.5):
     LOW_CPU_THRESHOLD = 2.0     # below 2% we consider the process "sleepy"
     LOW_CPU_COUNT_TRIGGER = 4   # number of consecutive low-CPU cycles
 
-    while True:
-        avg_load, max_load = get_kernel_metrics()
-        sys_features = get_system_features()
+    for _ in itertools.count() if iterations is None else range(iterations):
+        avg_load, max_load = waiter.loads()
 
         # 1) Choose or validate target PID
         if last_target_pid is None:
-            pid = pick_target_pid(min_cpu=5.0)
+            pid = TARGET_PID or pick_target_pid(min_cpu=5.0)
             if pid is not None:
                 if write_int(PATH_TARGET_PID, pid):
                     last_target_pid = pid
                     hold_start = time.time()
                     low_cpu_counter = 0
                     print(f"[INFO] target_pid set to {pid}")
+                elif TARGET_PID:
+                    print(f"[ERROR] Cannot set pinned target pid {pid}")
+                    return
             else:
                 print("[INFO] No suitable target PID found (CPU too low)")
-                time.sleep(interval)
+                waiter.wait(IDLE_TIMEOUT)
                 continue
 
         proc_cpu = estimate_process_cpu(last_target_pid)
         if proc_cpu is None:
+            if TARGET_PID:
+                print(f"[INFO] Pinned target PID {last_target_pid} is gone, stopping")
+                throttle.release()
+                memguard.release()
+                write_boost(0)
+                return
             print(f"[INFO] Previous target PID {last_target_pid} is gone, resetting")
+            throttle.release()
+            memguard.release()
             last_target_pid = None
-            write_int(PATH_BOOST_LEVEL, 0)
+            write_boost(0)
             last_boost_level = 0
+            transition.reset()
             hold_start = None
             low_cpu_counter = 0
-            time.sleep(interval)
+            waiter.wait(interval)
             continue
 
         now = time.time()
@@ -457,13 +1143,19 @@ def main_loop(interval: float = 0.5):
         if competing_pid is not None and competing_pid != last_target_pid:
             comp_cpu = estimate_process_cpu(competing_pid)
             if comp_cpu is not None and comp_cpu > proc_cpu + 30.0:
-                high_competition = True
+                # Keep the target and push the competitor back if we can
+                level = max(last_boost_level or 0, 1)
+                if competing_pid in throttle.pids or throttle.add_pid(competing_pid, level):
+                    throttle.set_level(level)
+                else:
+                    high_competition = True
 
         # 3) Time-based condition:
         #    if we hold the process long, but it is weak, we can switch as well
         time_based_switch = (now - hold_start > HOLD_TIME_SEC and proc_cpu < 5.0)
 
-        should_switch = low_cpu_triggered or high_competition or time_based_switch
+        should_switch = not TARGET_PID and \
+            (low_cpu_triggered or high_competition or time_based_switch)
 
         if should_switch:
             print(
@@ -472,58 +1164,59 @@ def main_loop(interval: float = 0.5):
                 f"low_cpu={low_cpu_triggered}, high_comp={high_competition}, "
                 f"time_based={time_based_switch})"
             )
+            throttle.release()
+            memguard.release()
             last_target_pid = None
-            write_int(PATH_BOOST_LEVEL, 0)
+            write_boost(0)
             last_boost_level = 0
+            transition.reset()
             hold_start = None
             low_cpu_counter = 0
-            time.sleep(interval)
+            waiter.wait(interval)
             continue
 
         # -------------------------
-        # Collect process features
+        # Collect the features the policy uses (cached while load is flat)
         # -------------------------
 
-        proc_features = get_process_features(last_target_pid)
-
-        # Merge all features into a single dict
         all_features: Dict[str, Any] = {
             "avg_load": avg_load if avg_load is not None else 0,
             "max_load": max_load if max_load is not None else 0,
             "proc_cpu": proc_cpu,
             "target_pid": last_target_pid,
         }
-        all_features.update(sys_features)
-        all_features.update(proc_features)
+        all_features.update(pipeline.collect(avg_load, max_load, last_target_pid))
 
         # -------------------------
-        # Decide boost level (base / ml / hybrid)
+        # Decide boost level (base / ml / hybrid), then rate-limit it:
+        # hold is the same decision with the lowered "down" thresholds
         # -------------------------
-        if MODE == "ml":
-            boost = predict_boost_ml(all_features)
-        elif MODE == "hybrid":
-            rule_boost = decide_boost_level(
-                all_features["avg_load"],
-                all_features["max_load"],
-                proc_cpu,
-                all_features,
-            )
-            ml_boost = predict_boost_ml(all_features)
-            boost = combine_hybrid(ml_boost, rule_boost)
-        else:  # MODE == "base"
-            boost = decide_boost_level(
-                all_features["avg_load"],
-                all_features["max_load"],
-                proc_cpu,
-                all_features,
-            )
+        if POLICY_MODE != "user":
+            boost = read_int(PATH_BOOST_LEVEL) or 0
+        else:
+            if MODE in ("base", "hybrid"):
+                args = (all_features["avg_load"], all_features["max_load"],
+                        proc_cpu, all_features)
+                rule_boost = decide_boost_level(*args)
+                rule_hold = decide_boost_level(*args, margin=transition.margin)
+            if MODE == "ml":
+                raw = hold = predict_boost_ml(all_features)
+            elif MODE == "hybrid":
+                ml_boost = predict_boost_ml(all_features)
+                raw = combine_hybrid(ml_boost, rule_boost)
+                hold = combine_hybrid(ml_boost, rule_hold)
+            else:  # MODE == "base"
+                raw, hold = rule_boost, rule_hold
+            boost = transition.update(raw, hold)
 
         # -------------------------
         # Apply boost if changed + verbose terminal output
         # -------------------------
         if last_boost_level is None or boost != last_boost_level:
-            if write_int(PATH_BOOST_LEVEL, boost):
+            if write_boost(boost):
                 last_boost_level = boost
+                if throttle.pids:
+                    throttle.set_level(boost)
                 print(
                     f"[INFO] boost_level={boost} "
                     f"(mode={MODE}, "
@@ -545,7 +1238,10 @@ def main_loop(interval: float = 0.5):
                 f"pid={last_target_pid}"
             )
 
-        time.sleep(interval)
+        memguard.update(last_target_pid, boost, all_features.get("mem_used_pct"))
+
+        # Nothing boosted: sleep until the module reports a load change
+        waiter.wait(interval if boost > 0 else IDLE_TIMEOUT)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,1364 @@
+/*
+ * adaptive_ctl.c - native controller for the adaptive_sched module
+ *
+ * Same control loop as adaptive_controller.py (target selection and
+ * auto-switching, base/ml/hybrid boost decision, load events) and the
+ * same CSV log as adaptive_daemon.py, without the per-iteration cost of
+ * the Python version: every sysfs and /proc file is opened once and read
+ * with pread(), nothing is forked and nothing is allocated in the loop.
+ *
+ * Targets come from the module's top_table (falling back to top_tasks);
+ * per-process files of the current target are opened when it is picked.
+ * An open /proc/<pid> file keeps referring to that process, so a reused
+ * pid is seen as the old target being gone.
+ *
+ * Configuration uses the controller's environment variables:
+ *   ADAPTIVE_MODE          base, ml or hybrid (default hybrid)
+ *   ADAPTIVE_TARGET_SCOPE  task or group (default group)
+ *   ADAPTIVE_TARGET_PID    pin the target to this pid, never switched
+ *                          away; the controller exits once it is gone
+ *   ADAPTIVE_BOOST_POLICY  boost_policy to set, empty keeps the module's
+ *   ADAPTIVE_POLICY_MODE   user, kernel or model (default user); model
+ *                          uploads ADAPTIVE_MODEL_BIN to policy_model
+ *   ADAPTIVE_MODEL_BIN     tree tables for ml / hybrid, default model.bin
+ *                          next to the binary (logs/export_model.py)
+ *   ADAPTIVE_RULES_FILE    rule table replacing the built-in one, default
+ *                          rules.json next to the binary (boost_policy.py
+ *                          layout, saved there by fleet_agent.py)
+ *   ADAPTIVE_IDLE_TIMEOUT  seconds to wait for a load event when idle
+ *   ADAPTIVE_BOOST_MARGIN  points the thresholds drop by for going down
+ *   ADAPTIVE_BOOST_DWELL   seconds before a level decays by one step
+ *                          (both as in boost_policy.py)
+ *   ADAPTIVE_LOG_FILE      CSV log, default logs/metrics_log.csv next to
+ *                          the binary, empty disables logging
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "adaptive_model.h"
+#include "adaptive_sched_uapi.h"
+
+#ifndef SYSFS_BASE
+#define SYSFS_BASE      "/sys/kernel/adaptive_sched/"
+#endif
+
+#define INTERVAL_SEC            0.5
+#define HOLD_TIME_SEC           10.0    // minimum time to keep the same PID
+#define LOW_CPU_THRESHOLD       2.0     // below 2% the process is "sleepy"
+#define LOW_CPU_COUNT_TRIGGER   4       // consecutive low-CPU cycles
+#define MIN_TARGET_CPU          5.0
+#define MIN_COMPETITOR_CPU      10.0
+#define COMPETITION_MARGIN      30.0
+
+#define FILE_BUF_SIZE   4096
+
+/*
+ * ----------------------
+ * Configuration
+ * ----------------------
+ */
+
+enum ctl_mode {
+    MODE_BASE = 0,
+    MODE_ML,
+    MODE_HYBRID,
+};
+
+static const char * const mode_names[] = {
+    [MODE_BASE]   = "base",
+    [MODE_ML]     = "ml",
+    [MODE_HYBRID] = "hybrid",
+};
+
+static struct {
+    int mode;
+    const char *policy_mode;
+    bool kernel_policy;         // module decides boost_level: only pick targets
+    const char *scope;
+    const char *boost_policy;
+    pid_t target_pid;           // pinned target, 0 picks by CPU usage
+    double idle_timeout;
+    double boost_margin;
+    double boost_dwell;
+    char log_path[PATH_MAX];
+    char model_path[PATH_MAX];
+    char rules_path[PATH_MAX];
+} cfg;
+
+static struct adaptive_model model;
+
+static volatile sig_atomic_t stop;
+
+static const char *env_or(const char *name, const char *def)
+{
+    const char *v = getenv(name);
+
+    return v ? v : def;
+}
+
+// name relative to the directory of this binary
+static void exe_relative(char *buf, size_t size, const char *name)
+{
+    char exe[PATH_MAX - 32];
+    ssize_t n;
+    char *slash;
+
+    n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n <= 0) {
+        snprintf(buf, size, "%s", name);
+        return;
+    }
+    exe[n] = '\0';
+
+    slash = strrchr(exe, '/');
+    if (slash)
+        *slash = '\0';
+    snprintf(buf, size, "%s/%s", exe, name);
+}
+
+static void load_config(void)
+{
+    const char *mode = env_or("ADAPTIVE_MODE", "hybrid");
+    const char *log = getenv("ADAPTIVE_LOG_FILE");
+    size_t i;
+
+    cfg.mode = MODE_BASE;
+    for (i = 0; i < sizeof(mode_names) / sizeof(mode_names[0]); i++) {
+        if (!strcasecmp(mode, mode_names[i]))
+            cfg.mode = i;
+    }
+
+    cfg.policy_mode = env_or("ADAPTIVE_POLICY_MODE", "user");
+    cfg.kernel_policy = strcasecmp(cfg.policy_mode, "user") != 0;
+    cfg.scope = env_or("ADAPTIVE_TARGET_SCOPE", "group");
+    cfg.boost_policy = env_or("ADAPTIVE_BOOST_POLICY", "");
+    cfg.target_pid = atoi(env_or("ADAPTIVE_TARGET_PID", "0"));
+    cfg.idle_timeout = atof(env_or("ADAPTIVE_IDLE_TIMEOUT", "5.0"));
+    if (cfg.idle_timeout <= 0)
+        cfg.idle_timeout = 5.0;
+    cfg.boost_margin = atof(env_or("ADAPTIVE_BOOST_MARGIN", "5"));
+    cfg.boost_dwell = atof(env_or("ADAPTIVE_BOOST_DWELL", "1.0"));
+
+    if (log)
+        snprintf(cfg.log_path, sizeof(cfg.log_path), "%s", log);
+    else
+        exe_relative(cfg.log_path, sizeof(cfg.log_path), "logs/metrics_log.csv");
+
+    if (getenv("ADAPTIVE_MODEL_BIN"))
+        snprintf(cfg.model_path, sizeof(cfg.model_path), "%s",
+                 getenv("ADAPTIVE_MODEL_BIN"));
+    else
+        exe_relative(cfg.model_path, sizeof(cfg.model_path), "model.bin");
+
+    if (getenv("ADAPTIVE_RULES_FILE"))
+        snprintf(cfg.rules_path, sizeof(cfg.rules_path), "%s",
+                 getenv("ADAPTIVE_RULES_FILE"));
+    else
+        exe_relative(cfg.rules_path, sizeof(cfg.rules_path), "rules.json");
+}
+
+/*
+ * ----------------------
+ * File helpers: persistent fds, pread / pwrite at offset 0
+ * ----------------------
+ */
+
+static double now_mono(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double now_wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_ro(const char *path)
+{
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static void close_fd(int *fd)
+{
+    if (*fd >= 0)
+        close(*fd);
+    *fd = -1;
+}
+
+// Read a whole text file into buf, NUL-terminated. Returns the length or -1.
+static ssize_t read_text(int fd, char *buf, size_t size)
+{
+    ssize_t n;
+
+    if (fd < 0)
+        return -1;
+
+    n = pread(fd, buf, size - 1, 0);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+static bool read_int(int fd, int *val)
+{
+    char buf[32];
+    char *end;
+    long v;
+
+    if (read_text(fd, buf, sizeof(buf)) <= 0)
+        return false;
+
+    v = strtol(buf, &end, 10);
+    if (end == buf)
+        return false;
+    *val = (int)v;
+    return true;
+}
+
+static bool write_text(int fd, const char *path, const char *value)
+{
+    size_t len = strlen(value);
+
+    if (fd >= 0 && pwrite(fd, value, len, 0) == (ssize_t)len)
+        return true;
+
+    fprintf(stderr, "[ERROR] Failed to write '%s' to %s: %s\n",
+            value, path, strerror(errno));
+    return false;
+}
+
+static bool write_int(int fd, const char *path, int value)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%d", value);
+    return write_text(fd, path, buf);
+}
+
+// One-shot setting: open, write, close
+static bool write_setting(const char *path, const char *value)
+{
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    bool ok;
+
+    if (fd < 0)
+        return false;
+    ok = write_text(fd, path, value);
+    close(fd);
+    return ok;
+}
+
+// Value of "key <number>" at the start of a line, as in /proc/meminfo
+static bool parse_key(const char *buf, const char *key, uint64_t *val)
+{
+    size_t len = strlen(key);
+    const char *p = buf;
+
+    while (p && *p) {
+        if (!strncmp(p, key, len)) {
+            *val = strtoull(p + len, NULL, 10);
+            return true;
+        }
+        p = strchr(p, '\n');
+        if (p)
+            p++;
+    }
+    return false;
+}
+
+/*
+ * ----------------------
+ * Module and /proc files
+ * ----------------------
+ */
+
+#define PATH_CURRENT_LOAD   SYSFS_BASE "current_load"
+#define PATH_MAX_LOAD       SYSFS_BASE "max_load"
+#define PATH_BOOST_LEVEL    SYSFS_BASE "boost_level"
+#define PATH_TARGET_PID     SYSFS_BASE "target_pid"
+#define PATH_TARGET_SCOPE   SYSFS_BASE "target_scope"
+#define PATH_BOOST_POLICY   SYSFS_BASE "boost_policy"
+#define PATH_POLICY_MODE    SYSFS_BASE "policy_mode"
+#define PATH_POLICY_MODEL   SYSFS_BASE "policy_model"
+#define PATH_SNAPSHOT       SYSFS_BASE "snapshot"
+#define PATH_TOP_TABLE      SYSFS_BASE "top_table"
+#define PATH_TOP_TASKS      SYSFS_BASE "top_tasks"
+
+static struct {
+    int current_load;
+    int max_load;
+    int boost_level;
+    int target_pid;
+    int snapshot;
+    int top_table;
+    int top_tasks;
+
+    int meminfo;
+    int stat;
+    int loadavg;
+    int psi_cpu;
+    int uptime;
+} fds;
+
+static void open_files(void)
+{
+    fds.current_load = open_ro(PATH_CURRENT_LOAD);
+    fds.max_load = open_ro(PATH_MAX_LOAD);
+    fds.boost_level = open(PATH_BOOST_LEVEL, O_RDWR | O_CLOEXEC);
+    fds.target_pid = open(PATH_TARGET_PID, O_RDWR | O_CLOEXEC);
+    fds.snapshot = open_ro(PATH_SNAPSHOT);
+    fds.top_table = open_ro(PATH_TOP_TABLE);
+    fds.top_tasks = open_ro(PATH_TOP_TASKS);
+
+    fds.meminfo = open_ro("/proc/meminfo");
+    fds.stat = open_ro("/proc/stat");
+    fds.loadavg = open_ro("/proc/loadavg");
+    fds.psi_cpu = open_ro("/proc/pressure/cpu");
+    fds.uptime = open_ro("/proc/uptime");
+
+    if (fds.snapshot < 0)
+        fprintf(stderr, "[WARN] Snapshot unavailable, parsing /proc instead\n");
+    if (fds.top_table < 0 && fds.top_tasks < 0)
+        fprintf(stderr, "[WARN] Module exports no top_table/top_tasks, no target selection\n");
+}
+
+/*
+ * ----------------------
+ * Features (named as in the CSV log)
+ * ----------------------
+ */
+
+struct features {
+    int avg_load;
+    int max_load;
+    double proc_cpu;
+    int target_pid;
+    double mem_used_pct;
+    unsigned int procs_running;
+    unsigned int procs_blocked;
+    double loadavg[3];
+    double psi_cpu_some;
+    double psi_cpu_full;
+    uint64_t proc_vms_kb;
+    uint64_t proc_rss_kb;
+    unsigned int proc_threads;
+    uint64_t proc_read_bytes;
+    uint64_t proc_write_bytes;
+    unsigned int proc_wait_pct;     // not logged, used by the rules
+};
+
+static double psi_avg10(const char *buf, const char *line)
+{
+    const char *p = strstr(buf, line);
+
+    if (!p || !(p = strstr(p, "avg10=")))
+        return 0.0;
+    return strtod(p + 6, NULL);
+}
+
+static void read_cpu_psi(struct features *f)
+{
+    char buf[256];
+
+    if (read_text(fds.psi_cpu, buf, sizeof(buf)) <= 0)
+        return;
+    f->psi_cpu_some = psi_avg10(buf, "some ");
+    f->psi_cpu_full = psi_avg10(buf, "full ");
+}
+
+// /proc/stat has a line per CPU before the procs_* lines
+#define STAT_BUF_SIZE   (64 * 1024)
+
+// System features from /proc, for modules without the snapshot file
+static void read_proc_system(struct features *f)
+{
+    static char stat_buf[STAT_BUF_SIZE];
+    char buf[FILE_BUF_SIZE];
+    uint64_t total, avail, v;
+    const char *p;
+
+    if (read_text(fds.meminfo, buf, sizeof(buf)) > 0 &&
+        parse_key(buf, "MemTotal:", &total) &&
+        parse_key(buf, "MemAvailable:", &avail) && total)
+        f->mem_used_pct = (1.0 - (double)avail / total) * 100.0;
+
+    if (read_text(fds.stat, stat_buf, sizeof(stat_buf)) > 0) {
+        p = strstr(stat_buf, "\nprocs_running ");
+        if (p && parse_key(p + 1, "procs_running ", &v))
+            f->procs_running = v;
+        p = strstr(stat_buf, "\nprocs_blocked ");
+        if (p && parse_key(p + 1, "procs_blocked ", &v))
+            f->procs_blocked = v;
+    }
+
+    if (read_text(fds.loadavg, buf, sizeof(buf)) > 0)
+        sscanf(buf, "%lf %lf %lf", &f->loadavg[0], &f->loadavg[1],
+               &f->loadavg[2]);
+
+    read_cpu_psi(f);
+}
+
+static bool read_snapshot(struct adaptive_snapshot *snap)
+{
+    ssize_t n;
+
+    if (fds.snapshot < 0)
+        return false;
+
+    memset(snap, 0, sizeof(*snap));
+    n = pread(fds.snapshot, snap, sizeof(*snap), 0);
+    if (n < (ssize_t)offsetof(struct adaptive_snapshot, rq_running))
+        return false;
+
+    if (snap->version != ADAPTIVE_SNAPSHOT_VERSION) {
+        fprintf(stderr, "[WARN] Unknown snapshot version %u\n", snap->version);
+        close_fd(&fds.snapshot);
+        return false;
+    }
+
+    // Older modules end before the runqueue fields
+    if (snap->size < sizeof(*snap) || n < (ssize_t)sizeof(*snap))
+        snap->flags &= ~ADAPTIVE_SNAP_HAVE_DELAY;
+    return true;
+}
+
+static void snapshot_system(const struct adaptive_snapshot *snap,
+                            struct features *f)
+{
+    f->avg_load = snap->avg_load;
+    f->max_load = snap->max_load;
+    f->procs_running = snap->procs_running;
+    f->procs_blocked = snap->procs_blocked;
+    f->loadavg[0] = snap->loadavg[0] / 100.0;
+    f->loadavg[1] = snap->loadavg[1] / 100.0;
+    f->loadavg[2] = snap->loadavg[2] / 100.0;
+    if (snap->mem_total_kb)
+        f->mem_used_pct = (1.0 - (double)snap->mem_available_kb /
+                                 snap->mem_total_kb) * 100.0;
+
+    if (snap->flags & ADAPTIVE_SNAP_HAVE_PSI) {
+        f->psi_cpu_some = snap->psi_cpu_some / 100.0;
+        f->psi_cpu_full = snap->psi_cpu_full / 100.0;
+    } else {
+        read_cpu_psi(f);
+    }
+}
+
+/*
+ * ----------------------
+ * Target process
+ * ----------------------
+ */
+
+static struct {
+    pid_t pid;
+    int stat;
+    int status;
+    int io;
+    uint64_t prev_ticks;
+    double prev_time;           // 0 until the first CPU reading
+} target = { .stat = -1, .status = -1, .io = -1 };
+
+static long clk_tck;
+
+static void target_close(void)
+{
+    close_fd(&target.stat);
+    close_fd(&target.status);
+    close_fd(&target.io);
+    target.pid = 0;
+    target.prev_time = 0;
+}
+
+static bool target_open(pid_t pid)
+{
+    char path[64];
+
+    target_close();
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    target.stat = open_ro(path);
+    if (target.stat < 0)
+        return false;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    target.status = open_ro(path);
+    snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    target.io = open_ro(path);      // needs ptrace access, may fail
+
+    target.pid = pid;
+    return true;
+}
+
+/*
+ * utime + stime and starttime from /proc/<pid>/stat, in clock ticks.
+ * Fails once the process is gone.
+ */
+static bool read_stat_ticks(uint64_t *ticks, uint64_t *start)
+{
+    unsigned long long utime, stime, starttime;
+    char buf[1024];
+    char *p;
+
+    if (read_text(target.stat, buf, sizeof(buf)) <= 0)
+        return false;
+
+    // comm may contain spaces, fields start after the last ')'
+    p = strrchr(buf, ')');
+    if (!p)
+        return false;
+
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu "
+               "%*d %*d %*d %*d %*d %*d %llu",
+               &utime, &stime, &starttime) != 3)
+        return false;
+
+    *ticks = utime + stime;
+    *start = starttime;
+    return true;
+}
+
+static double uptime_sec(void)
+{
+    char buf[64];
+
+    if (read_text(fds.uptime, buf, sizeof(buf)) <= 0)
+        return 0.0;
+    return strtod(buf, NULL);
+}
+
+/*
+ * Recent CPU % of the target from the /proc/<pid>/stat delta since the
+ * previous call; the first call uses the lifetime average, like ps.
+ * Returns < 0 if the target is gone.
+ */
+static double target_stat_cpu(void)
+{
+    uint64_t ticks, start;
+    double now = now_mono();
+    double cpu = 0.0, age;
+
+    if (!read_stat_ticks(&ticks, &start))
+        return -1.0;
+
+    if (target.prev_time > 0 && now > target.prev_time) {
+        cpu = (double)(ticks - target.prev_ticks) / clk_tck /
+              (now - target.prev_time) * 100.0;
+    } else {
+        age = uptime_sec() - (double)start / clk_tck;
+        if (age > 0)
+            cpu = (double)ticks / clk_tck / age * 100.0;
+    }
+
+    target.prev_ticks = ticks;
+    target.prev_time = now;
+    return cpu;
+}
+
+static void read_target_io(struct features *f)
+{
+    char buf[FILE_BUF_SIZE];
+    uint64_t v;
+
+    if (read_text(target.io, buf, sizeof(buf)) <= 0)
+        return;
+    if (parse_key(buf, "read_bytes:", &v))
+        f->proc_read_bytes = v;
+    if (parse_key(buf, "write_bytes:", &v))
+        f->proc_write_bytes = v;
+}
+
+static void read_target_proc(struct features *f)
+{
+    char buf[FILE_BUF_SIZE];
+    uint64_t v;
+
+    if (read_text(target.status, buf, sizeof(buf)) > 0) {
+        if (parse_key(buf, "VmRSS:", &v))
+            f->proc_rss_kb = v;
+        if (parse_key(buf, "VmSize:", &v))
+            f->proc_vms_kb = v;
+        if (parse_key(buf, "Threads:", &v))
+            f->proc_threads = v;
+    }
+
+    read_target_io(f);
+}
+
+static void snapshot_target(const struct adaptive_snapshot *snap,
+                            struct features *f)
+{
+    if (snap->target_pid != f->target_pid ||
+        !(snap->flags & ADAPTIVE_SNAP_HAVE_TARGET)) {
+        read_target_proc(f);
+        return;
+    }
+
+    f->proc_vms_kb = snap->proc_vms_kb;
+    f->proc_rss_kb = snap->proc_rss_kb;
+    f->proc_threads = snap->proc_threads;
+
+    if (snap->flags & ADAPTIVE_SNAP_HAVE_IO) {
+        f->proc_read_bytes = snap->proc_read_bytes;
+        f->proc_write_bytes = snap->proc_write_bytes;
+    } else {
+        read_target_io(f);
+    }
+
+    if (snap->flags & ADAPTIVE_SNAP_HAVE_DELAY)
+        f->proc_wait_pct = snap->proc_wait_pct;
+}
+
+/*
+ * ----------------------
+ * Top-N table from the module
+ * ----------------------
+ */
+
+struct top_entry {
+    pid_t pid;                  // process (tgid)
+    double cpu;
+    char comm[ADAPTIVE_TOP_COMM_LEN];
+};
+
+static struct top_entry top[ADAPTIVE_TOP_TASKS_MAX];
+static int nr_top;
+
+static const char * const blacklist_prefixes[] = {
+    "systemd", "kthreadd", "rcu_", "migration", "idle",
+    "adaptive_daemon", "adaptive_controller", "adaptive_ctl",
+    "gnome-shell", "Xorg",
+};
+
+static bool read_top_table(void)
+{
+    struct {
+        struct adaptive_top_header hdr;
+        struct adaptive_top_task tasks[ADAPTIVE_TOP_TASKS_MAX];
+    } table;
+    const struct adaptive_top_task *tt;
+    ssize_t n;
+    unsigned int i;
+
+    n = pread(fds.top_table, &table, sizeof(table), 0);
+    if (n < (ssize_t)sizeof(table.hdr) ||
+        table.hdr.version != ADAPTIVE_TOP_TABLE_VERSION ||
+        table.hdr.size != sizeof(table.hdr) ||
+        table.hdr.entry_size != sizeof(table.tasks[0]))
+        return false;
+
+    nr_top = 0;
+    for (i = 0; i < table.hdr.nr && i < ADAPTIVE_TOP_TASKS_MAX; i++) {
+        if (sizeof(table.hdr) + (i + 1) * sizeof(*tt) > (size_t)n)
+            break;
+        tt = &table.tasks[i];
+        top[nr_top].pid = tt->tgid;
+        top[nr_top].cpu = tt->cpu_x10 / 10.0;
+        memcpy(top[nr_top].comm, tt->comm, sizeof(tt->comm));
+        top[nr_top].comm[sizeof(tt->comm) - 1] = '\0';
+        nr_top++;
+    }
+    return true;
+}
+
+// Text fallback: "<tgid> <cpu%> <comm>" per line
+static bool read_top_tasks(void)
+{
+    char buf[FILE_BUF_SIZE];
+    char *line, *save = NULL;
+    struct top_entry *e;
+
+    if (read_text(fds.top_tasks, buf, sizeof(buf)) < 0)
+        return false;
+
+    nr_top = 0;
+    for (line = strtok_r(buf, "\n", &save);
+         line && nr_top < ADAPTIVE_TOP_TASKS_MAX;
+         line = strtok_r(NULL, "\n", &save)) {
+        e = &top[nr_top];
+        if (sscanf(line, "%d %lf %15[^\n]", &e->pid, &e->cpu, e->comm) == 3)
+            nr_top++;
+    }
+    return true;
+}
+
+// Refresh the top-N list once per control iteration
+static void refresh_top(void)
+{
+    if (fds.top_table >= 0 && read_top_table())
+        return;
+    if (!read_top_tasks())
+        nr_top = 0;
+}
+
+static const struct top_entry *find_top(pid_t pid)
+{
+    int i;
+
+    for (i = 0; i < nr_top; i++) {
+        if (top[i].pid == pid)
+            return &top[i];
+    }
+    return NULL;
+}
+
+static bool blacklisted(const struct top_entry *e)
+{
+    size_t i;
+
+    if (e->pid == getpid())
+        return true;
+
+    for (i = 0; i < sizeof(blacklist_prefixes) / sizeof(blacklist_prefixes[0]); i++) {
+        if (!strncmp(e->comm, blacklist_prefixes[i], strlen(blacklist_prefixes[i])))
+            return true;
+    }
+    return false;
+}
+
+static const struct top_entry *pick_target(double min_cpu)
+{
+    int i;
+
+    for (i = 0; i < nr_top; i++) {
+        if (top[i].cpu >= min_cpu && !blacklisted(&top[i]))
+            return &top[i];
+    }
+    return NULL;
+}
+
+/*
+ * Recent CPU % of the target: the module's figure when it is listed,
+ * the /proc/<pid>/stat delta otherwise. Returns < 0 if it is gone.
+ */
+static double estimate_target_cpu(void)
+{
+    const struct top_entry *e = find_top(target.pid);
+    double cpu = target_stat_cpu();
+
+    if (cpu < 0)
+        return cpu;
+    return e ? e->cpu : cpu;
+}
+
+/*
+ * ----------------------
+ * Boost decision
+ * ----------------------
+ */
+
+#define RULE_OFF    101     // disables a percentage
+
+// Rule table of boost_policy.py (and policy_rules in the module)
+static struct boost_rule {
+    int avg, max, proc, mem, run, wait;
+} boost_rules[4] = {
+    [1] = {       40, RULE_OFF, 30, 70, 4,       20 },
+    [2] = {       70, RULE_OFF, 60, 80, 6,       40 },
+    [3] = { RULE_OFF,       90, 80, 90, 8, RULE_OFF },
+};
+
+static const char *skip_space(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    return p;
+}
+
+// Expect c after optional whitespace, NULL if it is not there
+static const char *expect(const char *p, char c)
+{
+    p = skip_space(p);
+    return *p == c ? p + 1 : NULL;
+}
+
+static const char *parse_long(const char *p, long *v)
+{
+    char *end;
+
+    p = skip_space(p);
+    *v = strtol(p, &end, 10);
+    return end == p ? NULL : end;
+}
+
+#define RULE_KEYS   6
+
+static const struct boost_rule rule_off = {
+    RULE_OFF, RULE_OFF, RULE_OFF, RULE_OFF, RULE_OFF, RULE_OFF
+};
+
+/*
+ * One rule object, {"avg": 40, ...}, checked like parse_rules() in
+ * boost_policy.py: avg, max, mem and wait 0..RULE_OFF, proc and run >= 0.
+ * Keys left out are off, unknown keys are ignored.
+ */
+static const char *parse_rule(const char *p, struct boost_rule *r)
+{
+    static const char * const keys[RULE_KEYS] = {
+        "avg", "max", "proc", "mem", "run", "wait",
+    };
+    static const bool pct[RULE_KEYS] = { true, true, false, true, false, true };
+    int *fields[RULE_KEYS] = { &r->avg, &r->max, &r->proc, &r->mem, &r->run, &r->wait };
+    const char *end;
+    size_t i, len;
+    long v;
+
+    *r = rule_off;
+    if (!(p = expect(p, '{')))
+        return NULL;
+    if ((end = expect(p, '}')))
+        return end;
+
+    for (;;) {
+        if (!(p = expect(p, '"')) || !(end = strchr(p, '"')))
+            return NULL;
+        len = end - p;
+        for (i = 0; i < RULE_KEYS; i++) {
+            if (strlen(keys[i]) == len && !strncmp(p, keys[i], len))
+                break;
+        }
+        if (!(p = expect(end + 1, ':')) || !(p = parse_long(p, &v)))
+            return NULL;
+        if (i < RULE_KEYS) {
+            if (v < 0 || v > (pct[i] ? RULE_OFF : INT_MAX))
+                return NULL;
+            *fields[i] = v;
+        }
+
+        if ((end = expect(p, ',')))
+            p = end;
+        else
+            return expect(p, '}');
+    }
+}
+
+// [[<level>, {rule}], ...]; levels left out never fire, as in boost_policy.py
+static bool parse_rules(const char *p, struct boost_rule *rules)
+{
+    bool seen[4] = { false };
+    long level;
+
+    for (level = 1; level < 4; level++)
+        rules[level] = rule_off;
+
+    if (!(p = expect(p, '[')))
+        return false;
+
+    for (;;) {
+        if (!(p = expect(p, '[')) || !(p = parse_long(p, &level)) ||
+            level < 1 || level > 3 || seen[level])
+            return false;
+        seen[level] = true;
+        if (!(p = expect(p, ',')) || !(p = parse_rule(p, &rules[level])) ||
+            !(p = expect(p, ']')))
+            return false;
+
+        if (!expect(p, ','))
+            break;
+        p = expect(p, ',');
+    }
+
+    p = expect(p, ']');
+    return p && !*skip_space(p);
+}
+
+// Replace the built-in table with rules.json if there is a valid one
+static void load_rules(void)
+{
+    struct boost_rule rules[4];
+    char buf[FILE_BUF_SIZE];
+    int fd = open_ro(cfg.rules_path);
+    ssize_t n;
+
+    if (fd < 0)
+        return;
+    n = read_text(fd, buf, sizeof(buf));
+    close(fd);
+
+    if (n <= 0 || n == sizeof(buf) - 1 || !parse_rules(buf, rules)) {
+        fprintf(stderr, "[WARN] Ignoring rule table %s\n", cfg.rules_path);
+        return;
+    }
+
+    memcpy(&boost_rules[1], &rules[1], 3 * sizeof(rules[0]));
+    printf("[INFO] Rules loaded from %s\n", cfg.rules_path);
+}
+
+static bool at_least(double v, int threshold, double margin)
+{
+    return threshold < RULE_OFF && v >= threshold - margin;
+}
+
+// decide_boost_level() of boost_policy.py, thresholds lowered by margin
+static int decide_boost_level(const struct features *f, double margin)
+{
+    const struct boost_rule *r;
+    int level;
+
+    for (level = 3; level > 0; level--) {
+        r = &boost_rules[level];
+        if (at_least(f->avg_load, r->avg, margin) ||
+            at_least(f->max_load, r->max, margin) ||
+            at_least(f->proc_cpu, r->proc, margin) ||
+            at_least(f->proc_wait_pct, r->wait, margin) ||
+            (at_least(f->mem_used_pct, r->mem, margin) &&
+             f->procs_running >= (unsigned int)r->run))
+            return level;
+    }
+
+    return 0;
+}
+
+static int predict_boost_ml(const struct features *f)
+{
+    double v[ADAPTIVE_FEAT_COUNT] = {
+        [ADAPTIVE_FEAT_AVG_LOAD]         = f->avg_load,
+        [ADAPTIVE_FEAT_MAX_LOAD]         = f->max_load,
+        [ADAPTIVE_FEAT_PROC_CPU]         = f->proc_cpu,
+        [ADAPTIVE_FEAT_MEM_USED_PCT]     = f->mem_used_pct,
+        [ADAPTIVE_FEAT_PROCS_RUNNING]    = f->procs_running,
+        [ADAPTIVE_FEAT_PROCS_BLOCKED]    = f->procs_blocked,
+        [ADAPTIVE_FEAT_LOADAVG1]         = f->loadavg[0],
+        [ADAPTIVE_FEAT_LOADAVG5]         = f->loadavg[1],
+        [ADAPTIVE_FEAT_LOADAVG15]        = f->loadavg[2],
+        [ADAPTIVE_FEAT_PSI_CPU_SOME]     = f->psi_cpu_some,
+        [ADAPTIVE_FEAT_PSI_CPU_FULL]     = f->psi_cpu_full,
+        [ADAPTIVE_FEAT_PROC_VMS_KB]      = f->proc_vms_kb,
+        [ADAPTIVE_FEAT_PROC_RSS_KB]      = f->proc_rss_kb,
+        [ADAPTIVE_FEAT_PROC_THREADS]     = f->proc_threads,
+        [ADAPTIVE_FEAT_PROC_READ_BYTES]  = f->proc_read_bytes,
+        [ADAPTIVE_FEAT_PROC_WRITE_BYTES] = f->proc_write_bytes,
+    };
+
+    return adaptive_model_predict(&model, v);
+}
+
+/*
+ * Hybrid combination, as combine_hybrid() in adaptive_controller.py:
+ * trust the model when it is within one level of the rules, keep the
+ * rules as a safety net when it strongly disagrees.
+ */
+static int combine_hybrid(int ml_boost, int rule_boost)
+{
+    return abs(ml_boost - rule_boost) <= 1 ? ml_boost : rule_boost;
+}
+
+/*
+ * Raw decision, and in *hold the same decision with the lowered "down"
+ * thresholds (the model has none, it is its own hold).
+ */
+static int decide_boost(const struct features *f, int *hold)
+{
+    int ml;
+
+    switch (cfg.mode) {
+    case MODE_ML:
+        *hold = predict_boost_ml(f);
+        return *hold;
+    case MODE_HYBRID:
+        ml = predict_boost_ml(f);
+        *hold = combine_hybrid(ml, decide_boost_level(f, cfg.boost_margin));
+        return combine_hybrid(ml, decide_boost_level(f, 0));
+    default:
+        *hold = decide_boost_level(f, cfg.boost_margin);
+        return decide_boost_level(f, 0);
+    }
+}
+
+/*
+ * BoostTransition of boost_policy.py: up at once; down one level at a
+ * time, after the current level went unjustified for boost_dwell seconds.
+ */
+static struct {
+    int level;
+    double since;
+} transition;
+
+static void transition_reset(void)
+{
+    transition.level = 0;
+    transition.since = now_mono();
+}
+
+static int transition_update(int raw, int hold, double now)
+{
+    if (raw > transition.level) {
+        transition.level = raw;
+        transition.since = now;
+    } else if ((hold > raw ? hold : raw) >= transition.level) {
+        transition.since = now;
+    } else if (now - transition.since >= cfg.boost_dwell) {
+        transition.level--;
+        transition.since = now;
+    }
+
+    return transition.level;
+}
+
+static int next_boost(const struct features *f, double now)
+{
+    int level, raw, hold;
+
+    if (cfg.kernel_policy)
+        return read_int(fds.boost_level, &level) ? level : 0;
+
+    raw = decide_boost(f, &hold);
+    return transition_update(raw, hold, now);
+}
+
+static bool write_boost(int level)
+{
+    if (cfg.kernel_policy)
+        return true;
+    return write_int(fds.boost_level, PATH_BOOST_LEVEL, level);
+}
+
+/*
+ * ----------------------
+ * CSV log, same columns as adaptive_daemon.py
+ * ----------------------
+ */
+
+static FILE *log_file;
+
+static const char log_header[] =
+    "avg_load,max_load,proc_cpu,target_pid,mem_used_pct,procs_running,"
+    "procs_blocked,loadavg1,loadavg5,loadavg15,psi_cpu_some,psi_cpu_full,"
+    "proc_vms_kb,proc_rss_kb,proc_threads,proc_read_bytes,proc_write_bytes,"
+    "boost_level,timestamp\n";
+
+static void open_log(void)
+{
+    char dir[PATH_MAX];
+    char *slash;
+    bool fresh;
+
+    if (!cfg.log_path[0])
+        return;
+
+    snprintf(dir, sizeof(dir), "%s", cfg.log_path);
+    slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+    }
+
+    fresh = access(cfg.log_path, F_OK) != 0;
+    log_file = fopen(cfg.log_path, "ae");
+    if (!log_file) {
+        fprintf(stderr, "[WARN] Cannot open log %s: %s\n", cfg.log_path,
+                strerror(errno));
+        return;
+    }
+
+    if (fresh) {
+        fputs(log_header, log_file);
+        printf("[INFO] Created new log file: %s\n", cfg.log_path);
+    }
+    fflush(log_file);
+}
+
+static void log_row(const struct features *f, int boost, double timestamp)
+{
+    if (!log_file)
+        return;
+
+    fprintf(log_file,
+            "%d,%d,%.1f,%d,%.6f,%u,%u,%.2f,%.2f,%.2f,%.2f,%.2f,"
+            "%llu,%llu,%u,%llu,%llu,%d,%.6f\n",
+            f->avg_load, f->max_load, f->proc_cpu, f->target_pid,
+            f->mem_used_pct, f->procs_running, f->procs_blocked,
+            f->loadavg[0], f->loadavg[1], f->loadavg[2],
+            f->psi_cpu_some, f->psi_cpu_full,
+            (unsigned long long)f->proc_vms_kb,
+            (unsigned long long)f->proc_rss_kb, f->proc_threads,
+            (unsigned long long)f->proc_read_bytes,
+            (unsigned long long)f->proc_write_bytes,
+            boost, timestamp);
+    fflush(log_file);
+}
+
+/*
+ * ----------------------
+ * Load events
+ * ----------------------
+ * The module sysfs_notify()'s current_load / max_load when load crosses
+ * a notify_thresholds band; poll() reports that as POLLPRI. Without the
+ * files this degrades to a plain sleep.
+ */
+
+static void wait_load_event(double timeout)
+{
+    struct pollfd pfd[2];
+    char buf[32];
+    int nr = 0, i;
+
+    if (fds.current_load >= 0)
+        pfd[nr++] = (struct pollfd){ .fd = fds.current_load, .events = POLLPRI };
+    if (fds.max_load >= 0)
+        pfd[nr++] = (struct pollfd){ .fd = fds.max_load, .events = POLLPRI };
+
+    if (!nr) {
+        struct timespec ts = {
+            .tv_sec = (time_t)timeout,
+            .tv_nsec = (long)((timeout - (time_t)timeout) * 1e9),
+        };
+
+        nanosleep(&ts, NULL);
+        return;
+    }
+
+    poll(pfd, nr, (int)(timeout * 1000.0));
+
+    // A read re-arms the notification
+    for (i = 0; i < nr; i++)
+        if (pread(pfd[i].fd, buf, sizeof(buf), 0) < 0)
+            continue;
+}
+
+/*
+ * ----------------------
+ * Main control loop
+ * ----------------------
+ */
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+// Write the loaded model file to policy_model, in order from offset 0
+static bool upload_model(void)
+{
+    const char *p = (const char *)model.hdr;
+    size_t left = model.hdr->total_size;
+    ssize_t n;
+    int fd;
+
+    fd = open(PATH_POLICY_MODEL, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    while (left) {
+        n = write(fd, p, left);
+        if (n <= 0) {
+            fprintf(stderr, "[ERROR] Failed to upload model to %s: %s\n",
+                    PATH_POLICY_MODEL, strerror(errno));
+            close(fd);
+            return false;
+        }
+        p += n;
+        left -= n;
+    }
+
+    close(fd);
+    return true;
+}
+
+static void setup(void)
+{
+    struct sigaction sa = { .sa_handler = on_signal };
+    int ret;
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    clk_tck = sysconf(_SC_CLK_TCK);
+    if (clk_tck <= 0)
+        clk_tck = 100;
+
+    load_config();
+    open_files();
+    open_log();
+    load_rules();
+
+    if (cfg.mode != MODE_BASE || !strcasecmp(cfg.policy_mode, "model")) {
+        ret = adaptive_model_load(&model, cfg.model_path);
+        if (ret)
+            fprintf(stderr, "[WARN] Cannot load model %s: %s\n",
+                    cfg.model_path, strerror(-ret));
+        else
+            printf("[INFO] Model loaded from %s (%u trees)\n",
+                   cfg.model_path, model.hdr->nr_trees);
+    }
+
+    if (cfg.mode != MODE_BASE && !adaptive_model_loaded(&model)) {
+        fprintf(stderr, "[WARN] MODE=%s, but no model is available\n",
+                mode_names[cfg.mode]);
+        fprintf(stderr, "[WARN] Falling back to MODE=base\n");
+        cfg.mode = MODE_BASE;
+    }
+
+    // The module keeps using its rules until a model has been uploaded
+    if (!strcasecmp(cfg.policy_mode, "model") && adaptive_model_loaded(&model) &&
+        upload_model())
+        printf("[INFO] Model uploaded to %s\n", PATH_POLICY_MODEL);
+
+    if (write_setting(PATH_TARGET_SCOPE, cfg.scope))
+        printf("[INFO] Target scope: %s\n", cfg.scope);
+    if (write_setting(PATH_POLICY_MODE, cfg.policy_mode))
+        printf("[INFO] Policy mode: %s\n", cfg.policy_mode);
+    if (cfg.boost_policy[0] && write_setting(PATH_BOOST_POLICY, cfg.boost_policy))
+        printf("[INFO] Boost policy: %s\n", cfg.boost_policy);
+}
+
+static void drop_target(int *last_boost)
+{
+    target_close();
+    write_boost(0);
+    *last_boost = 0;
+    transition_reset();
+}
+
+int main(void)
+{
+    struct adaptive_snapshot snap;
+    struct features f;
+    const struct top_entry *e;
+    double hold_start = 0, now;
+    int low_cpu_count = 0, last_boost = -1, boost;
+    bool have_snap, low_cpu, high_comp, time_switch;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    setup();
+
+    printf("[INFO] Adaptive controller started\n");
+    printf("[INFO] Mode: %s\n", mode_names[cfg.mode]);
+    printf("[INFO] Using sysfs base: %s\n", SYSFS_BASE);
+
+    while (!stop) {
+        memset(&f, 0, sizeof(f));
+
+        have_snap = read_snapshot(&snap);
+        if (have_snap) {
+            snapshot_system(&snap, &f);
+        } else {
+            read_int(fds.current_load, &f.avg_load);
+            read_int(fds.max_load, &f.max_load);
+            read_proc_system(&f);
+        }
+
+        refresh_top();
+
+        // 1) Choose or validate the target
+        if (!target.pid && cfg.target_pid) {
+            if (!target_open(cfg.target_pid) ||
+                !write_int(fds.target_pid, PATH_TARGET_PID, cfg.target_pid)) {
+                fprintf(stderr, "[ERROR] Cannot set pinned target pid %d\n",
+                        cfg.target_pid);
+                break;
+            }
+            printf("[INFO] target_pid pinned to %d\n", cfg.target_pid);
+            hold_start = now_mono();
+        } else if (!target.pid) {
+            e = pick_target(MIN_TARGET_CPU);
+            if (!e) {
+                printf("[INFO] No suitable target PID found (CPU too low)\n");
+                wait_load_event(cfg.idle_timeout);
+                continue;
+            }
+            if (target_open(e->pid) &&
+                write_int(fds.target_pid, PATH_TARGET_PID, e->pid)) {
+                printf("[INFO] Selected target pid=%d (comm=%s, cpu=%.1f%%)\n",
+                       e->pid, e->comm, e->cpu);
+                hold_start = now_mono();
+                low_cpu_count = 0;
+            } else {
+                target_close();
+                wait_load_event(INTERVAL_SEC);
+                continue;
+            }
+        }
+
+        f.target_pid = target.pid;
+        f.proc_cpu = estimate_target_cpu();
+        if (f.proc_cpu < 0 && cfg.target_pid) {
+            printf("[INFO] Pinned target PID %d is gone, stopping\n",
+                   target.pid);
+            write_boost(0);
+            break;
+        }
+        if (f.proc_cpu < 0) {
+            printf("[INFO] Previous target PID %d is gone, resetting\n",
+                   target.pid);
+            drop_target(&last_boost);
+            wait_load_event(INTERVAL_SEC);
+            continue;
+        }
+
+        now = now_mono();
+
+        // 2) Auto-switching: sleepy, out-competed or weak for too long
+        low_cpu_count = f.proc_cpu < LOW_CPU_THRESHOLD ? low_cpu_count + 1 : 0;
+        low_cpu = low_cpu_count >= LOW_CPU_COUNT_TRIGGER;
+
+        e = pick_target(MIN_COMPETITOR_CPU);
+        high_comp = e && e->pid != target.pid &&
+                    e->cpu > f.proc_cpu + COMPETITION_MARGIN;
+
+        time_switch = now - hold_start > HOLD_TIME_SEC &&
+                      f.proc_cpu < MIN_TARGET_CPU;
+
+        if (!cfg.target_pid && (low_cpu || high_comp || time_switch)) {
+            printf("[INFO] Auto-switching target pid %d (proc_cpu=%.1f%%, "
+                   "low_cpu=%d, high_comp=%d, time_based=%d)\n",
+                   target.pid, f.proc_cpu, low_cpu, high_comp, time_switch);
+            drop_target(&last_boost);
+            wait_load_event(INTERVAL_SEC);
+            continue;
+        }
+
+        // 3) Process features, decision, apply
+        if (have_snap)
+            snapshot_target(&snap, &f);
+        else
+            read_target_proc(&f);
+
+        boost = next_boost(&f, now);
+
+        if (boost != last_boost) {
+            if (write_boost(boost)) {
+                last_boost = boost;
+                printf("[INFO] boost_level=%d (mode=%s, avg=%d%%, max=%d%%, "
+                       "proc_cpu=%.1f%%, mem_used=%.1f%%, procs_running=%u, "
+                       "pid=%d)\n",
+                       boost, mode_names[cfg.mode], f.avg_load, f.max_load,
+                       f.proc_cpu, f.mem_used_pct, f.procs_running,
+                       target.pid);
+            }
+        }
+
+        log_row(&f, boost, now_wall());
+
+        // Nothing boosted: sleep until the module reports a load change
+        wait_load_event(boost > 0 ? INTERVAL_SEC : cfg.idle_timeout);
+    }
+
+    printf("\n[INFO] Controller stopped\n");
+    if (log_file)
+        fclose(log_file);
+    adaptive_model_free(&model);
+    return 0;
+}
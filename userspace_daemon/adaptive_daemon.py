@@ -1,10 +1,16 @@
 #!/usr/bin/env python3
+import os
 import time
 import subprocess
 import csv
+import atexit
 from pathlib import Path
 from typing import Optional, Tuple, Dict, Any
 
+from binlog import SNAP_HAVE_PSI, BinlogWriter, read_log_device
+from boost_policy import BoostTransition, decide_boost_level
+from mem_protect import MemoryGuard, release_on_exit
+
 # ----------------------------
 # Paths to kernel module sysfs interface
 # ----------------------------
@@ -14,6 +20,8 @@ PATH_CURRENT_LOAD = SYSFS_BASE / "current_load"
 PATH_MAX_LOAD = SYSFS_BASE / "max_load"
 PATH_BOOST_LEVEL = SYSFS_BASE / "boost_level"
 PATH_TARGET_PID = SYSFS_BASE / "target_pid"
+PATH_SAMPLE_PERIOD = SYSFS_BASE / "sample_period_ms"
+DEV_LOG = Path("/dev/adaptive_sched_log")
 
 # ----------------------------
 # Paths to /proc and pressure information
@@ -34,6 +42,15 @@ SCRIPT_DIR = Path(__file__).resolve().parent
 LOG_DIR = SCRIPT_DIR / "logs"
 LOG_FILE = LOG_DIR / "metrics_log.csv"
 
+# "csv": one row per control tick into LOG_FILE. "binary": every load
+# sample of the module (with per-CPU data) from /dev/adaptive_sched_log,
+# drained once per tick into the columnar BIN_LOG_FILE; convert it with
+# logs/binlog_to_csv.py. ADAPTIVE_LOG_PERIOD_MS sets the module's
+# sample_period_ms for it (10 = 100 Hz), empty keeps the current one.
+LOG_FORMAT = os.environ.get("ADAPTIVE_LOG_FORMAT", "csv").lower()
+LOG_PERIOD_MS = os.environ.get("ADAPTIVE_LOG_PERIOD_MS", "")
+BIN_LOG_FILE = LOG_DIR / "metrics_log.alog"
+
 
 def init_log_file(fieldnames):
     """Create log directory and CSV file with a header if it does not exist."""
@@ -52,6 +69,46 @@ def append_log_row(row: Dict[str, Any]):
         writer.writerow(row)
 
 
+class BinaryLogger:
+    """Drain the module's log device into BIN_LOG_FILE, one block per call."""
+
+    def __init__(self):
+        self.fd = os.open(DEV_LOG, os.O_RDONLY | os.O_NONBLOCK)
+        self.writer: Optional[BinlogWriter] = None
+        self.rows = 0
+
+    def drain(self):
+        records, nr_cpus = read_log_device(self.fd)
+        if not records:
+            return
+        if self.writer is None:
+            LOG_DIR.mkdir(exist_ok=True)
+            self.writer = BinlogWriter(BIN_LOG_FILE, nr_cpus)
+            print(f"[INFO] Writing binary log: {self.writer.path}")
+
+        # The module cannot read PSI; it is a 10 s average, so one reading
+        # per batch is as good as one per record
+        psi = parse_cpu_psi()
+        dropped = 0
+        for rec, _ in records:
+            dropped += rec["dropped"]
+            if psi and not rec["flags"] & SNAP_HAVE_PSI:
+                rec["psi_cpu_some"] = round(psi.get("psi_cpu_some", 0.0) * 100)
+                rec["psi_cpu_full"] = round(psi.get("psi_cpu_full", 0.0) * 100)
+                rec["flags"] |= SNAP_HAVE_PSI
+        if dropped:
+            print(f"[WARN] Log device dropped {dropped} records, drain more often")
+
+        wall_offset = time.time() - time.clock_gettime(time.CLOCK_BOOTTIME)
+        self.rows += self.writer.append(records, wall_offset)
+
+    def close(self):
+        self.drain()
+        os.close(self.fd)
+        if self.writer is not None:
+            self.writer.close()
+
+
 # ----------------------------
 # Generic helpers
 # ----------------------------
@@ -325,47 +382,6 @@ def get_process_features(pid: int) -> Dict[str, Any]:
     return features
 
 
-# ----------------------------
-# Decision logic (placeholder for ML)
-# ----------------------------
-
-def decide_boost_level(avg_load: int,
-                       max_load: int,
-                       proc_cpu: Optional[float],
-                       features: Dict[str, Any]) -> int:
-    """
-    Very simple rule-based controller, using system + process features.
-
-    This is a placeholder for a future ML model.
-    """
-    if avg_load is None or max_load is None:
-        return 0
-
-    mem_used = features.get("mem_used_pct", 0.0)
-    procs_running = features.get("procs_running", 0)
-
-    # Strong boost if:
-    #  - CPU core is fully loaded, or
-    #  - target process is very CPU-heavy, or
-    #  - system is under high memory + runqueue pressure
-    if max_load >= 90 or \
-       (proc_cpu is not None and proc_cpu >= 80) or \
-       (mem_used >= 90 and procs_running >= 8):
-        return 3
-
-    if avg_load >= 70 or \
-       (proc_cpu is not None and proc_cpu >= 60) or \
-       (mem_used >= 80 and procs_running >= 6):
-        return 2
-
-    if avg_load >= 40 or \
-       (proc_cpu is not None and proc_cpu >= 30) or \
-       (mem_used >= 70 and procs_running >= 4):
-        return 1
-
-    return 0
-
-
 # ----------------------------
 # Main loop
 # ----------------------------
@@ -374,8 +390,25 @@ def main_loop(interval: float = 0.5):
     print("[INFO] Adaptive ML daemon started")
     print(f"[INFO] Using sysfs base: {SYSFS_BASE}")
     print(f"[INFO] Logs will be written to: {LOG_FILE}")
+    binary_log: Optional[BinaryLogger] = None
+    if LOG_FORMAT == "binary":
+        try:
+            binary_log = BinaryLogger()
+        except OSError as e:
+            print(f"[WARN] Binary log unavailable ({DEV_LOG}: {e}), logging CSV")
+        else:
+            atexit.register(binary_log.close)
+            if LOG_PERIOD_MS and write_int(PATH_SAMPLE_PERIOD, int(LOG_PERIOD_MS)):
+                print(f"[INFO] sample_period_ms={LOG_PERIOD_MS}")
+
+    memguard = MemoryGuard()
+    if memguard.enabled:
+        print(f"[INFO] Memory protection from {memguard.threshold:g}% used")
+        release_on_exit(memguard)
+
     last_target_pid: Optional[int] = None
     last_boost_level: Optional[int] = None
+    transition = BoostTransition()
     hold_start: Optional[float] = None
     low_cpu_counter: int = 0
 
@@ -385,6 +418,9 @@ def main_loop(interval: float = 0.5):
     LOW_CPU_COUNT_TRIGGER = 4     # кількість послідовних циклів низького CPU
 
     while True:
+        if binary_log is not None:
+            binary_log.drain()
+
         avg_load, max_load = get_kernel_metrics()
         sys_features = get_system_features()
 
@@ -405,9 +441,11 @@ def main_loop(interval: float = 0.5):
         proc_cpu = estimate_process_cpu(last_target_pid)
         if proc_cpu is None:
             print(f"[INFO] Previous target PID {last_target_pid} is gone, resetting")
+            memguard.release()
             last_target_pid = None
             write_int(PATH_BOOST_LEVEL, 0)
             last_boost_level = 0
+            transition.reset()
             hold_start = None
             low_cpu_counter = 0
             time.sleep(interval)
@@ -450,9 +488,11 @@ def main_loop(interval: float = 0.5):
                 f"low_cpu={low_cpu_triggered}, high_comp={high_competition}, "
                 f"time_based={time_based_switch})"
             )
+            memguard.release()
             last_target_pid = None
             write_int(PATH_BOOST_LEVEL, 0)
             last_boost_level = 0
+            transition.reset()
             hold_start = None
             low_cpu_counter = 0
             time.sleep(interval)
@@ -474,13 +514,18 @@ def main_loop(interval: float = 0.5):
         all_features.update(sys_features)
         all_features.update(proc_features)
 
-        # 2) Decide boost level (rule-based for now)
-        boost = decide_boost_level(
+        # 2) Decide boost level (rule-based for now), rate-limited by the
+        #    lowered "down" thresholds and the dwell time
+        args = (
             avg_load if avg_load is not None else 0,
             max_load if max_load is not None else 0,
             proc_cpu,
             all_features,
         )
+        boost = transition.update(
+            decide_boost_level(*args),
+            decide_boost_level(*args, margin=transition.margin),
+        )
 
         # 3) Apply boost if changed
         if last_boost_level is None or boost != last_boost_level:
@@ -504,13 +549,17 @@ def main_loop(interval: float = 0.5):
                 f"pid={last_target_pid}"
             )
 
-        # 4) Log features + boost to CSV (dataset for ML)
-        log_row = all_features.copy()
-        log_row["boost_level"] = boost
-        log_row["timestamp"] = now
+        memguard.update(last_target_pid, boost, all_features.get("mem_used_pct"))
+
+        # 4) Log features + boost to CSV (dataset for ML); the binary log
+        #    is drained at the top of every iteration instead
+        if binary_log is None:
+            log_row = all_features.copy()
+            log_row["boost_level"] = boost
+            log_row["timestamp"] = now
 
-        init_log_file(list(log_row.keys()))
-        append_log_row(log_row)
+            init_log_file(list(log_row.keys()))
+            append_log_row(log_row)
 
         time.sleep(interval)
 
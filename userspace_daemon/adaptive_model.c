@@ -0,0 +1,75 @@
+/*
+ * adaptive_model.c - evaluator for model.bin
+ *
+ * The file is read once into one buffer and checked with
+ * adaptive_model_valid(); prediction scales the feature values and runs
+ * adaptive_model_eval(), the same integer walk the module's policy_model
+ * uses.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adaptive_model.h"
+
+int adaptive_model_load(struct adaptive_model *m, const char *path)
+{
+    void *data = NULL;
+    FILE *f;
+    long len;
+    int ret = -EINVAL;
+
+    m->hdr = NULL;
+
+    f = fopen(path, "rbe");
+    if (!f)
+        return -errno;
+
+    if (fseek(f, 0, SEEK_END) || (len = ftell(f)) < 0 ||
+        len > ADAPTIVE_MODEL_MAX_SIZE || fseek(f, 0, SEEK_SET))
+        goto out;
+
+    // malloc() memory is suitably aligned for the 8-byte node fields
+    data = malloc(len ? len : 1);
+    if (!data) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    if (fread(data, 1, len, f) != (size_t)len || !adaptive_model_valid(data, len))
+        goto out;
+
+    m->hdr = data;
+    data = NULL;
+    ret = 0;
+
+out:
+    fclose(f);
+    free(data);
+    return ret;
+}
+
+void adaptive_model_free(struct adaptive_model *m)
+{
+    free(m->hdr);
+    m->hdr = NULL;
+}
+
+int adaptive_model_predict(const struct adaptive_model *m, const double *values)
+{
+    const struct adaptive_model_feature *features;
+    __s64 x[ADAPTIVE_FEAT_COUNT];
+    __u32 i;
+
+    if (!m->hdr)
+        return 0;
+
+    features = adaptive_model_features(m->hdr);
+    for (i = 0; i < m->hdr->nr_features; i++)
+        x[i] = (__s64)floor(values[features[i].id] * features[i].scale);
+
+    return adaptive_model_eval(m->hdr, x);
+}
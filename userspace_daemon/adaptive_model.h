@@ -0,0 +1,36 @@
+/*
+ * adaptive_model.h - evaluator for model.bin (tree tables written by
+ * logs/export_model.py, format in adaptive_sched_uapi.h)
+ */
+
+#ifndef _ADAPTIVE_MODEL_H
+#define _ADAPTIVE_MODEL_H
+
+#include <stdbool.h>
+
+#include "adaptive_sched_uapi.h"
+
+struct adaptive_model {
+    struct adaptive_model_header *hdr;      // whole file, NULL if none loaded
+};
+
+/*
+ * Load and validate a model file. Returns 0 or a negative errno; on
+ * error the model is left empty.
+ */
+int adaptive_model_load(struct adaptive_model *m, const char *path);
+
+void adaptive_model_free(struct adaptive_model *m);
+
+static inline bool adaptive_model_loaded(const struct adaptive_model *m)
+{
+    return m->hdr != NULL;
+}
+
+/*
+ * Predicted boost level for feature values indexed by
+ * enum adaptive_model_feature_id (ADAPTIVE_FEAT_COUNT entries).
+ */
+int adaptive_model_predict(const struct adaptive_model *m, const double *values);
+
+#endif /* _ADAPTIVE_MODEL_H */
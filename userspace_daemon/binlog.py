@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+"""
+binlog.py — the columnar binary metrics log (.alog).
+
+adaptive_daemon.py drains struct adaptive_log_record (adaptive_sched_uapi.h)
+from /dev/adaptive_sched_log and appends them here in blocks;
+logs/binlog_to_csv.py reads them back.
+
+Layout, little endian:
+  file header   magic b"ALOG", version, nr_columns, then per column a
+                NUL-padded name and an array typecode ("<32sc")
+  block         magic b"ABLK", nr_rows, wall_offset (double, seconds to
+                add to timestamp_ns / 1e9 for wall-clock time), then for
+                every column nr_rows values of its type, column after column
+"""
+
+import array
+import os
+import struct
+import sys
+from pathlib import Path
+from typing import Dict, Iterator, List, Optional, Tuple
+
+BINLOG_MAGIC = b"ALOG"
+BINLOG_VERSION = 1
+BLOCK_MAGIC = b"ABLK"
+
+FILE_HEADER = struct.Struct("<4s2I")
+COLUMN = struct.Struct("<32sc")
+BLOCK_HEADER = struct.Struct("<4sId")
+
+# struct adaptive_log_record / adaptive_snapshot (with the runqueue
+# extension) / adaptive_cpu_sample, version 1
+LOG_RECORD_VERSION = 1
+RECORD_HEADER = struct.Struct("<4I")
+RECORD_HEADER_FIELDS = ("record_version", "record_size", "nr_cpus", "dropped")
+SNAPSHOT = struct.Struct("<4I2Q4i2Q2I3I2II5Q4IQ2I")
+SNAPSHOT_FIELDS = (
+    "version", "size", "flags", "nr_online",
+    "timestamp_ns", "seq",
+    "avg_load", "max_load", "boost_level", "target_pid",
+    "mem_total_kb", "mem_available_kb",
+    "procs_running", "procs_blocked",
+    "loadavg1", "loadavg5", "loadavg15",
+    "psi_cpu_some", "psi_cpu_full",
+    "proc_threads", "proc_vms_kb", "proc_rss_kb",
+    "proc_read_bytes", "proc_write_bytes", "proc_runtime_ns",
+    "rq_running", "rq_waiting", "rq_max_depth", "wait_pct",
+    "proc_run_delay_ns", "proc_wait_pct", "reserved",
+)
+CPU_SAMPLE = struct.Struct("<6BH")
+CPU_SAMPLE_FIELDS = ("busy", "iowait", "irq", "softirq", "steal", "flags", "nr_running")
+CPU_SAMPLE_TYPES = "BBBBBBH"
+
+SNAP_HAVE_TARGET = 1 << 0
+SNAP_HAVE_PSI = 1 << 2
+
+RECORD_COLUMNS = [(name, "q") for name in ("dropped",) + SNAPSHOT_FIELDS
+                  if name != "reserved"]
+
+
+def columns_for(nr_cpus: int) -> List[Tuple[str, str]]:
+    """(name, typecode) of every column for a machine with nr_cpus CPUs."""
+    columns = list(RECORD_COLUMNS)
+    for cpu in range(nr_cpus):
+        columns += [(f"cpu{cpu}_{name}", t)
+                    for name, t in zip(CPU_SAMPLE_FIELDS, CPU_SAMPLE_TYPES)]
+    return columns
+
+
+def parse_records(data: bytes) -> Iterator[Tuple[Dict[str, int], List[tuple]]]:
+    """Split a read() of the log device into (record fields, CPU samples)."""
+    off = 0
+    while off + RECORD_HEADER.size + SNAPSHOT.size <= len(data):
+        head = dict(zip(RECORD_HEADER_FIELDS, RECORD_HEADER.unpack_from(data, off)))
+        size = head["record_size"]
+        if head["record_version"] != LOG_RECORD_VERSION or size <= 0 or \
+                off + size > len(data):
+            break
+        rec = dict(zip(SNAPSHOT_FIELDS,
+                       SNAPSHOT.unpack_from(data, off + RECORD_HEADER.size)))
+        rec["dropped"] = head["dropped"]
+        base = off + RECORD_HEADER.size + SNAPSHOT.size
+        cpus = [CPU_SAMPLE.unpack_from(data, base + i * CPU_SAMPLE.size)
+                for i in range(head["nr_cpus"])
+                if base + (i + 1) * CPU_SAMPLE.size <= off + size]
+        yield rec, cpus
+        off += size
+
+
+def _to_le(values: array.array) -> bytes:
+    if sys.byteorder != "little":
+        values = array.array(values.typecode, values)
+        values.byteswap()
+    return values.tobytes()
+
+
+class BinlogWriter:
+    """Append blocks of records to an .alog file, one write per block."""
+
+    def __init__(self, path: Path, nr_cpus: int):
+        self.columns = columns_for(nr_cpus)
+        self.nr_cpus = nr_cpus
+        header = FILE_HEADER.pack(BINLOG_MAGIC, BINLOG_VERSION, len(self.columns)) + \
+            b"".join(COLUMN.pack(name.encode(), t.encode()) for name, t in self.columns)
+
+        self.path = Path(path)
+        if self.path.exists() and self.path.stat().st_size > 0:
+            with self.path.open("rb") as f:
+                existing = f.read(len(header))
+            if existing != header:
+                # other machine or module version: start a new file
+                stem = f"{self.path.stem}-{int(os.path.getmtime(self.path))}"
+                self.path.rename(self.path.with_name(stem + self.path.suffix))
+        self.fd = os.open(self.path, os.O_WRONLY | os.O_CREAT | os.O_APPEND, 0o644)
+        if os.fstat(self.fd).st_size == 0:
+            os.write(self.fd, header)
+
+    def append(self, records: List[Tuple[Dict[str, int], List[tuple]]],
+               wall_offset: float) -> int:
+        """Write one block, returns the number of rows written."""
+        if not records:
+            return 0
+
+        nr_snap = len(RECORD_COLUMNS)
+        columns = [array.array(t) for _, t in self.columns]
+        for rec, cpus in records:
+            for col, (name, _) in zip(columns, RECORD_COLUMNS):
+                col.append(rec[name])
+            for cpu in range(self.nr_cpus):
+                sample = cpus[cpu] if cpu < len(cpus) else (0,) * len(CPU_SAMPLE_FIELDS)
+                base = nr_snap + cpu * len(CPU_SAMPLE_FIELDS)
+                for i, v in enumerate(sample):
+                    columns[base + i].append(v)
+
+        os.write(self.fd, BLOCK_HEADER.pack(BLOCK_MAGIC, len(records), wall_offset) +
+                 b"".join(_to_le(col) for col in columns))
+        return len(records)
+
+    def close(self):
+        os.close(self.fd)
+
+
+def read_binlog(path: Path) -> Iterator[Tuple[List[str], Dict[str, array.array], float]]:
+    """Yield (column names, columns, wall_offset) for every block of a file."""
+    data = Path(path).read_bytes()
+    magic, version, nr_columns = FILE_HEADER.unpack_from(data)
+    if magic != BINLOG_MAGIC or version != BINLOG_VERSION:
+        raise ValueError(f"{path}: not a version {BINLOG_VERSION} .alog file")
+
+    off = FILE_HEADER.size
+    names, types = [], []
+    for _ in range(nr_columns):
+        name, t = COLUMN.unpack_from(data, off)
+        names.append(name.rstrip(b"\0").decode())
+        types.append(t.decode())
+        off += COLUMN.size
+
+    while off + BLOCK_HEADER.size <= len(data):
+        magic, rows, wall_offset = BLOCK_HEADER.unpack_from(data, off)
+        if magic != BLOCK_MAGIC:
+            raise ValueError(f"{path}: corrupt block at offset {off}")
+        off += BLOCK_HEADER.size
+        columns: Dict[str, array.array] = {}
+        for name, t in zip(names, types):
+            col = array.array(t)
+            end = off + rows * col.itemsize
+            if end > len(data):
+                return  # truncated last block (daemon killed mid-write)
+            col.frombytes(data[off:end])
+            if sys.byteorder != "little":
+                col.byteswap()
+            columns[name] = col
+            off = end
+        yield names, columns, wall_offset
+
+
+def read_log_device(fd: int, bufsize: int = 1 << 20) -> Tuple[List, Optional[int]]:
+    """
+    Drain an O_NONBLOCK fd of /dev/adaptive_sched_log. Returns the records
+    and the machine's nr_cpus (None if nothing was read).
+    """
+    records = []
+    while True:
+        try:
+            data = os.read(fd, bufsize)
+        except BlockingIOError:
+            break
+        if not data:
+            break
+        records.extend(parse_records(data))
+    nr_cpus = max((len(cpus) for _, cpus in records), default=None)
+    return records, nr_cpus
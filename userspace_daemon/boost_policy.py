@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""
+boost_policy.py — the boost rule table, the hybrid combination and the
+transition layer between a decision and the boost_level write, shared
+by adaptive_controller.py, adaptive_daemon.py and logs/simulate_policy.py
+(adaptive_ctl.c has the same logic in C, the module's policy_rules /
+policy_hysteresis the in-kernel equivalent).
+"""
+
+import json
+import os
+import time
+from pathlib import Path
+from typing import Any, Dict, Optional
+
+# Going down is judged with every percentage of the rules lowered by this
+# many points, so a load hovering at a threshold does not flip the level.
+BOOST_MARGIN = float(os.environ.get("ADAPTIVE_BOOST_MARGIN", "5"))
+
+# Seconds a level has to stay unjustified before it decays, one level at
+# a time (3 -> 0 takes three dwell periods). Going up is immediate.
+BOOST_DWELL = float(os.environ.get("ADAPTIVE_BOOST_DWELL", "1.0"))
+
+RULE_OFF = 101  # disables a percentage
+
+# level -> thresholds, same table as policy_rules in the module: a level
+# fires when avg_load >= avg, max_load >= max, target CPU % >= proc or
+# target runqueue wait % >= wait, or when memory used % >= mem together
+# with at least run running tasks. The highest firing level wins.
+DEFAULT_BOOST_RULES = (
+    (3, {"avg": RULE_OFF, "max": 90, "proc": 80, "mem": 90, "run": 8, "wait": RULE_OFF}),
+    (2, {"avg": 70, "max": RULE_OFF, "proc": 60, "mem": 80, "run": 6, "wait": 40}),
+    (1, {"avg": 40, "max": RULE_OFF, "proc": 30, "mem": 70, "run": 4, "wait": 20}),
+)
+RULE_KEYS = ("avg", "max", "proc", "mem", "run", "wait")
+# Bounded by RULE_OFF, as policy_rules in the module checks; proc (a
+# multi-threaded target may exceed 100 %) and run are only >= 0
+RULE_PCT_KEYS = ("avg", "max", "mem", "wait")
+RULE_INT_MAX = (1 << 31) - 1
+
+# A table in the same layout, as JSON ([[3, {"avg": 101, ...}], ...]),
+# replaces the default when present; fleet_agent.py saves pushed ones here.
+RULES_FILE = Path(os.environ.get("ADAPTIVE_RULES_FILE",
+                                 Path(__file__).resolve().parent / "rules.json"))
+
+
+def parse_rules(table) -> tuple:
+    """
+    Validate a decoded JSON rule table, highest level first. Accepts what
+    the module's policy_rules accepts, one entry per level.
+    """
+    rules = []
+    for level, r in table:
+        level = int(level)
+        if not 1 <= level <= 3:
+            raise ValueError(f"bad level {level}")
+        if any(level == lv for lv, _ in rules):
+            raise ValueError(f"level {level} given twice")
+        rule = {k: int(r.get(k, RULE_OFF)) for k in RULE_KEYS}
+        for k, v in rule.items():
+            if not 0 <= v <= (RULE_OFF if k in RULE_PCT_KEYS else RULE_INT_MAX):
+                raise ValueError(f"{k}={v} out of range for level {level}")
+        rules.append((level, rule))
+    return tuple(sorted(rules, key=lambda lr: lr[0], reverse=True))
+
+
+def load_rules(path: Path) -> Optional[tuple]:
+    """The rule table saved at path, None if there is none or it is bad."""
+    try:
+        return parse_rules(json.loads(Path(path).read_text()))
+    except FileNotFoundError:
+        return None
+    except (OSError, ValueError, TypeError, AttributeError) as e:
+        print(f"[WARN] Ignoring rule table {path}: {e}")
+        return None
+
+
+BOOST_RULES = load_rules(RULES_FILE) or DEFAULT_BOOST_RULES
+
+
+def _at_least(value: Optional[float], threshold: int, margin: float) -> bool:
+    return value is not None and threshold < RULE_OFF and value >= threshold - margin
+
+
+def decide_boost_level(avg_load: Optional[int],
+                       max_load: Optional[int],
+                       proc_cpu: Optional[float],
+                       features: Dict[str, Any],
+                       margin: float = 0.0,
+                       rules=BOOST_RULES) -> int:
+    """
+    Rule-based boost level from the kernel load, the target's CPU usage
+    and the system / process features (mem_used_pct, procs_running,
+    proc_wait_pct when the module's snapshot has it). margin lowers every
+    percentage threshold, see BoostTransition; rules replaces BOOST_RULES
+    (logs/simulate_policy.py tries variants of it).
+    """
+    if avg_load is None or max_load is None:
+        return 0
+
+    mem_used = features.get("mem_used_pct", 0.0)
+    procs_running = features.get("procs_running", 0)
+    wait = features.get("proc_wait_pct", 0)
+
+    for level, r in rules:
+        if _at_least(avg_load, r["avg"], margin) or \
+           _at_least(max_load, r["max"], margin) or \
+           _at_least(proc_cpu, r["proc"], margin) or \
+           _at_least(wait, r["wait"], margin) or \
+           (_at_least(mem_used, r["mem"], margin) and procs_running >= r["run"]):
+            return level
+
+    return 0
+
+
+def combine_hybrid(ml_boost: int, rule_boost: int) -> int:
+    """
+    Hybrid combination:
+    - If ML and rules are close (difference <= 1), trust ML.
+    - If ML strongly disagrees, keep rule-based decision as a safety net.
+    """
+    if abs(ml_boost - rule_boost) <= 1:
+        return ml_boost
+    return rule_boost
+
+
+class BoostTransition:
+    """
+    Rate-limit boost_level changes.
+
+    update() takes the decision made with the normal thresholds (raw) and
+    the one made with the lowered "down" thresholds (hold, >= raw):
+    - raw above the current level raises it at once;
+    - while hold still reaches the current level, the level is kept and
+      its dwell timer restarts;
+    - otherwise, once the level has gone unjustified for dwell seconds,
+      it drops by one level and the timer restarts.
+    """
+
+    def __init__(self, margin: float = BOOST_MARGIN, dwell: float = BOOST_DWELL):
+        self.margin = margin
+        self.dwell = dwell
+        self.level = 0
+        self.since = time.monotonic()
+
+    def reset(self, level: int = 0, now: Optional[float] = None):
+        self.level = level
+        self.since = time.monotonic() if now is None else now
+
+    def update(self, raw: int, hold: int, now: Optional[float] = None) -> int:
+        if now is None:
+            now = time.monotonic()
+
+        if raw > self.level:
+            self.level = raw
+            self.since = now
+        elif max(raw, hold) >= self.level:
+            self.since = now
+        elif now - self.since >= self.dwell:
+            self.level -= 1
+            self.since = now
+
+        return self.level
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+fleet.py — the UDP protocol between fleet_agent.py (one per host) and
+fleet_collector.py (central).
+
+Every datagram starts with a header, little endian:
+  magic b"AFLT", version, type, count, host (NUL-padded), seq, time_ns
+followed by the payload and, when a shared key is configured
+(ADAPTIVE_FLEET_KEY on both sides), an HMAC-SHA256 of header + payload.
+time_ns is the sender's wall clock; with a key, ReplayWindow drops
+datagrams more than ADAPTIVE_FLEET_MAX_SKEW seconds off and any
+(host, seq, time_ns) already seen, so a recorded datagram cannot be
+sent again later, not even after a restart. Without a key the agent
+only exports snapshots and never applies a policy.
+
+  SNAPSHOTS  agent -> collector; count snapshots. Payload: wall_offset
+             (double, seconds to add to timestamp_ns / 1e9) and the
+             zlib-compressed records, each a u16 length and a raw
+             struct adaptive_snapshot as read from the snapshot attribute
+  POLICY     collector -> agent, in reply to SNAPSHOTS while the host has
+             not acknowledged the current policy. Payload: policy id,
+             kind, chunk index, number of chunks, then one chunk of the
+             zlib-compressed policy (model.bin, or a rule table as JSON)
+  ACK        agent -> collector. Payload: policy id, status (0 applied,
+             otherwise a negative errno-like code)
+
+Lost datagrams are not retransmitted as such: snapshots are samples, and
+a policy keeps being re-sent with every reply until it is acknowledged.
+"""
+
+import hashlib
+import hmac
+import os
+import socket
+import struct
+import time
+import zlib
+from typing import Dict, Iterator, List, NamedTuple, Optional, Tuple
+
+FLEET_MAGIC = b"AFLT"
+FLEET_VERSION = 2
+DEFAULT_PORT = 7453
+
+HEADER = struct.Struct("<4sBBH32sQQ")
+MAC_SIZE = hashlib.sha256().digest_size
+MAX_DATAGRAM = 60000            # below the 64 KiB UDP limit
+POLICY_CHUNK = 32768
+
+MSG_SNAPSHOTS = 1
+MSG_POLICY = 2
+MSG_ACK = 3
+
+SNAPSHOTS_HEAD = struct.Struct("<d")
+RECORD_LEN = struct.Struct("<H")
+POLICY_HEAD = struct.Struct("<IBHH")
+ACK = struct.Struct("<Ii")
+
+POLICY_MODEL = 1                # model.bin (logs/export_model.py)
+POLICY_RULES = 2                # rule table, boost_policy.py JSON layout
+POLICY_KINDS = {POLICY_MODEL: "model", POLICY_RULES: "rules"}
+
+ACK_OK = 0
+ACK_INVALID = -22               # -EINVAL: did not decode or validate
+ACK_FAILED = -5                 # -EIO: valid, but could not be saved
+
+MAX_INFLATED = 16 << 20         # decompressed size limit of any payload
+
+# seconds a signed datagram may be off the receiver's clock
+MAX_SKEW = float(os.environ.get("ADAPTIVE_FLEET_MAX_SKEW", "30"))
+
+
+def inflate(data: bytes) -> bytes:
+    """zlib.decompress() bounded by MAX_INFLATED."""
+    d = zlib.decompressobj()
+    out = d.decompress(data, MAX_INFLATED)
+    if d.unconsumed_tail:
+        raise ValueError("payload too large")
+    return out
+
+
+def fleet_key() -> Optional[bytes]:
+    key = os.environ.get("ADAPTIVE_FLEET_KEY")
+    return key.encode() if key else None
+
+
+def host_name() -> str:
+    return os.environ.get("ADAPTIVE_FLEET_HOST", socket.gethostname())[:32]
+
+
+def parse_address(value: str) -> Tuple[str, int]:
+    """"host:port" or "host" (default port)."""
+    host, _, port = value.rpartition(":")
+    if not host:
+        return value, DEFAULT_PORT
+    return host.strip("[]"), int(port)
+
+
+def pack(msg_type: int, count: int, host: str, seq: int, payload: bytes,
+         key: Optional[bytes]) -> bytes:
+    data = HEADER.pack(FLEET_MAGIC, FLEET_VERSION, msg_type, count,
+                       host.encode()[:32], seq, time.time_ns()) + payload
+    if key:
+        data += hmac.new(key, data, hashlib.sha256).digest()
+    return data
+
+
+class Message(NamedTuple):
+    msg_type: int
+    count: int
+    host: str
+    seq: int
+    time_ns: int
+    payload: bytes
+
+
+def unpack(data: bytes, key: Optional[bytes]) -> Optional[Message]:
+    """The datagram's Message, None if malformed or not authentic."""
+    if len(data) < HEADER.size + (MAC_SIZE if key else 0):
+        return None
+    if key:
+        data, mac = data[:-MAC_SIZE], data[-MAC_SIZE:]
+        if not hmac.compare_digest(mac, hmac.new(key, data, hashlib.sha256).digest()):
+            return None
+    magic, version, msg_type, count, host, seq, time_ns = HEADER.unpack_from(data)
+    if magic != FLEET_MAGIC or version != FLEET_VERSION:
+        return None
+    return Message(msg_type, count, host.rstrip(b"\0").decode(errors="replace"),
+                   seq, time_ns, data[HEADER.size:])
+
+
+class ReplayWindow:
+    """Accept every signed datagram once, and only while it is recent."""
+
+    def __init__(self, max_skew: float = MAX_SKEW):
+        self.max_skew_ns = int(max_skew * 1e9)
+        self.seen: Dict[Tuple[str, int, int], int] = {}
+        self.pruned_ns = 0
+
+    def accept(self, msg: Message) -> bool:
+        now = time.time_ns()
+        if abs(now - msg.time_ns) > self.max_skew_ns:
+            return False
+        # older entries fail the skew check anyway
+        if now - self.pruned_ns > self.max_skew_ns:
+            self.seen = {k: t for k, t in self.seen.items()
+                         if now - t <= self.max_skew_ns}
+            self.pruned_ns = now
+        key = (msg.host, msg.seq, msg.time_ns)
+        if key in self.seen:
+            return False
+        self.seen[key] = msg.time_ns
+        return True
+
+
+# ----------------------------
+# SNAPSHOTS
+# ----------------------------
+
+def snapshot_payloads(records: List[bytes], wall_offset: float) -> Iterator[Tuple[int, bytes]]:
+    """(count, payload) of as few datagrams as fit the records."""
+    if not records:
+        return
+    raw = b"".join(RECORD_LEN.pack(len(r)) + r for r in records)
+    payload = SNAPSHOTS_HEAD.pack(wall_offset) + zlib.compress(raw)
+    if len(payload) + HEADER.size + MAC_SIZE <= MAX_DATAGRAM or len(records) == 1:
+        yield len(records), payload
+        return
+    half = len(records) // 2
+    yield from snapshot_payloads(records[:half], wall_offset)
+    yield from snapshot_payloads(records[half:], wall_offset)
+
+
+def decode_snapshots(payload: bytes) -> Tuple[float, List[bytes]]:
+    (wall_offset,) = SNAPSHOTS_HEAD.unpack_from(payload)
+    raw = inflate(payload[SNAPSHOTS_HEAD.size:])
+    records, off = [], 0
+    while off + RECORD_LEN.size <= len(raw):
+        (n,) = RECORD_LEN.unpack_from(raw, off)
+        off += RECORD_LEN.size
+        records.append(raw[off:off + n])
+        off += n
+    return wall_offset, records
+
+
+# ----------------------------
+# POLICY / ACK
+# ----------------------------
+
+def policy_payloads(policy_id: int, kind: int, blob: bytes) -> List[bytes]:
+    data = zlib.compress(blob)
+    chunks = [data[i:i + POLICY_CHUNK] for i in range(0, len(data), POLICY_CHUNK)] or [b""]
+    return [POLICY_HEAD.pack(policy_id, kind, i, len(chunks)) + c
+            for i, c in enumerate(chunks)]
+
+
+class PolicyAssembler:
+    """Collect POLICY chunks; feed() returns (id, kind, blob) once complete."""
+
+    def __init__(self):
+        # policy id -> (kind, number of chunks, chunks received)
+        self.pending: Dict[int, Tuple[int, int, Dict[int, bytes]]] = {}
+
+    def feed(self, payload: bytes) -> Optional[Tuple[int, int, bytes]]:
+        policy_id, kind, index, nr_chunks = POLICY_HEAD.unpack_from(payload)
+        kind, nr_chunks, chunks = self.pending.setdefault(policy_id, (kind, nr_chunks, {}))
+        if index >= nr_chunks:
+            return None
+        chunks[index] = payload[POLICY_HEAD.size:]
+        if len(chunks) < nr_chunks:
+            return None
+
+        del self.pending[policy_id]
+        return policy_id, kind, inflate(b"".join(chunks[i] for i in range(nr_chunks)))
@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+"""
+fleet_agent.py — stream this host's snapshots to a fleet collector
+(fleet_collector.py) and apply the policies it pushes back.
+
+Runs next to the controller or daemon. Every --interval seconds it reads
+the module's snapshot attribute (the same compact struct the controllers
+read, skipped when no new sample was taken) and sends them in batches of
+--batch, zlib-compressed, over UDP (see fleet.py).
+
+Policies are applied only when ADAPTIVE_FLEET_KEY is set, and then only
+from the collector's address, with a valid HMAC and not replayed (see
+fleet.py). Without a key the agent exports snapshots and ignores every
+pushed policy, since a UDP source address is easily spoofed. A policy
+is checked as the module checks it, loaded into the module, and saved
+only once the module took it:
+  model  ModelTables, uploaded to policy_model (policy_mode "model"),
+         saved to ADAPTIVE_MODEL_BIN (model.bin next to this script)
+         for the ml / hybrid modes
+  rules  boost_policy.parse_rules(), written to policy_rules (policy_mode
+         "kernel", levels left out never fire), saved to
+         ADAPTIVE_RULES_FILE (rules.json) for the base / hybrid modes
+The module switches at once. adaptive_controller.py and adaptive_ctl
+read model.bin and rules.json when they start, adaptive_daemon.py
+rules.json, so they pick a pushed policy up on their next restart
+without a redeploy. A policy equal to the saved file is acknowledged
+without applying it again: a restarted collector pushes until every
+host ACKs, and a restarted agent no longer knows what it applied.
+
+  sudo ADAPTIVE_FLEET_COLLECTOR=collector.example:7453 ./fleet_agent.py
+"""
+
+import argparse
+import json
+import os
+import select
+import socket
+import struct
+import time
+from pathlib import Path
+from typing import List, Optional, Set
+
+from boost_policy import RULE_KEYS, RULE_OFF, RULES_FILE, load_rules, parse_rules
+from fleet import (ACK, ACK_FAILED, ACK_INVALID, ACK_OK, MSG_ACK, MSG_POLICY,
+                   MSG_SNAPSHOTS, POLICY_KINDS, POLICY_MODEL, POLICY_RULES,
+                   PolicyAssembler, ReplayWindow, fleet_key, host_name, pack,
+                   parse_address, snapshot_payloads, unpack)
+from model_tables import ModelTables
+
+SCRIPT_DIR = Path(__file__).resolve().parent
+SYSFS_BASE = Path("/sys/kernel/adaptive_sched")
+PATH_SNAPSHOT = SYSFS_BASE / "snapshot"
+PATH_POLICY_MODEL = SYSFS_BASE / "policy_model"
+PATH_POLICY_RULES = SYSFS_BASE / "policy_rules"
+MODEL_BIN_PATH = Path(os.environ.get("ADAPTIVE_MODEL_BIN", SCRIPT_DIR / "model.bin"))
+
+# timestamp_ns and seq of struct adaptive_snapshot
+SNAPSHOT_TIME_SEQ = struct.Struct("<16xQQ")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Adaptive scheduler fleet agent")
+    parser.add_argument("--collector", type=str,
+                        default=os.environ.get("ADAPTIVE_FLEET_COLLECTOR"),
+                        help="host[:port] of fleet_collector.py")
+    parser.add_argument("--interval", type=float,
+                        default=float(os.environ.get("ADAPTIVE_FLEET_INTERVAL", "1.0")),
+                        help="seconds between snapshot reads")
+    parser.add_argument("--batch", type=int,
+                        default=int(os.environ.get("ADAPTIVE_FLEET_BATCH", "30")),
+                        help="snapshots per datagram")
+    return parser.parse_args()
+
+
+def save_atomic(path: Path, data: bytes):
+    tmp = path.with_name(f".{path.name}.tmp")
+    tmp.write_bytes(data)
+    os.replace(tmp, path)
+
+
+def apply_model(blob: bytes) -> int:
+    try:
+        tables = ModelTables(blob)
+    except (ValueError, struct.error) as e:
+        print(f"[WARN] Rejected pushed model: {e}")
+        return ACK_INVALID
+    try:
+        if MODEL_BIN_PATH.read_bytes() == blob:
+            print(f"[INFO] Pushed model is already {MODEL_BIN_PATH}")
+            return ACK_OK
+    except OSError:
+        pass
+    try:
+        # the module first: the file is only replaced by a model it took
+        if PATH_POLICY_MODEL.exists():
+            with PATH_POLICY_MODEL.open("wb") as f:
+                f.write(blob)
+        save_atomic(MODEL_BIN_PATH, blob)
+    except OSError as e:
+        print(f"[ERROR] Failed to apply pushed model: {e}")
+        return ACK_FAILED
+    print(f"[INFO] Model applied ({len(tables.roots)} trees) -> {MODEL_BIN_PATH}")
+    return ACK_OK
+
+
+def rule_lines(rules) -> List[str]:
+    """policy_rules lines for levels 1..3, levels not in rules never fire."""
+    table = dict(rules)
+    lines = []
+    for level in (1, 2, 3):
+        r = table.get(level, dict.fromkeys(RULE_KEYS, RULE_OFF))
+        lines.append(f"{level} {r['avg']} {r['max']} {r['proc']} {r['mem']} "
+                     f"{r['run']} {r['wait']}\n")
+    return lines
+
+
+def write_rule_lines(lines: List[str]):
+    for line in lines:
+        PATH_POLICY_RULES.write_text(line)
+
+
+def apply_rules(blob: bytes) -> int:
+    try:
+        rules = parse_rules(json.loads(blob))
+    except (ValueError, TypeError, AttributeError) as e:
+        print(f"[WARN] Rejected pushed rules: {e}")
+        return ACK_INVALID
+    if load_rules(RULES_FILE) == rules:
+        print(f"[INFO] Pushed rules are already {RULES_FILE}")
+        return ACK_OK
+    try:
+        if PATH_POLICY_RULES.exists():
+            previous = PATH_POLICY_RULES.read_text().splitlines(keepends=True)
+            try:
+                write_rule_lines(rule_lines(rules))
+            except OSError:
+                # one line per level: put back the levels already changed
+                write_rule_lines(previous)
+                raise
+        save_atomic(RULES_FILE, json.dumps([[level, r] for level, r in rules]).encode())
+    except OSError as e:
+        print(f"[ERROR] Failed to apply pushed rules: {e}")
+        return ACK_FAILED
+    print(f"[INFO] Rules applied ({len(rules)} levels) -> {RULES_FILE}")
+    return ACK_OK
+
+
+APPLY = {POLICY_MODEL: apply_model, POLICY_RULES: apply_rules}
+
+
+class FleetAgent:
+    def __init__(self, collector: str, batch: int):
+        host, port = parse_address(collector)
+        info = socket.getaddrinfo(host, port, type=socket.SOCK_DGRAM)[0]
+        self.sock = socket.socket(info[0], socket.SOCK_DGRAM)
+        self.sock.connect(info[4])      # drops datagrams from anyone else
+        self.key = fleet_key()
+        self.host = host_name()
+        self.batch = batch
+        self.seq = 0
+        self.records: List[bytes] = []
+        self.last_seq: Optional[int] = None
+        self.assembler = PolicyAssembler()
+        self.replay = ReplayWindow()
+        self.applied: Set[int] = set()
+        self.fd = os.open(PATH_SNAPSHOT, os.O_RDONLY)
+
+    def send(self, msg_type: int, count: int, payload: bytes):
+        self.seq += 1
+        try:
+            self.sock.send(pack(msg_type, count, self.host, self.seq, payload, self.key))
+        except OSError as e:
+            # collector down or unreachable: keep sampling, try again later
+            print(f"[WARN] Send to collector failed: {e}")
+
+    def sample(self):
+        data = os.pread(self.fd, 4096, 0)
+        if len(data) < SNAPSHOT_TIME_SEQ.size:
+            return
+        _, seq = SNAPSHOT_TIME_SEQ.unpack_from(data)
+        if seq == self.last_seq:
+            return
+        self.last_seq = seq
+        self.records.append(data)
+        if len(self.records) >= self.batch:
+            self.flush()
+
+    def flush(self):
+        wall_offset = time.time() - time.clock_gettime(time.CLOCK_BOOTTIME)
+        for count, payload in snapshot_payloads(self.records, wall_offset):
+            self.send(MSG_SNAPSHOTS, count, payload)
+        self.records = []
+
+    def receive(self):
+        try:
+            data = self.sock.recv(65536)
+        except OSError:
+            return
+        if not self.key:
+            return                  # export only, see the docstring
+        msg = unpack(data, self.key)
+        if msg is None or msg.msg_type != MSG_POLICY or not self.replay.accept(msg):
+            return
+        try:
+            done = self.assembler.feed(msg.payload)
+        except (ValueError, struct.error) as e:
+            print(f"[WARN] Dropped a bad policy datagram: {e}")
+            return
+        if done is None:
+            return
+
+        policy_id, kind, blob = done
+        if policy_id in self.applied:
+            status = ACK_OK         # our earlier ACK was lost
+        elif kind in APPLY:
+            print(f"[INFO] Received {POLICY_KINDS[kind]} policy {policy_id:#010x}")
+            status = APPLY[kind](blob)
+            if status == ACK_OK:
+                self.applied.add(policy_id)
+        else:
+            status = ACK_INVALID
+        self.send(MSG_ACK, 1, ACK.pack(policy_id, status))
+
+    def run(self, interval: float):
+        next_sample = time.monotonic()
+        while True:
+            timeout = max(0.0, next_sample - time.monotonic())
+            readable, _, _ = select.select([self.sock], [], [], timeout)
+            if readable:
+                self.receive()
+                continue
+            self.sample()
+            next_sample += interval
+            if next_sample < time.monotonic():
+                next_sample = time.monotonic() + interval
+
+
+def main():
+    args = parse_args()
+    if not args.collector:
+        print("[ERROR] No collector: set ADAPTIVE_FLEET_COLLECTOR or --collector")
+        raise SystemExit(1)
+    if args.interval <= 0 or args.batch < 1:
+        print("[ERROR] --interval must be > 0 and --batch >= 1")
+        raise SystemExit(1)
+
+    try:
+        agent = FleetAgent(args.collector, args.batch)
+    except OSError as e:
+        print(f"[ERROR] {e}")
+        raise SystemExit(1)
+
+    print(f"[INFO] Fleet agent {agent.host} -> {args.collector} "
+          f"(every {args.interval:g}s, {args.batch} per datagram, "
+          f"{'signed' if agent.key else 'unsigned'})")
+    if not agent.key:
+        print("[WARN] ADAPTIVE_FLEET_KEY not set: exporting snapshots only, "
+              "pushed policies are ignored")
+    try:
+        agent.run(args.interval)
+    except KeyboardInterrupt:
+        agent.flush()
+        print("\n[INFO] Fleet agent stopped by user")
+
+
+if __name__ == "__main__":
+    main()
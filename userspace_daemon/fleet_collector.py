@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+"""
+fleet_collector.py — receive the snapshots of every fleet_agent.py and
+push policies back to them (protocol in fleet.py).
+
+Snapshots are appended per host to <output-dir>/<host>.alog, the binary
+log format of adaptive_daemon.py, so the usual tools work on fleet data:
+  logs/binlog_to_csv.py --input fleet_logs/web1.alog      (CSV per host)
+  logs/simulate_policy.py --input fleet_logs/*.alog       (replay)
+and the CSVs feed prepare_dataset.py / train_model.py / export_model.py.
+
+--model and --rules name the policy to roll out: a model.bin and / or a
+rule table in the boost_policy.py JSON layout. Every host gets it in
+reply to its snapshots until it acknowledges it; editing or replacing
+the file rolls out the new version (the policy id is the CRC of the
+content). Acknowledgements are only kept in memory: a restarted
+collector pushes every policy again until each host ACKs it, and the
+agents acknowledge one equal to what they have saved without applying it.
+Pushing needs ADAPTIVE_FLEET_KEY on both sides: agents without a key
+only export their snapshots.
+
+  ./fleet_collector.py --listen 0.0.0.0:7453 --model model.bin
+"""
+
+import argparse
+import re
+import socket
+import struct
+import time
+import zlib
+from pathlib import Path
+from typing import Dict, List, Optional, Set, Tuple
+
+from binlog import SNAPSHOT, SNAPSHOT_FIELDS, BinlogWriter
+from fleet import (ACK, DEFAULT_PORT, MSG_ACK, MSG_POLICY, MSG_SNAPSHOTS,
+                   POLICY_KINDS, POLICY_MODEL, POLICY_RULES, ReplayWindow,
+                   decode_snapshots, fleet_key, pack, parse_address,
+                   policy_payloads, unpack)
+
+COLLECTOR_HOST = "collector"
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Adaptive scheduler fleet collector")
+    parser.add_argument("--listen", type=str, default=f"0.0.0.0:{DEFAULT_PORT}")
+    parser.add_argument("--output-dir", type=str, default="fleet_logs")
+    parser.add_argument("--model", type=str, default=None,
+                        help="model.bin to push (logs/export_model.py)")
+    parser.add_argument("--rules", type=str, default=None,
+                        help="rule table JSON to push")
+    parser.add_argument("--stats-interval", type=float, default=60.0,
+                        help="seconds between per-host summaries, 0 disables")
+    return parser.parse_args()
+
+
+class PolicyFile:
+    """A policy to roll out, re-read whenever the file changes."""
+
+    def __init__(self, path: str, kind: int):
+        self.path = Path(path)
+        self.kind = kind
+        self.mtime: Optional[float] = None
+        self.policy_id: Optional[int] = None
+        self.payloads: List[bytes] = []
+
+    def refresh(self) -> bool:
+        """Reload if modified. Returns True when the content changed."""
+        try:
+            mtime = self.path.stat().st_mtime
+            if mtime == self.mtime:
+                return False
+            blob = self.path.read_bytes()
+        except OSError as e:
+            print(f"[WARN] Cannot read {self.path}: {e}")
+            return False
+        self.mtime = mtime
+
+        policy_id = zlib.crc32(bytes([self.kind]) + blob)
+        if policy_id == self.policy_id:
+            return False
+        self.policy_id = policy_id
+        self.payloads = policy_payloads(policy_id, self.kind, blob)
+        print(f"[INFO] Rolling out {POLICY_KINDS[self.kind]} policy {policy_id:#010x} "
+              f"from {self.path} ({len(blob)} bytes, {len(self.payloads)} datagrams)")
+        return True
+
+
+class Host:
+    def __init__(self, name: str, output_dir: Path):
+        self.name = name
+        self.path = output_dir / (re.sub(r"[^A-Za-z0-9_.-]", "_", name) + ".alog")
+        self.writer = BinlogWriter(self.path, 0)
+        self.addr: Optional[Tuple] = None
+        self.acked: Set[int] = set()
+        self.snapshots = 0
+        self.datagrams = 0
+        self.last_seq = 0
+        self.lost = 0
+        self.last_seen = 0.0
+
+
+def decode_record(raw: bytes) -> Optional[Dict[str, int]]:
+    if len(raw) < 8:
+        return None
+    # older modules send a shorter snapshot: the missing fields read as 0
+    rec = dict(zip(SNAPSHOT_FIELDS,
+                   SNAPSHOT.unpack(raw[:SNAPSHOT.size].ljust(SNAPSHOT.size, b"\0"))))
+    rec["dropped"] = 0
+    return rec
+
+
+class Collector:
+    def __init__(self, listen: str, output_dir: Path, policies: List[PolicyFile]):
+        host, port = parse_address(listen)
+        info = socket.getaddrinfo(host, port, type=socket.SOCK_DGRAM,
+                                  flags=socket.AI_PASSIVE)[0]
+        self.sock = socket.socket(info[0], socket.SOCK_DGRAM)
+        self.sock.bind(info[4])
+        self.key = fleet_key()
+        self.replay = ReplayWindow()
+        self.output_dir = output_dir
+        self.policies = policies
+        self.hosts: Dict[str, Host] = {}
+        self.seq = 0
+
+    def send(self, host: Host, msg_type: int, count: int, payload: bytes):
+        self.seq += 1
+        try:
+            self.sock.sendto(pack(msg_type, count, COLLECTOR_HOST, self.seq, payload,
+                                  self.key), host.addr)
+        except OSError as e:
+            print(f"[WARN] Send to {host.name} failed: {e}")
+
+    def host(self, name: str) -> Host:
+        if name not in self.hosts:
+            self.hosts[name] = Host(name, self.output_dir)
+            print(f"[INFO] New host {name} -> {self.hosts[name].path}")
+        return self.hosts[name]
+
+    def on_snapshots(self, host: Host, payload: bytes):
+        wall_offset, raw = decode_snapshots(payload)
+        records = [(rec, []) for rec in map(decode_record, raw) if rec is not None]
+        host.snapshots += host.writer.append(records, wall_offset)
+
+        for policy in self.policies:
+            if policy.policy_id is not None and policy.policy_id not in host.acked:
+                for p in policy.payloads:
+                    self.send(host, MSG_POLICY, 1, p)
+
+    def on_ack(self, host: Host, payload: bytes):
+        policy_id, status = ACK.unpack_from(payload)
+        if status == 0:
+            if policy_id not in host.acked:
+                print(f"[INFO] {host.name} applied policy {policy_id:#010x}")
+            host.acked.add(policy_id)
+        else:
+            print(f"[WARN] {host.name} rejected policy {policy_id:#010x} ({status})")
+            host.acked.add(policy_id)  # do not keep pushing what it cannot take
+
+    def receive(self):
+        data, addr = self.sock.recvfrom(65536)
+        msg = unpack(data, self.key)
+        if msg is None or (self.key and not self.replay.accept(msg)):
+            return
+        msg_type, name, seq, payload = msg.msg_type, msg.host, msg.seq, msg.payload
+        host = self.host(name)
+        host.addr = addr
+        host.datagrams += 1
+        host.last_seen = time.time()
+        # every agent datagram takes the next seq; a restarted agent starts over
+        if host.last_seq and host.last_seq < seq:
+            host.lost += seq - host.last_seq - 1
+        host.last_seq = seq
+        try:
+            if msg_type == MSG_SNAPSHOTS:
+                self.on_snapshots(host, payload)
+            elif msg_type == MSG_ACK:
+                self.on_ack(host, payload)
+        except (ValueError, struct.error, zlib.error) as e:
+            print(f"[WARN] Bad datagram from {name} {addr}: {e}")
+
+    def print_stats(self):
+        now = time.time()
+        for h in self.hosts.values():
+            print(f"[INFO] {h.name}: {h.snapshots} snapshots in {h.datagrams} datagrams, "
+                  f"{h.lost} lost, last seen {now - h.last_seen:.0f}s ago")
+
+    def run(self, stats_interval: float):
+        next_stats = time.monotonic() + stats_interval
+        self.sock.settimeout(1.0)
+        while True:
+            try:
+                self.receive()
+            except socket.timeout:
+                pass
+            for policy in self.policies:
+                policy.refresh()
+            if stats_interval > 0 and time.monotonic() >= next_stats:
+                self.print_stats()
+                next_stats += stats_interval
+
+
+def main():
+    args = parse_args()
+    output_dir = Path(args.output_dir)
+    output_dir.mkdir(parents=True, exist_ok=True)
+
+    policies = []
+    if (args.model or args.rules) and not fleet_key():
+        print("[ERROR] --model / --rules need ADAPTIVE_FLEET_KEY: agents apply "
+              "only signed policies")
+        raise SystemExit(1)
+    if args.model:
+        policies.append(PolicyFile(args.model, POLICY_MODEL))
+    if args.rules:
+        policies.append(PolicyFile(args.rules, POLICY_RULES))
+    for policy in policies:
+        policy.refresh()
+
+    collector = Collector(args.listen, output_dir, policies)
+    print(f"[INFO] Fleet collector listening on {args.listen}, logs in "
+          f"{output_dir.resolve()} ({'signed' if collector.key else 'unsigned'})")
+    try:
+        collector.run(args.stats_interval)
+    except KeyboardInterrupt:
+        collector.print_stats()
+        for h in collector.hosts.values():
+            h.writer.close()
+        print("\n[INFO] Fleet collector stopped by user")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""
+binlog_to_csv.py — convert the daemon's binary log (metrics_log.alog,
+ADAPTIVE_LOG_FORMAT=binary) to the CSV schema of metrics_log.csv, so
+prepare_dataset.py and train_model.py work on it unchanged.
+
+Like the CSV log, only samples with a target are written. proc_cpu is
+the target's CPU time between consecutive samples, so the first sample
+of every target is skipped. --per-cpu appends the runqueue and per-CPU
+columns the binary log carries on top of the CSV schema.
+"""
+
+import argparse
+import csv
+import sys
+from pathlib import Path
+from typing import Iterator, List, Tuple
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+from binlog import SNAP_HAVE_TARGET, read_binlog  # noqa: E402
+
+CSV_FIELDS = [
+    "avg_load", "max_load", "proc_cpu", "target_pid", "mem_used_pct",
+    "procs_running", "procs_blocked", "loadavg1", "loadavg5", "loadavg15",
+    "psi_cpu_some", "psi_cpu_full", "proc_vms_kb", "proc_rss_kb",
+    "proc_threads", "proc_read_bytes", "proc_write_bytes", "boost_level",
+    "timestamp",
+]
+
+EXTRA_FIELDS = ["rq_waiting", "rq_max_depth", "wait_pct", "proc_wait_pct"]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Convert metrics_log.alog to CSV")
+    parser.add_argument("--input", type=str, default="metrics_log.alog")
+    parser.add_argument("--output", type=str, default="metrics_log_bin.csv")
+    parser.add_argument("--per-cpu", action="store_true",
+                        help="append runqueue and per-CPU columns")
+    return parser.parse_args()
+
+
+def iter_rows(input_path: Path, extra: bool = False,
+              per_cpu: bool = False) -> Iterator[Tuple[List[str], list]]:
+    """
+    Yield (field names, row) for every sample of an .alog file that has a
+    target, in the CSV schema plus EXTRA_FIELDS (extra) and the per-CPU
+    columns (per_cpu). Also used by simulate_policy.py.
+    """
+    prev = None  # (target_pid, timestamp_ns, proc_runtime_ns) of the last sample
+
+    for names, c, wall_offset in read_binlog(input_path):
+        cpu_fields = [n for n in names if n.startswith("cpu")] if per_cpu else []
+        extra_fields = EXTRA_FIELDS if extra or per_cpu else []
+        fields = CSV_FIELDS + extra_fields + cpu_fields
+
+        for i in range(len(c["seq"])):
+            pid, ts, runtime = c["target_pid"][i], c["timestamp_ns"][i], \
+                c["proc_runtime_ns"][i]
+            if not c["flags"][i] & SNAP_HAVE_TARGET:
+                prev = None
+                continue
+            last, prev = prev, (pid, ts, runtime)
+            if last is None or last[0] != pid or ts <= last[1]:
+                continue
+
+            total = c["mem_total_kb"][i]
+            row = [
+                c["avg_load"][i],
+                c["max_load"][i],
+                round((runtime - last[2]) * 100.0 / (ts - last[1]), 1),
+                pid,
+                (1.0 - c["mem_available_kb"][i] / total) * 100.0 if total else 0.0,
+                c["procs_running"][i],
+                c["procs_blocked"][i],
+                c["loadavg1"][i] / 100.0,
+                c["loadavg5"][i] / 100.0,
+                c["loadavg15"][i] / 100.0,
+                c["psi_cpu_some"][i] / 100.0,
+                c["psi_cpu_full"][i] / 100.0,
+                c["proc_vms_kb"][i],
+                c["proc_rss_kb"][i],
+                c["proc_threads"][i],
+                c["proc_read_bytes"][i],
+                c["proc_write_bytes"][i],
+                c["boost_level"][i],
+                ts / 1e9 + wall_offset,
+            ]
+            row += [c[n][i] for n in extra_fields + cpu_fields]
+            yield fields, row
+
+
+def convert(input_path: Path, output_path: Path, per_cpu: bool) -> int:
+    rows = 0
+    writer = None
+
+    with output_path.open("w", newline="") as f:
+        for fields, row in iter_rows(input_path, per_cpu=per_cpu):
+            if writer is None:
+                writer = csv.writer(f)
+                writer.writerow(fields)
+            writer.writerow(row)
+            rows += 1
+
+    return rows
+
+
+def main():
+    args = parse_args()
+    input_path = Path(args.input)
+    output_path = Path(args.output)
+
+    if not input_path.exists():
+        print(f"[ERROR] File not found: {input_path}")
+        sys.exit(1)
+
+    print(f"[INFO] Loading: {input_path}")
+    try:
+        rows = convert(input_path, output_path, args.per_cpu)
+    except ValueError as e:
+        print(f"[ERROR] {e}")
+        sys.exit(1)
+    print(f"[INFO] {rows} rows -> {output_path.resolve()}")
+
+
+if __name__ == "__main__":
+    main()
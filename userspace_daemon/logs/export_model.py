@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""
+export_model.py — convert model.pkl (RandomForestClassifier from
+train_model.py) into model.bin: flat, integer tree tables for the native
+controller, the Python controller and the module's policy_model
+(format in adaptive_sched_uapi.h, reader in ../model_tables.py).
+"""
+
+import argparse
+import math
+import struct
+import sys
+from pathlib import Path
+
+import joblib
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+from model_tables import (  # noqa: E402
+    FEATURE_IDS, FEATURES, MODEL_FEATURE, MODEL_HEADER, MODEL_LEAF,
+    MODEL_MAGIC, MODEL_MAX_CLASSES, MODEL_NODE, MODEL_ROOT, MODEL_VERSION,
+    ModelTables, nodes_offset,
+)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Export model.pkl to model.bin")
+    parser.add_argument("--input", type=str, default="../model.pkl")
+    parser.add_argument("--output", type=str, default="../model.bin")
+    parser.add_argument("--check", type=str, default=None,
+                        help="CSV (e.g. metrics_clean.csv) to compare predictions on")
+    return parser.parse_args()
+
+
+def split_threshold(threshold: float, scale: int) -> int:
+    """x <= threshold  ->  floor(x * scale) <= floor(threshold * scale)."""
+    return math.floor(threshold * scale)
+
+
+def pack_leaf(value) -> int:
+    """Class weights of a leaf, 16 bits each, as a signed 64-bit value."""
+    total = float(sum(value))
+    bits = 0
+    for c, v in enumerate(value):
+        w = round(v / total * 0xFFFF) if total > 0 else 0
+        bits |= w << (16 * c)
+    return bits - (1 << 64) if bits >= 1 << 63 else bits
+
+
+def flatten_tree(tree, scales, nodes):
+    """Append one sklearn tree to nodes in preorder, return its root index."""
+    root = len(nodes)
+    stack = [(0, None)]  # (sklearn node, index of the parent waiting for .right)
+
+    while stack:
+        n, parent = stack.pop()
+        index = len(nodes)
+        if parent is not None:
+            threshold, feature, _ = nodes[parent]
+            nodes[parent] = (threshold, feature, index)
+
+        left, right = tree.children_left[n], tree.children_right[n]
+        if left == right:  # leaf
+            nodes.append((pack_leaf(tree.value[n][0]), MODEL_LEAF, 0))
+            continue
+
+        feature = int(tree.feature[n])
+        nodes.append((split_threshold(tree.threshold[n], scales[feature]), feature, 0))
+        # Right is patched in when it is emitted, after the whole left subtree
+        stack.append((right, index))
+        stack.append((left, None))
+
+    return root
+
+
+def export(model) -> bytes:
+    names = list(model.feature_names_in_)
+    unknown = [n for n in names if n not in FEATURE_IDS]
+    if unknown:
+        raise ValueError(f"features without a model id: {unknown}")
+
+    classes = [int(c) for c in model.classes_]
+    if len(classes) > MODEL_MAX_CLASSES or any(not 0 <= c <= 255 for c in classes):
+        raise ValueError(f"unsupported classes {classes}")
+
+    scales = [FEATURES[FEATURE_IDS[n]][1] for n in names]
+    nodes, roots = [], []
+    for est in model.estimators_:
+        roots.append(flatten_tree(est.tree_, scales, nodes))
+
+    nodes_off = nodes_offset(MODEL_HEADER.size, len(names), len(roots))
+    total = nodes_off + len(nodes) * MODEL_NODE.size
+
+    out = bytearray(total)
+    padded = classes + [0] * (MODEL_MAX_CLASSES - len(classes))
+    MODEL_HEADER.pack_into(out, 0, MODEL_MAGIC, MODEL_VERSION, MODEL_HEADER.size,
+                           total, len(names), len(roots), len(nodes),
+                           len(classes), *padded, 0)
+
+    off = MODEL_HEADER.size
+    for name, scale in zip(names, scales):
+        MODEL_FEATURE.pack_into(out, off, FEATURE_IDS[name], scale)
+        off += MODEL_FEATURE.size
+    for r in roots:
+        MODEL_ROOT.pack_into(out, off, r)
+        off += MODEL_ROOT.size
+    for i, node in enumerate(nodes):
+        MODEL_NODE.pack_into(out, nodes_off + i * MODEL_NODE.size, *node)
+
+    return bytes(out)
+
+
+def check(model, tables: ModelTables, csv_path: Path):
+    import pandas as pd
+
+    df = pd.read_csv(csv_path)
+    X = df[list(model.feature_names_in_)]
+    expected = model.predict(X)
+    got = [tables.predict(row) for row in X.to_dict("records")]
+    same = sum(int(a) == b for a, b in zip(expected, got))
+    print(f"[RESULT] Agreement with sklearn on {csv_path}: {same}/{len(got)} "
+          f"({same / max(len(got), 1) * 100:.2f}%)")
+
+
+def main():
+    args = parse_args()
+    input_path = Path(args.input)
+    output_path = Path(args.output)
+
+    if not input_path.exists():
+        print(f"[ERROR] File not found: {input_path}")
+        sys.exit(1)
+
+    print(f"[INFO] Loading: {input_path}")
+    model = joblib.load(input_path)
+
+    data = export(model)
+    tables = ModelTables(data)  # round-trip through the reader
+    output_path.write_bytes(data)
+    print(f"[INFO] {len(tables.roots)} trees, {len(tables.nodes)} nodes, "
+          f"{len(data)} bytes -> {output_path.resolve()}")
+
+    if args.check:
+        check(model, tables, Path(args.check))
+
+
+if __name__ == "__main__":
+    main()
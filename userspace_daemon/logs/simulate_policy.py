@@ -0,0 +1,303 @@
+#!/usr/bin/env python3
+"""
+simulate_policy.py — replay recorded metrics through the boost policies
+offline, to compare policy variants without a benchmark run per variant.
+
+Input is any mix of metrics_log.csv files (adaptive_daemon.py,
+adaptive_ctl) and binary .alog logs (ADAPTIVE_LOG_FORMAT=binary). Every
+sample goes through the same code the controller runs:
+decide_boost_level() / the exported trees / combine_hybrid() for the
+decision, then BoostTransition with the sample timestamps as its clock.
+
+A variant is a policy (base, ml, hybrid) with a margin, a dwell and a
+threshold scale (every percentage of BOOST_RULES or of --rules tables
+multiplied by it). The grid is the product of the lists given. Rule and
+model decisions are computed once per distinct (table, scale, margin)
+and reused for every dwell, so large grids stay cheap.
+
+Per variant it reports:
+  changes, changes_per_min  boost churn (ups plus downs)
+  ups, downs
+  level0_pct..level3_pct    time at each level
+  mean_level                time-weighted
+  agree_pct                 time at the boost_level that was recorded
+
+Time is weighted by the gap to the next sample of the same target; a
+gap over --gap seconds or a new target starts a new segment (the
+transition state is reset there, as the controller does on a switch).
+
+  python simulate_policy.py --input metrics_log.csv \\
+      --margin 0,2,5,10 --dwell 0.5,1,2,4 --scale 0.8,0.9,1.0,1.1 \\
+      --output variants.csv
+"""
+
+import argparse
+import csv
+import itertools
+import json
+import sys
+import time
+from pathlib import Path
+from typing import Any, Dict, List, Optional, Tuple
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+from binlog_to_csv import iter_rows  # noqa: E402
+from boost_policy import (BOOST_DWELL, BOOST_MARGIN, BOOST_RULES,  # noqa: E402
+                          RULE_OFF, BoostTransition, combine_hybrid,
+                          decide_boost_level)
+from model_tables import ModelTables, load_model_tables  # noqa: E402
+
+POLICIES = ("base", "ml", "hybrid")
+LEVELS = (0, 1, 2, 3)
+PCT_KEYS = ("avg", "max", "proc", "mem", "wait")
+
+SORT_KEYS = ("changes", "changes_per_min", "mean_level", "agree_pct",
+             "level0_pct", "level3_pct")
+
+
+def parse_list(value: str, cast=float) -> List:
+    return [cast(v) for v in value.split(",") if v.strip()]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Replay metrics logs through boost policies")
+    parser.add_argument("--input", type=str, nargs="+", default=["metrics_log.csv"],
+                        help=".csv and/or .alog files")
+    parser.add_argument("--policies", type=str, default="base",
+                        help="comma separated, from: " + ", ".join(POLICIES))
+    parser.add_argument("--margin", type=str, default=str(BOOST_MARGIN))
+    parser.add_argument("--dwell", type=str, default=str(BOOST_DWELL))
+    parser.add_argument("--scale", type=str, default="1.0",
+                        help="threshold scales, 1.0 is the table as it is")
+    parser.add_argument("--rules", type=str, default=None,
+                        help='JSON file with a list of rule tables, each like '
+                             '[[3, {"avg": 101, "max": 90, ...}], ...] (BOOST_RULES layout)')
+    parser.add_argument("--model", type=str,
+                        default=str(Path(__file__).resolve().parent.parent / "model.bin"),
+                        help="tree tables for ml / hybrid (export_model.py)")
+    parser.add_argument("--gap", type=float, default=5.0,
+                        help="seconds between samples that start a new segment")
+    parser.add_argument("--sort", choices=SORT_KEYS, default="changes")
+    parser.add_argument("--top", type=int, default=20, help="variants to print")
+    parser.add_argument("--output", type=str, default=None, help="CSV of every variant")
+    return parser.parse_args()
+
+
+# ----------------------------
+# Trace loading
+# ----------------------------
+
+def number(value: str) -> Any:
+    try:
+        f = float(value)
+    except ValueError:
+        return value
+    return int(f) if f.is_integer() else f
+
+
+def load_samples(paths: List[str]) -> List[Dict[str, Any]]:
+    samples: List[Dict[str, Any]] = []
+    for name in paths:
+        path = Path(name)
+        if not path.exists():
+            print(f"[ERROR] File not found: {path}")
+            sys.exit(1)
+        if path.suffix == ".alog":
+            samples.extend(dict(zip(fields, row))
+                           for fields, row in iter_rows(path, extra=True))
+        else:
+            with path.open(newline="") as f:
+                # short or padded rows of a log cut mid-line: keep what parses
+                samples.extend({k: number(v) for k, v in row.items()
+                                if k is not None and v not in (None, "")}
+                               for row in csv.DictReader(f))
+
+    samples = [s for s in samples if "timestamp" in s and "avg_load" in s]
+    samples.sort(key=lambda s: s["timestamp"])
+    return samples
+
+
+def segment(samples: List[Dict[str, Any]], gap: float) -> Tuple[List[bool], List[float]]:
+    """Per sample: does a new segment start here, and its time weight."""
+    starts, weights = [], []
+    prev: Optional[Dict[str, Any]] = None
+    for s in samples:
+        starts.append(prev is None or s.get("target_pid") != prev.get("target_pid") or
+                      s["timestamp"] - prev["timestamp"] > gap)
+        prev = s
+
+    for i, s in enumerate(samples):
+        nxt = samples[i + 1] if i + 1 < len(samples) else None
+        weights.append(nxt["timestamp"] - s["timestamp"]
+                       if nxt is not None and not starts[i + 1] else 0.0)
+    return starts, weights
+
+
+# ----------------------------
+# Policies
+# ----------------------------
+
+def scale_rules(rules, scale: float):
+    if scale == 1.0:
+        return rules
+    return tuple((level, {k: (min(100, round(v * scale))
+                              if k in PCT_KEYS and v < RULE_OFF else v)
+                          for k, v in r.items()})
+                 for level, r in rules)
+
+
+def rule_levels(samples, rules, margin: float) -> List[int]:
+    return [decide_boost_level(s.get("avg_load"), s.get("max_load"),
+                               s.get("proc_cpu"), s, margin, rules)
+            for s in samples]
+
+
+def simulate(raw: List[int], hold: List[int], samples, starts: List[bool],
+             weights: List[float], dwell: float) -> Dict[str, Any]:
+    transition = BoostTransition(margin=0.0, dwell=dwell)
+    at_level = dict.fromkeys(LEVELS, 0.0)
+    ups = downs = 0
+    agree = level_time = 0.0
+
+    for i, s in enumerate(samples):
+        now = s["timestamp"]
+        if starts[i]:
+            transition.reset(now=now)
+        before = transition.level
+        level = transition.update(raw[i], hold[i], now)
+        # the first decision of a segment is the target being picked, not churn
+        if not starts[i] and level > before:
+            ups += 1
+        elif not starts[i] and level < before:
+            downs += 1
+
+        w = weights[i]
+        at_level[level] = at_level.get(level, 0.0) + w
+        level_time += level * w
+        if s.get("boost_level") == level:
+            agree += w
+
+    total = sum(weights) or 1.0
+    result = {
+        "changes": ups + downs,
+        "changes_per_min": round((ups + downs) * 60.0 / total, 3),
+        "ups": ups,
+        "downs": downs,
+    }
+    for level in LEVELS:
+        result[f"level{level}_pct"] = round(at_level.get(level, 0.0) * 100.0 / total, 2)
+    result["mean_level"] = round(level_time / total, 3)
+    result["agree_pct"] = round(agree * 100.0 / total, 2)
+    return result
+
+
+def run_grid(args, samples, starts, weights,
+             model: Optional[ModelTables]) -> List[Dict[str, Any]]:
+    policies = parse_list(args.policies, str)
+    margins = parse_list(args.margin)
+    dwells = parse_list(args.dwell)
+    scales = parse_list(args.scale)
+
+    tables = [("default", BOOST_RULES)]
+    if args.rules:
+        for i, t in enumerate(json.loads(Path(args.rules).read_text())):
+            tables.append((f"rules{i}", tuple((int(level), r) for level, r in t)))
+
+    ml: Optional[List[int]] = None
+    if model is not None and ("ml" in policies or "hybrid" in policies):
+        ml = [model.predict(s) for s in samples]
+
+    cache: Dict[Tuple[str, float, float], List[int]] = {}
+
+    def rules_for(table: str, rules, scale: float, margin: float) -> List[int]:
+        key = (table, scale, margin)
+        if key not in cache:
+            cache[key] = rule_levels(samples, scale_rules(rules, scale), margin)
+        return cache[key]
+
+    variants: List[Dict[str, Any]] = []
+    for policy in policies:
+        if policy != "base" and ml is None:
+            print(f"[WARN] No model at {args.model}, skipping policy={policy}")
+            continue
+
+        if policy == "ml":
+            # margin and thresholds do not apply to the trees alone
+            grid = [("", None, "", "")]
+        else:
+            grid = [(name, rules, scale, margin) for (name, rules), scale, margin
+                    in itertools.product(tables, scales, margins)]
+
+        for name, rules, scale, margin in grid:
+            if policy == "ml":
+                raw = hold = ml
+            else:
+                raw = rules_for(name, rules, scale, 0.0)
+                hold = rules_for(name, rules, scale, margin)
+                if policy == "hybrid":
+                    raw = [combine_hybrid(m, r) for m, r in zip(ml, raw)]
+                    hold = [combine_hybrid(m, h) for m, h in zip(ml, hold)]
+
+            for dwell in dwells:
+                v = {"policy": policy, "rules": name, "scale": scale,
+                     "margin": margin, "dwell": dwell}
+                v.update(simulate(raw, hold, samples, starts, weights, dwell))
+                variants.append(v)
+
+    return variants
+
+
+def main():
+    args = parse_args()
+    unknown = [p for p in parse_list(args.policies, str) if p not in POLICIES]
+    if unknown:
+        print(f"[ERROR] Unknown policy: {', '.join(unknown)}")
+        sys.exit(1)
+
+    print(f"[INFO] Loading: {', '.join(args.input)}")
+    try:
+        samples = load_samples(args.input)
+    except ValueError as e:
+        print(f"[ERROR] {e}")
+        sys.exit(1)
+    if not samples:
+        print("[ERROR] No samples with a timestamp")
+        sys.exit(1)
+
+    starts, weights = segment(samples, args.gap)
+    print(f"[INFO] {len(samples)} samples, {sum(starts)} segments, "
+          f"{sum(weights) / 60.0:.1f} min of trace")
+
+    model = None
+    if "ml" in args.policies or "hybrid" in args.policies:
+        model = load_model_tables(Path(args.model))
+
+    t0 = time.monotonic()
+    variants = run_grid(args, samples, starts, weights, model)
+    elapsed = time.monotonic() - t0
+    print(f"[INFO] {len(variants)} variants in {elapsed:.2f}s")
+    if not variants:
+        sys.exit(1)
+
+    variants.sort(key=lambda v: v[args.sort], reverse=args.sort == "agree_pct")
+
+    columns = list(variants[0].keys())
+    shown = ["policy", "rules", "scale", "margin", "dwell", "changes_per_min",
+             "level0_pct", "level1_pct", "level2_pct", "level3_pct", "mean_level",
+             "agree_pct"]
+    widths = [max(len(c), 7) for c in shown]
+    print()
+    print(" ".join(f"{c:>{w}}" for c, w in zip(shown, widths)))
+    for v in variants[:args.top]:
+        print(" ".join(f"{v[c]!s:>{w}}" for c, w in zip(shown, widths)))
+
+    if args.output:
+        with open(args.output, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=columns)
+            writer.writeheader()
+            writer.writerows(variants)
+        print(f"[INFO] Variants saved to {Path(args.output).resolve()}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""
+mem_protect.py — protect the boosted target from reclaim through cgroup
+v2 memory.low while memory is under pressure. Shared by
+adaptive_controller.py and adaptive_daemon.py.
+
+The module boosts CPU and IO priority; reclaim can only be steered from
+userspace. While the target is boosted and memory used % reaches
+ADAPTIVE_MEM_PROTECT_PCT, or the "some avg10" of /proc/pressure/memory
+reaches ADAPTIVE_MEM_PROTECT_PSI, the target's cgroup gets memory.low
+set to its current usage plus ADAPTIVE_MEM_PROTECT_HEADROOM %, or to
+ADAPTIVE_MEM_LOW (bytes, K/M/G suffix) when given. Every other process
+in the target's cgroup is protected along with it. A cgroup is only
+protected as far as its ancestors are; ADAPTIVE_MEM_PROTECT_ANCESTORS=1
+also raises every ancestor below the root with a smaller memory.low to
+the same value, which shifts reclaim onto their other children.
+
+The original values are written back at level 0, when the target
+changes, after ADAPTIVE_MEM_PROTECT_DWELL seconds without pressure and
+on exit, including SIGTERM (see release_on_exit()). It is off unless
+ADAPTIVE_MEM_PROTECT_PCT is set.
+"""
+
+import atexit
+import os
+import signal
+import time
+from pathlib import Path
+from typing import List, Optional, Tuple
+
+CGROUP2_ROOT = Path("/sys/fs/cgroup")
+PROC_MEMINFO = Path("/proc/meminfo")
+PROC_PSI_MEMORY = Path("/proc/pressure/memory")
+
+MEM_PROTECT_PCT = os.environ.get("ADAPTIVE_MEM_PROTECT_PCT", "")
+MEM_PROTECT_ANCESTORS = os.environ.get("ADAPTIVE_MEM_PROTECT_ANCESTORS", "") == "1"
+MEM_PROTECT_PSI = float(os.environ.get("ADAPTIVE_MEM_PROTECT_PSI", "10"))
+MEM_PROTECT_HEADROOM = float(os.environ.get("ADAPTIVE_MEM_PROTECT_HEADROOM", "10"))
+MEM_PROTECT_DWELL = float(os.environ.get("ADAPTIVE_MEM_PROTECT_DWELL", "10"))
+MEM_LOW = os.environ.get("ADAPTIVE_MEM_LOW", "")
+
+SIZE_SUFFIXES = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+
+
+def parse_size(value: str) -> int:
+    """Bytes of "123", "512M", "2G"."""
+    value = value.strip().upper()
+    if value and value[-1] in SIZE_SUFFIXES:
+        return int(float(value[:-1]) * SIZE_SUFFIXES[value[-1]])
+    return int(value)
+
+
+def mem_used_pct() -> Optional[float]:
+    total = available = None
+    try:
+        with PROC_MEMINFO.open("r") as f:
+            for line in f:
+                if line.startswith("MemTotal:"):
+                    total = int(line.split()[1])
+                elif line.startswith("MemAvailable:"):
+                    available = int(line.split()[1])
+                if total is not None and available is not None:
+                    break
+    except OSError:
+        return None
+    if not total or available is None:
+        return None
+    return (1.0 - available / total) * 100.0
+
+
+def memory_psi_some() -> Optional[float]:
+    """avg10 of the "some" line of /proc/pressure/memory."""
+    try:
+        with PROC_PSI_MEMORY.open("r") as f:
+            for line in f:
+                if line.startswith("some"):
+                    for part in line.split():
+                        if part.startswith("avg10="):
+                            return float(part.split("=", 1)[1])
+    except (OSError, ValueError):
+        return None
+    return None
+
+
+def target_cgroup(pid: int) -> Optional[Path]:
+    """cgroup v2 directory of a process, None for the root or without v2."""
+    try:
+        with open(f"/proc/{pid}/cgroup", "r") as f:
+            for line in f:
+                if line.startswith("0::"):
+                    rel = line.strip()[3:].lstrip("/")
+                    return CGROUP2_ROOT / rel if rel else None
+    except OSError:
+        return None
+    return None
+
+
+class MemoryGuard:
+    """memory.low protection of the boost target, see the module docstring."""
+
+    def __init__(self):
+        self.enabled = bool(MEM_PROTECT_PCT) and \
+            (CGROUP2_ROOT / "cgroup.controllers").exists()
+        self.threshold = float(MEM_PROTECT_PCT) if MEM_PROTECT_PCT else 101.0
+        self.fixed_low = parse_size(MEM_LOW) if MEM_LOW else None
+        # (cgroup, original memory.low), in the order they were raised
+        self.saved: List[Tuple[Path, str]] = []
+        self.pid: Optional[int] = None     # target protection was tried for
+        self.calm_since: Optional[float] = None
+
+    def under_pressure(self, used_pct: Optional[float]) -> bool:
+        if used_pct is None:
+            used_pct = mem_used_pct()
+        if used_pct is not None and used_pct >= self.threshold:
+            return True
+        psi = memory_psi_some()
+        return psi is not None and psi >= MEM_PROTECT_PSI
+
+    def update(self, pid: Optional[int], level: int,
+               used_pct: Optional[float] = None, now: Optional[float] = None):
+        """Call once per control tick with the target and its boost level."""
+        if not self.enabled:
+            return
+        if not level or pid is None or (self.pid is not None and pid != self.pid):
+            self.release()
+            if not level or pid is None:
+                return
+
+        now = time.monotonic() if now is None else now
+        if self.under_pressure(used_pct):
+            self.calm_since = None
+            if self.pid is None:
+                self.protect(pid)
+        elif self.pid is not None:
+            if self.calm_since is None:
+                self.calm_since = now
+            elif now - self.calm_since >= MEM_PROTECT_DWELL:
+                self.release()
+
+    def protect(self, pid: int):
+        self.pid = pid      # tried once per target and pressure episode
+        cgroup = target_cgroup(pid)
+        if cgroup is None:
+            print(f"[WARN] Target pid {pid} is in no cgroup below the root, "
+                  f"memory.low not set")
+            return
+
+        try:
+            current = int((cgroup / "memory.current").read_text())
+        except (OSError, ValueError) as e:
+            print(f"[WARN] No memory controller for {cgroup}: {e}")
+            return
+        low = self.fixed_low if self.fixed_low is not None else \
+            int(current * (1.0 + MEM_PROTECT_HEADROOM / 100.0))
+
+        chain = [cgroup]
+        path = cgroup.parent
+        while MEM_PROTECT_ANCESTORS and path != CGROUP2_ROOT and \
+                CGROUP2_ROOT in path.parents:
+            chain.append(path)
+            path = path.parent
+        # top down, so no cgroup is ever protected beyond its parent
+        for path in reversed(chain):
+            self._raise_low(path, low)
+        print(f"[INFO] Memory pressure: memory.low={low} for {cgroup} "
+              f"(pid={pid}, current={current})")
+
+    def _raise_low(self, path: Path, low: int):
+        memory_low = path / "memory.low"
+        try:
+            orig = memory_low.read_text().strip()
+            if orig == "max" or int(orig) >= low:
+                return
+            memory_low.write_text(str(low))
+        except (OSError, ValueError) as e:
+            print(f"[WARN] Cannot set {memory_low}: {e}")
+            return
+        self.saved.append((path, orig))
+
+    def release(self):
+        for path, orig in reversed(self.saved):
+            try:
+                (path / "memory.low").write_text(orig)
+            except OSError as e:
+                print(f"[WARN] Cannot restore {path / 'memory.low'}: {e}")
+        if self.saved:
+            print("[INFO] memory.low restored")
+        self.saved = []
+        self.pid = None
+        self.calm_since = None
+
+
+def release_on_exit(guard: MemoryGuard):
+    """Restore memory.low at exit; SIGTERM exits through atexit too."""
+    def on_sigterm(signum, frame):
+        raise SystemExit(128 + signum)
+
+    atexit.register(guard.release)
+    if signal.getsignal(signal.SIGTERM) == signal.SIG_DFL:
+        signal.signal(signal.SIGTERM, on_sigterm)
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""
+model_tables.py — read and evaluate model.bin, the flat tree tables
+written by logs/export_model.py (struct adaptive_model_* in
+adaptive_sched_uapi.h). Pure Python, no pandas / sklearn at runtime.
+"""
+
+import math
+import struct
+from pathlib import Path
+from typing import Any, Dict, List, Optional, Tuple
+
+MODEL_MAGIC = 0x4C444D41  # "AMDL"
+MODEL_VERSION = 1
+MODEL_MAX_CLASSES = 4
+MODEL_MAX_SIZE = 4 << 20
+MODEL_LEAF = -1
+
+MODEL_HEADER = struct.Struct("<8I4BI")
+MODEL_FEATURE = struct.Struct("<2I")
+MODEL_ROOT = struct.Struct("<I")
+MODEL_NODE = struct.Struct("<qiI")
+
+# enum adaptive_model_feature_id -> (CSV column, default scale)
+FEATURES: Tuple[Tuple[str, int], ...] = (
+    ("avg_load", 1),
+    ("max_load", 1),
+    ("proc_cpu", 100),
+    ("mem_used_pct", 100),
+    ("procs_running", 1),
+    ("procs_blocked", 1),
+    ("loadavg1", 100),
+    ("loadavg5", 100),
+    ("loadavg15", 100),
+    ("psi_cpu_some", 100),
+    ("psi_cpu_full", 100),
+    ("proc_vms_kb", 1),
+    ("proc_rss_kb", 1),
+    ("proc_threads", 1),
+    ("proc_read_bytes", 1),
+    ("proc_write_bytes", 1),
+)
+
+FEATURE_IDS = {name: i for i, (name, _) in enumerate(FEATURES)}
+
+
+def nodes_offset(header_size: int, nr_features: int, nr_trees: int) -> int:
+    """Same as adaptive_model_nodes_offset(): nodes start 8-byte aligned."""
+    off = header_size + nr_features * MODEL_FEATURE.size + nr_trees * MODEL_ROOT.size
+    return (off + 7) & ~7
+
+
+def leaf_weights(threshold: int, nr_classes: int) -> List[int]:
+    bits = threshold & ((1 << 64) - 1)
+    return [(bits >> (16 * c)) & 0xFFFF for c in range(nr_classes)]
+
+
+class ModelTables:
+    """
+    An exported tree ensemble, evaluated with integer comparisons. Accepts
+    exactly what adaptive_model_valid() accepts, so a file that loads here
+    also uploads to policy_model.
+    """
+
+    def __init__(self, data: bytes):
+        if len(data) < MODEL_HEADER.size:
+            raise ValueError("model too short")
+        if len(data) > MODEL_MAX_SIZE:
+            raise ValueError("model too large")
+
+        (magic, version, size, total_size, nr_features, nr_trees, nr_nodes,
+         nr_classes, *rest) = MODEL_HEADER.unpack_from(data)
+        if magic != MODEL_MAGIC or version != MODEL_VERSION:
+            raise ValueError("not a model.bin of a known version")
+        if not MODEL_HEADER.size <= size <= len(data) or total_size != len(data) or \
+                not 0 < nr_classes <= MODEL_MAX_CLASSES:
+            raise ValueError("corrupt model header")
+        if nr_features > len(FEATURES) or not nr_trees or \
+                nr_trees > len(data) // MODEL_ROOT.size or \
+                nr_nodes > len(data) // MODEL_NODE.size:
+            raise ValueError("corrupt model header")
+
+        self.classes = list(rest[:nr_classes])
+        self.nr_classes = nr_classes
+
+        off = size
+        self.features: List[Tuple[str, int]] = []
+        for _ in range(nr_features):
+            fid, scale = MODEL_FEATURE.unpack_from(data, off)
+            if fid >= len(FEATURES):
+                raise ValueError(f"unknown feature id {fid}")
+            if not scale:
+                raise ValueError(f"zero scale for feature {FEATURES[fid][0]}")
+            self.features.append((FEATURES[fid][0], scale))
+            off += MODEL_FEATURE.size
+
+        self.roots = [MODEL_ROOT.unpack_from(data, off + i * MODEL_ROOT.size)[0]
+                      for i in range(nr_trees)]
+
+        off = nodes_offset(size, nr_features, nr_trees)
+        if off + nr_nodes * MODEL_NODE.size > len(data):
+            raise ValueError("model truncated")
+        self.nodes = [MODEL_NODE.unpack_from(data, off + i * MODEL_NODE.size)
+                      for i in range(nr_nodes)]
+
+        for i, (_, feature, right) in enumerate(self.nodes):
+            if feature == MODEL_LEAF:
+                continue
+            if not 0 <= feature < nr_features or not i + 1 < right < nr_nodes:
+                raise ValueError(f"bad node {i}")
+        if any(r >= nr_nodes for r in self.roots):
+            raise ValueError("bad tree root")
+
+    @classmethod
+    def load(cls, path: Path) -> "ModelTables":
+        return cls(Path(path).read_bytes())
+
+    def scaled(self, features: Dict[str, Any]) -> List[int]:
+        """Feature vector in table order, as the integers the splits compare."""
+        return [math.floor(float(features.get(name, 0) or 0) * scale)
+                for name, scale in self.features]
+
+    def predict(self, features: Dict[str, Any]) -> int:
+        x = self.scaled(features)
+        nodes = self.nodes
+        totals = [0] * self.nr_classes
+
+        for i in self.roots:
+            threshold, feature, right = nodes[i]
+            while feature != MODEL_LEAF:
+                i = i + 1 if x[feature] <= threshold else right
+                threshold, feature, right = nodes[i]
+            for c, w in enumerate(leaf_weights(threshold, self.nr_classes)):
+                totals[c] += w
+
+        best = max(range(self.nr_classes), key=lambda c: totals[c])
+        return self.classes[best]
+
+
+def load_model_tables(path: Path) -> Optional[ModelTables]:
+    """ModelTables from path, None (with a warning) if it is missing or bad."""
+    try:
+        return ModelTables.load(path)
+    except FileNotFoundError:
+        return None
+    except (OSError, ValueError, struct.error) as e:
+        print(f"[WARN] Cannot load {path}: {e}")
+        return None